@@ -0,0 +1,127 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/alloc_counter.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <new>
+
+namespace xpaf {
+
+namespace {
+
+// Per-thread counts. Plain old data, so that operator new can use them at
+// any point in a thread's life.
+struct ThreadAllocCounts {
+  bool counting;
+  int64 allocs;
+  int64 bytes;
+  int64 live_bytes;
+  int64 peak_live_bytes;
+};
+
+__thread ThreadAllocCounts thread_counts;
+
+}  // namespace
+
+void AllocCounter::Start() {
+  thread_counts.counting = true;
+}
+
+void AllocCounter::Stop() {
+  thread_counts.counting = false;
+}
+
+void AllocCounter::Reset() {
+  const bool counting = thread_counts.counting;
+  thread_counts = ThreadAllocCounts();
+  thread_counts.counting = counting;
+}
+
+AllocStats AllocCounter::Get() {
+  AllocStats stats;
+  stats.allocs = thread_counts.allocs;
+  stats.bytes = thread_counts.bytes;
+  stats.peak_live_bytes = thread_counts.peak_live_bytes;
+  return stats;
+}
+
+void AllocCounter::RecordAlloc(void* ptr) {
+  ThreadAllocCounts* const counts = &thread_counts;
+  if (!counts->counting || ptr == NULL) return;
+  const int64 size = malloc_usable_size(ptr);
+  ++counts->allocs;
+  counts->bytes += size;
+  counts->live_bytes += size;
+  if (counts->live_bytes > counts->peak_live_bytes) {
+    counts->peak_live_bytes = counts->live_bytes;
+  }
+}
+
+void AllocCounter::RecordFree(void* ptr) {
+  ThreadAllocCounts* const counts = &thread_counts;
+  if (!counts->counting || ptr == NULL) return;
+  counts->live_bytes -= malloc_usable_size(ptr);
+}
+
+void* AllocCounter::Realloc(void* ptr, size_t size) {
+  ThreadAllocCounts* const counts = &thread_counts;
+  // The old block can't be measured once realloc() succeeds.
+  const int64 old_size =
+      counts->counting && ptr != NULL ? malloc_usable_size(ptr) : 0;
+  void* const new_ptr = realloc(ptr, size);
+  if (new_ptr != NULL) {
+    counts->live_bytes -= old_size;
+    RecordAlloc(new_ptr);
+  }
+  return new_ptr;
+}
+
+}  // namespace xpaf
+
+// Replacements for the global allocation functions. The array and sized
+// forms forward to these by default.
+
+#if __cplusplus >= 201103L
+#define XPAF_THROW_BAD_ALLOC
+#define XPAF_NOTHROW noexcept
+#else
+#define XPAF_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define XPAF_NOTHROW throw()
+#endif
+
+void* operator new(size_t size) XPAF_THROW_BAD_ALLOC {
+  void* const ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) throw std::bad_alloc();
+  xpaf::AllocCounter::RecordAlloc(ptr);
+  return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) XPAF_NOTHROW {
+  void* const ptr = malloc(size == 0 ? 1 : size);
+  xpaf::AllocCounter::RecordAlloc(ptr);
+  return ptr;
+}
+
+void operator delete(void* ptr) XPAF_NOTHROW {
+  xpaf::AllocCounter::RecordFree(ptr);
+  free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) XPAF_NOTHROW {
+  xpaf::AllocCounter::RecordFree(ptr);
+  free(ptr);
+}
@@ -0,0 +1,66 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Counts heap allocations for benchmarking. Linking alloc_counter.cc
+// replaces the global operator new and delete so that, between Start() and
+// Stop(), the calling thread's allocations are tallied. Other allocators
+// (e.g. libxml2's, via xmlMemSetup()) can report through RecordAlloc(),
+// RecordFree() and Realloc().
+//
+// Sizes are malloc_usable_size() of each block, so they include the
+// allocator's rounding. Counts are per thread. Memory freed on a thread
+// other than the one that allocated it is credited to the freeing thread.
+
+#ifndef XPAF_BASE_ALLOC_COUNTER_H_
+#define XPAF_BASE_ALLOC_COUNTER_H_
+
+#include <stddef.h>
+
+#include "base/integral_types.h"
+
+namespace xpaf {
+
+struct AllocStats {
+  int64 allocs;           // number of allocations
+  int64 bytes;            // total bytes allocated
+  int64 peak_live_bytes;  // peak of bytes allocated minus bytes freed
+};
+
+class AllocCounter {
+ public:
+  // Starts or stops counting the calling thread's allocations.
+  static void Start();
+  static void Stop();
+
+  // Zeroes the calling thread's counts.
+  static void Reset();
+
+  // Returns the calling thread's counts since the last Reset().
+  static AllocStats Get();
+
+  // Records that the calling thread allocated the block at 'ptr' (which may
+  // be NULL), or is about to free it. Block sizes come from the C
+  // allocator, so 'ptr' must come from malloc() or realloc().
+  static void RecordAlloc(void* ptr);
+  static void RecordFree(void* ptr);
+
+  // Calls realloc() and records the old block's free and the new block's
+  // allocation. If realloc() fails, 'ptr' is still allocated and nothing is
+  // recorded.
+  static void* Realloc(void* ptr, size_t size);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_ALLOC_COUNTER_H_
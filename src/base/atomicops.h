@@ -0,0 +1,71 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Minimal atomic operations with explicit memory ordering, implemented with
+// GCC __atomic builtins. Names follow the usual Google atomicops convention.
+
+#ifndef XPAF_BASE_ATOMICOPS_H_
+#define XPAF_BASE_ATOMICOPS_H_
+
+#include "base/integral_types.h"
+
+namespace xpaf {
+
+// Loads *ptr. No later memory access can be reordered before this load.
+template <typename T>
+inline T Acquire_Load(const volatile T* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+// Stores 'value' to *ptr. No earlier memory access can be reordered after this
+// store.
+template <typename T>
+inline void Release_Store(volatile T* ptr, T value) {
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+// Atomically adds 'increment' to *ptr and returns the new value. Acts as a
+// full memory barrier.
+inline int32 Barrier_AtomicIncrement(volatile int32* ptr, int32 increment) {
+  return __atomic_add_fetch(ptr, increment, __ATOMIC_SEQ_CST);
+}
+
+inline int64 Barrier_AtomicIncrement(volatile int64* ptr, int64 increment) {
+  return __atomic_add_fetch(ptr, increment, __ATOMIC_SEQ_CST);
+}
+
+// Atomically adds 'increment' to *ptr and returns the new value. Imposes no
+// ordering on other memory accesses.
+inline int32 NoBarrier_AtomicIncrement(volatile int32* ptr, int32 increment) {
+  return __atomic_add_fetch(ptr, increment, __ATOMIC_RELAXED);
+}
+
+inline int64 NoBarrier_AtomicIncrement(volatile int64* ptr, int64 increment) {
+  return __atomic_add_fetch(ptr, increment, __ATOMIC_RELAXED);
+}
+
+// Loads *ptr atomically, imposing no ordering on other memory accesses.
+template <typename T>
+inline T NoBarrier_Load(const volatile T* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+// Full memory barrier: no memory access can be reordered across it.
+inline void MemoryBarrier() {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_ATOMICOPS_H_
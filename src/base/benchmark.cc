@@ -13,20 +13,66 @@
 // limitations under the License.
 
 // Modeled after re2: http://code.google.com/p/re2/
+//
+// Each benchmark is calibrated to run for at least --benchmark_min_time
+// seconds and then run --benchmark_repetitions times with the calibrated
+// iteration count. Results are printed as text or, with
+// --benchmark_format=json, as JSON. --benchmark_compare=old.json,new.json
+// compares two JSON result files instead of running benchmarks.
+// --benchmark_perf_counters adds hardware counters (cycles, instructions,
+// LLC misses, branch misses) per op, where the kernel allows it.
+// --benchmark_alloc_stats adds heap allocations and bytes per op, and peak
+// live bytes, as counted by AllocCounter.
 
 #include "base/benchmark.h"
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <fstream>
 #include <string>
+#include <vector>
 
 #include <re2/re2.h>
 
+#include "base/alloc_counter.h"
+#include "base/commandlineflags.h"
 #include "base/integral_types.h"
 #include "base/logging.h"
+#include "base/mutex.h"
+#include "base/perf_counters.h"
+#include "base/scoped_ptr.h"
 #include "base/stl_decl.h"
+#include "base/timer.h"
+
+DEFINE_int32(benchmark_repetitions, 1,
+             "Number of times to run each benchmark with the calibrated "
+             "iteration count. With more than one repetition, the spread of "
+             "ns/op across repetitions is reported.");
+DEFINE_double(benchmark_min_time, 1.0,
+              "Minimum wall time, in seconds, of each benchmark run.");
+DEFINE_string(benchmark_format, "text", "Output format: 'text' or 'json'.");
+DEFINE_string(benchmark_compare, "",
+              "If set to 'old.json,new.json', compares two result files "
+              "written with --benchmark_format=json instead of running "
+              "benchmarks. Exits with status 1 if any benchmark regressed "
+              "significantly.");
+DEFINE_bool(benchmark_perf_counters, false,
+            "If true, reads hardware performance counters around each "
+            "benchmark and reports them per op. Counters that the kernel "
+            "doesn't provide are omitted.");
+DEFINE_bool(benchmark_alloc_stats, false,
+            "If true, counts heap allocations while each benchmark is "
+            "timed and reports allocations and bytes per op, and peak live "
+            "bytes.");
+DEFINE_double(benchmark_regression_threshold, 0.05,
+              "In compare mode, the minimum relative increase in mean ns/op "
+              "that is reported as a regression.");
 
 namespace xpaf {
 
@@ -48,26 +94,33 @@ void Benchmark::Register() {
   nbenchmarks++;
 }
 
-static int64 nsec() {
-  struct timeval tv;
-  CHECK_NE(gettimeofday(&tv, NULL), -1);
-  return static_cast<int64>(tv.tv_sec)*1000*1000*1000 + tv.tv_usec*1000;
-}
-
-static int64 ns;
-static int64 t0;
-static int64 bytes;
-static int64 items;
+// Timing state for the benchmark function running on the current thread. In
+// threaded benchmarks, each thread times itself.
+static __thread int64 ns;
+static __thread int64 cpu_ns;
+static __thread int64 t0;
+static __thread int64 cpu_t0;
+static __thread int64 bytes;
+static __thread int64 items;
+static __thread PerfCounters* perf_counters;  // NULL unless enabled
 
 void StopBenchmarkTiming() {
-  if (t0 != 0)
-    ns += nsec() - t0;
+  if (t0 != 0) {
+    if (perf_counters != NULL) perf_counters->Stop();
+    if (FLAGS_benchmark_alloc_stats) AllocCounter::Stop();
+    ns += MonotonicNanos() - t0;
+    cpu_ns += ThreadCpuNanos() - cpu_t0;
+  }
   t0 = 0;
 }
 
 void StartBenchmarkTiming() {
-  if (t0 == 0)
-    t0 = nsec();
+  if (t0 == 0) {
+    t0 = MonotonicNanos();
+    cpu_t0 = ThreadCpuNanos();
+    if (perf_counters != NULL) perf_counters->Start();
+    if (FLAGS_benchmark_alloc_stats) AllocCounter::Start();
+  }
 }
 
 void SetBenchmarkBytesProcessed(int64 x) {
@@ -79,14 +132,46 @@ void SetBenchmarkItemsProcessed(int n) {
 }
 
 int NumCPUs() {
-  return 1;
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT
+  return n > 0 ? static_cast<int>(n) : 1;
 }
 
-static void runN(Benchmark* b, int n, int siz) {
+// Results of running a benchmark function once on each of one or more
+// threads.
+struct RunResult {
+  int64 ns;              // mean timed wall nanoseconds per thread
+  int64 cpu_ns;          // mean timed CPU nanoseconds per thread
+  double ops_per_sec;    // summed over threads
+  double bytes_per_sec;  // summed over threads
+  double items_per_sec;  // summed over threads
+  // Hardware counts summed over threads, or -1 for unavailable counters.
+  int64 counters[PerfCounters::kNumCounters];
+  // Summed over threads, except for peak_live_bytes, which is the sum of
+  // each thread's peak.
+  AllocStats alloc_stats;
+
+  RunResult()
+      : ns(0), cpu_ns(0), ops_per_sec(0), bytes_per_sec(0), items_per_sec(0) {
+    alloc_stats.allocs = 0;
+    alloc_stats.bytes = 0;
+    alloc_stats.peak_live_bytes = 0;
+    for (int i = 0; i < PerfCounters::kNumCounters; ++i) counters[i] = -1;
+  }
+};
+
+// Runs the benchmark function with 'n' iterations on the current thread,
+// and records the thread's timing state in 'result'.
+static void runOne(Benchmark* b, int n, int siz, RunResult* result) {
   bytes = 0;
   items = 0;
   ns = 0;
-  t0 = nsec();
+  cpu_ns = 0;
+  t0 = 0;
+  scoped_ptr<PerfCounters> counters;
+  if (FLAGS_benchmark_perf_counters) counters.reset(new PerfCounters);
+  perf_counters = counters.get();
+  AllocCounter::Reset();
+  StartBenchmarkTiming();
   if (b->fn) {
     b->fn(n);
   } else if (b->fnr) {
@@ -94,7 +179,105 @@ static void runN(Benchmark* b, int n, int siz) {
   } else {
     LOG(FATAL) << "Missing function: " <<  b->name;
   }
-  if (t0 != 0) ns += nsec() - t0;
+  StopBenchmarkTiming();
+  perf_counters = NULL;
+  result->alloc_stats = AllocCounter::Get();
+  result->ns = ns;
+  result->cpu_ns = cpu_ns;
+  if (counters.get() != NULL) {
+    for (int i = 0; i < PerfCounters::kNumCounters; ++i) {
+      result->counters[i] = counters->Value(PerfCounters::Counter(i));
+    }
+  }
+  if (ns > 0) {
+    const double secs = static_cast<double>(ns) / 1e9;
+    result->ops_per_sec = n / secs;
+    result->bytes_per_sec = bytes / secs;
+    result->items_per_sec = items / secs;
+  }
+}
+
+// Shared by the threads of a threaded run. The threads wait at a barrier so
+// that they start the benchmark function at the same time.
+struct ThreadedRun {
+  Benchmark* b;
+  int n;
+  int siz;
+  int nthread;
+
+  Mutex mu;
+  CondVar all_ready;
+  int num_ready;
+  vector<RunResult> results;
+};
+
+struct ThreadArg {
+  ThreadedRun* run;
+  int index;
+};
+
+static void* threadMain(void* arg_ptr) {
+  ThreadArg* arg = static_cast<ThreadArg*>(arg_ptr);
+  ThreadedRun* run = arg->run;
+  {
+    MutexLock lock(&run->mu);
+    if (++run->num_ready == run->nthread) {
+      run->all_ready.SignalAll();
+    } else {
+      while (run->num_ready < run->nthread) run->all_ready.Wait(&run->mu);
+    }
+  }
+  runOne(run->b, run->n, run->siz, &run->results[arg->index]);
+  return NULL;
+}
+
+// Runs the benchmark function with 'n' iterations on each of 'nthread'
+// threads, and aggregates their results.
+static RunResult runN(Benchmark* b, int n, int siz, int nthread) {
+  if (nthread == 1) {
+    RunResult result;
+    runOne(b, n, siz, &result);
+    return result;
+  }
+
+  ThreadedRun run;
+  run.b = b;
+  run.n = n;
+  run.siz = siz;
+  run.nthread = nthread;
+  run.num_ready = 0;
+  run.results.resize(nthread);
+  vector<ThreadArg> args(nthread);
+  vector<pthread_t> threads(nthread);
+  for (int i = 0; i < nthread; ++i) {
+    args[i].run = &run;
+    args[i].index = i;
+    CHECK_EQ(pthread_create(&threads[i], NULL, &threadMain, &args[i]), 0);
+  }
+  for (int i = 0; i < nthread; ++i) {
+    CHECK_EQ(pthread_join(threads[i], NULL), 0);
+  }
+
+  RunResult total;
+  for (int i = 0; i < nthread; ++i) {
+    total.ns += run.results[i].ns;
+    total.cpu_ns += run.results[i].cpu_ns;
+    total.ops_per_sec += run.results[i].ops_per_sec;
+    total.bytes_per_sec += run.results[i].bytes_per_sec;
+    total.items_per_sec += run.results[i].items_per_sec;
+    total.alloc_stats.allocs += run.results[i].alloc_stats.allocs;
+    total.alloc_stats.bytes += run.results[i].alloc_stats.bytes;
+    total.alloc_stats.peak_live_bytes +=
+        run.results[i].alloc_stats.peak_live_bytes;
+    for (int j = 0; j < PerfCounters::kNumCounters; ++j) {
+      const int64 count = run.results[i].counters[j];
+      if (count < 0) continue;
+      total.counters[j] = max<int64>(total.counters[j], 0) + count;
+    }
+  }
+  total.ns /= nthread;
+  total.cpu_ns /= nthread;
+  return total;
 }
 
 static int round(int n) {
@@ -108,53 +291,229 @@ static int round(int n) {
   return 10*base;
 }
 
+// Summary statistics of a set of samples.
+struct SampleStats {
+  double mean;
+  double stddev;  // sample standard deviation; 0 for a single sample
+  double min;
+  double p50;
+  double p90;
+};
+
+// Returns the nearest-rank percentile 'p' (in [0, 1]) of sorted 'samples'.
+static double percentile(const vector<double>& samples, double p) {
+  int rank = static_cast<int>(ceil(p * samples.size()));
+  rank = max(1, min(rank, static_cast<int>(samples.size())));
+  return samples[rank - 1];
+}
+
+static SampleStats computeStats(vector<double> samples) {
+  CHECK(!samples.empty());
+  sort(samples.begin(), samples.end());
+  SampleStats stats;
+  double sum = 0;
+  for (int i = 0; i < samples.size(); ++i) sum += samples[i];
+  stats.mean = sum / samples.size();
+  double sum_sq = 0;
+  for (int i = 0; i < samples.size(); ++i) {
+    sum_sq += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+  }
+  stats.stddev =
+      samples.size() > 1 ? sqrt(sum_sq / (samples.size() - 1)) : 0;
+  stats.min = samples[0];
+  stats.p50 = percentile(samples, 0.5);
+  stats.p90 = percentile(samples, 0.9);
+  return stats;
+}
+
+static string jsonDoubleArray(const vector<double>& values) {
+  string s = "[";
+  char buf[32];
+  for (int i = 0; i < values.size(); ++i) {
+    snprintf(buf, sizeof buf, "%s%.1f", i > 0 ? ", " : "", values[i]);
+    s += buf;
+  }
+  return s + "]";
+}
+
+static bool first_json_result = true;
+
+// Calibrates the iteration count, runs the benchmark
+// --benchmark_repetitions times, and prints the results.
+//
+// With nthread > 1, ns/op is the mean time per iteration as seen by each
+// thread, while MB/s, items/s, and ops/s are aggregate throughputs.
 static void RunBench(Benchmark* b, int nthread, int siz, int max_name_len) {
+  const int64 min_ns = static_cast<int64>(FLAGS_benchmark_min_time * 1e9);
   int n, last;
 
-  // TODO(sadovsky): Threaded benchmarks.
-  if (nthread != 1)
-    return;
-
   // Run once in case it's expensive.
   n = 1;
-  runN(b, n, siz);
-  while (ns < static_cast<int>(1e9) && n < static_cast<int>(1e9)) {
+  RunResult result = runN(b, n, siz, nthread);
+  while (result.ns < min_ns && n < static_cast<int>(1e9)) {
     last = n;
-    if (ns/n == 0)
+    if (result.ns/n == 0)
       n = 1e9;
     else
-      n = 1e9 / (ns/n);
+      n = min_ns / (result.ns/n);
 
     n = max(last+1, min(n+n/2, 100*last));
     n = round(n);
-    runN(b, n, siz);
+    result = runN(b, n, siz, nthread);
+  }
+
+  // The final calibration run counts as the first repetition.
+  vector<RunResult> runs(1, result);
+  for (int i = 1; i < FLAGS_benchmark_repetitions; ++i) {
+    runs.push_back(runN(b, n, siz, nthread));
+  }
+  vector<double> ns_per_op;
+  vector<double> cpu_ns_per_op;
+  double ops_per_sec = 0;
+  double bytes_per_sec = 0;
+  double items_per_sec = 0;
+  for (int i = 0; i < runs.size(); ++i) {
+    ns_per_op.push_back(static_cast<double>(runs[i].ns) / n);
+    cpu_ns_per_op.push_back(static_cast<double>(runs[i].cpu_ns) / n);
+    ops_per_sec += runs[i].ops_per_sec / runs.size();
+    bytes_per_sec += runs[i].bytes_per_sec / runs.size();
+    items_per_sec += runs[i].items_per_sec / runs.size();
+  }
+  const SampleStats stats = computeStats(ns_per_op);
+  const SampleStats cpu_stats = computeStats(cpu_ns_per_op);
+
+  // Hardware counts per op, averaged over repetitions; -1 if unavailable.
+  double per_op[PerfCounters::kNumCounters];
+  for (int j = 0; j < PerfCounters::kNumCounters; ++j) {
+    per_op[j] = 0;
+    for (int i = 0; i < runs.size(); ++i) {
+      if (runs[i].counters[j] < 0) {
+        per_op[j] = -1;
+        break;
+      }
+      per_op[j] += static_cast<double>(runs[i].counters[j]) /
+          (static_cast<double>(n) * nthread * runs.size());
+    }
+  }
+  // Allocations and bytes per op, averaged over repetitions, and the
+  // largest peak.
+  double allocs_per_op = 0;
+  double alloc_bytes_per_op = 0;
+  int64 peak_live_bytes = 0;
+  for (int i = 0; i < runs.size(); ++i) {
+    const double ops = static_cast<double>(n) * nthread * runs.size();
+    allocs_per_op += runs[i].alloc_stats.allocs / ops;
+    alloc_bytes_per_op += runs[i].alloc_stats.bytes / ops;
+    peak_live_bytes = max(peak_live_bytes, runs[i].alloc_stats.peak_live_bytes);
+  }
+
+  if (FLAGS_benchmark_perf_counters) {
+    static bool checked = false;
+    if (!checked) {
+      const PerfCounters probe;
+      if (!probe.any_available()) {
+        LOG(WARNING) << "Hardware performance counters are unavailable; "
+                     << "check kernel.perf_event_paranoid";
+      }
+      checked = true;
+    }
   }
 
-  char mb[100];
   char suf[100];
-  mb[0] = '\0';
+  char thr[100];
   suf[0] = '\0';
-  if (ns > 0 && bytes > 0)
-    snprintf(mb, sizeof mb, "\t%7.2f MB/s",
-             (static_cast<double>(bytes)/1e6) / (static_cast<double>(ns)/1e9));
+  thr[0] = '\0';
   if (b->fnr || b->lo != b->hi) {
-    if (siz >= (1<<20))
+    if (siz >= (1<<20) && siz % (1<<20) == 0)
       snprintf(suf, sizeof suf, "/%dM", siz/(1<<20));
-    else if (siz >= (1<<10))
+    else if (siz >= (1<<10) && siz % (1<<10) == 0)
       snprintf(suf, sizeof suf, "/%dK", siz/(1<<10));
     else
       snprintf(suf, sizeof suf, "/%d", siz);
   }
-  printf("%-*s\t%10lld\t%10lld ns/op%s\n",
-         max_name_len + 8,
-         (string(b->name) + string(suf)).c_str(),
-         static_cast<int64>(n),
-         static_cast<int64>(ns/n),
-         mb);
+  if (b->threadlo != b->threadhi)
+    snprintf(thr, sizeof thr, "/threads:%d", nthread);
+  const string name = string(b->name) + string(suf) + string(thr);
+
+  if (FLAGS_benchmark_format == "json") {
+    printf("%s    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %d, "
+           "\"repetitions\": %d, \"ns_per_op\": %s, \"cpu_ns_per_op\": %s, "
+           "\"mean_ns_per_op\": %.1f, \"stddev_ns_per_op\": %.1f, "
+           "\"min_ns_per_op\": %.1f, \"p50_ns_per_op\": %.1f, "
+           "\"p90_ns_per_op\": %.1f, \"mean_cpu_ns_per_op\": %.1f, "
+           "\"bytes_per_sec\": %.1f, \"items_per_sec\": %.1f",
+           first_json_result ? "" : ",\n",
+           name.c_str(), nthread, n, static_cast<int>(runs.size()),
+           jsonDoubleArray(ns_per_op).c_str(),
+           jsonDoubleArray(cpu_ns_per_op).c_str(),
+           stats.mean, stats.stddev, stats.min, stats.p50, stats.p90,
+           cpu_stats.mean, bytes_per_sec, items_per_sec);
+    for (int j = 0; j < PerfCounters::kNumCounters; ++j) {
+      if (per_op[j] >= 0) {
+        printf(", \"%s_per_op\": %.2f",
+               PerfCounters::Name(PerfCounters::Counter(j)), per_op[j]);
+      }
+    }
+    if (FLAGS_benchmark_alloc_stats) {
+      printf(", \"allocs_per_op\": %.2f, \"alloc_bytes_per_op\": %.1f, "
+             "\"peak_live_bytes\": %lld", allocs_per_op, alloc_bytes_per_op,
+             static_cast<long long>(peak_live_bytes));  // NOLINT
+    }
+    printf("}");
+    first_json_result = false;
+    fflush(stdout);
+    return;
+  }
+
+  char spread[200];
+  char mb[100];
+  char ips[100];
+  char ops[100];
+  char hw[200];
+  char alloc[200];
+  alloc[0] = '\0';
+  spread[0] = '\0';
+  mb[0] = '\0';
+  ips[0] = '\0';
+  ops[0] = '\0';
+  hw[0] = '\0';
+  if (runs.size() > 1) {
+    snprintf(spread, sizeof spread,
+             " +-%5.1f%%\tmin %10.0f\tp50 %10.0f\tp90 %10.0f",
+             stats.mean > 0 ? 100 * stats.stddev / stats.mean : 0.0,
+             stats.min, stats.p50, stats.p90);
+  }
+  if (bytes_per_sec > 0)
+    snprintf(mb, sizeof mb, "\t%7.2f MB/s", bytes_per_sec / 1e6);
+  if (items_per_sec > 0)
+    snprintf(ips, sizeof ips, "\t%10.0f items/s", items_per_sec);
+  if (nthread > 1)
+    snprintf(ops, sizeof ops, "\t%10.0f ops/s", ops_per_sec);
+  for (int j = 0; j < PerfCounters::kNumCounters; ++j) {
+    if (per_op[j] < 0) continue;
+    const size_t len = strlen(hw);
+    snprintf(hw + len, sizeof(hw) - len, "\t%10.1f %s/op",
+             per_op[j], PerfCounters::Name(PerfCounters::Counter(j)));
+  }
+  if (per_op[PerfCounters::CYCLES] > 0 &&
+      per_op[PerfCounters::INSTRUCTIONS] >= 0) {
+    const size_t len = strlen(hw);
+    snprintf(hw + len, sizeof(hw) - len, "\t%5.2f IPC",
+             per_op[PerfCounters::INSTRUCTIONS] / per_op[PerfCounters::CYCLES]);
+  }
+  if (FLAGS_benchmark_alloc_stats) {
+    snprintf(alloc, sizeof alloc,
+             "\t%10.1f allocs/op\t%10.0f B/op\t%10lld peak B",
+             allocs_per_op, alloc_bytes_per_op,
+             static_cast<long long>(peak_live_bytes));  // NOLINT
+  }
+  printf("%-*s\t%10d\t%10.0f ns/op%s\t%10.0f cpu ns/op%s%s%s%s%s\n",
+         max_name_len + 20, name.c_str(), n, stats.mean, spread,
+         cpu_stats.mean, mb, ips, ops, hw, alloc);
   fflush(stdout);
 }
 
-static int match(const char* name, int argc, const char** argv) {
+static int match(const char* name, int argc, char** argv) {
   if (argc == 1)
     return 1;
   for (int i = 1; i < argc; i++)
@@ -163,16 +522,146 @@ static int match(const char* name, int argc, const char** argv) {
   return 0;
 }
 
+// Reads the per-repetition ns/op samples of each benchmark from a file
+// written with --benchmark_format=json. Returns false if the file can't be
+// read.
+static bool readJsonResults(const string& filename,
+                            vector<string>* names,
+                            vector<vector<double> >* samples) {
+  std::ifstream in(filename.c_str());
+  if (!in) return false;
+  static const RE2 name_re("\"name\": \"([^\"]*)\"");
+  static const RE2 samples_re("\"ns_per_op\": \\[([^\\]]*)\\]");
+  string line;
+  while (getline(in, line)) {
+    string name, values;
+    if (!RE2::PartialMatch(line, name_re, &name) ||
+        !RE2::PartialMatch(line, samples_re, &values)) {
+      continue;
+    }
+    vector<double> v;
+    const char* p = values.c_str();
+    char* end;
+    for (double x = strtod(p, &end); end != p; x = strtod(p, &end)) {
+      v.push_back(x);
+      p = end;
+      while (*p == ',' || *p == ' ') ++p;
+    }
+    if (v.empty()) continue;
+    names->push_back(name);
+    samples->push_back(v);
+  }
+  return true;
+}
+
+// Two-sided critical values of Student's t-distribution at the 5% level,
+// indexed by degrees of freedom minus one.
+static const double kTCritical[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double tCritical(double df) {
+  const int kNumValues = sizeof(kTCritical) / sizeof(kTCritical[0]);
+  const int d = static_cast<int>(df);  // round down, to be conservative
+  if (d < 1) return kTCritical[0];
+  if (d <= kNumValues) return kTCritical[d - 1];
+  if (d <= 60) return 2.000;
+  if (d <= 120) return 1.980;
+  return 1.960;
+}
+
+// Returns whether the means of 'a' and 'b' differ significantly, by
+// Welch's t-test at the 5% level. Needs at least two samples of each.
+static bool significantlyDifferent(const vector<double>& a,
+                                   const vector<double>& b) {
+  if (a.size() < 2 || b.size() < 2) return false;
+  const SampleStats sa = computeStats(a);
+  const SampleStats sb = computeStats(b);
+  const double va = sa.stddev * sa.stddev / a.size();
+  const double vb = sb.stddev * sb.stddev / b.size();
+  if (va + vb == 0) return sa.mean != sb.mean;
+  const double t = fabs(sa.mean - sb.mean) / sqrt(va + vb);
+  const double df = (va + vb) * (va + vb) /
+      (va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+  return t > tCritical(df);
+}
+
+// Compares the results in two JSON files, given as "old.json,new.json".
+// Returns the process exit status: 1 if any benchmark regressed
+// significantly, 2 on bad input, and 0 otherwise.
+static int CompareResults(const string& files) {
+  const size_t comma = files.find(',');
+  if (comma == string::npos) {
+    LOG(ERROR) << "--benchmark_compare wants old.json,new.json";
+    return 2;
+  }
+  const string old_file = files.substr(0, comma);
+  const string new_file = files.substr(comma + 1);
+  vector<string> old_names, new_names;
+  vector<vector<double> > old_samples, new_samples;
+  if (!readJsonResults(old_file, &old_names, &old_samples)) {
+    LOG(ERROR) << "Failed to read " << old_file;
+    return 2;
+  }
+  if (!readJsonResults(new_file, &new_names, &new_samples)) {
+    LOG(ERROR) << "Failed to read " << new_file;
+    return 2;
+  }
+
+  int max_name_len = 0;
+  for (int i = 0; i < new_names.size(); ++i) {
+    max_name_len = max(max_name_len, static_cast<int>(new_names[i].size()));
+  }
+  printf("%-*s\t%12s\t%12s\t%8s\n", max_name_len, "benchmark",
+         "old ns/op", "new ns/op", "change");
+  int num_regressions = 0;
+  for (int i = 0; i < new_names.size(); ++i) {
+    const int j = find(old_names.begin(), old_names.end(), new_names[i]) -
+        old_names.begin();
+    if (j == old_names.size()) continue;
+    const double old_mean = computeStats(old_samples[j]).mean;
+    const double new_mean = computeStats(new_samples[i]).mean;
+    const double change = old_mean > 0 ? new_mean / old_mean - 1 : 0;
+    const char* verdict = "";
+    if (old_samples[j].size() < 2 || new_samples[i].size() < 2) {
+      verdict = "(too few repetitions)";
+    } else if (!significantlyDifferent(old_samples[j], new_samples[i])) {
+      verdict = "";
+    } else if (change > FLAGS_benchmark_regression_threshold) {
+      verdict = "REGRESSION";
+      ++num_regressions;
+    } else if (change < -FLAGS_benchmark_regression_threshold) {
+      verdict = "improvement";
+    }
+    printf("%-*s\t%12.0f\t%12.0f\t%+7.1f%%\t%s\n", max_name_len,
+           new_names[i].c_str(), old_mean, new_mean, 100 * change, verdict);
+  }
+  return num_regressions > 0 ? 1 : 0;
+}
+
 }  // namespace xpaf
 
 using namespace xpaf;  // NOLINT
 
-int main(int argc, const char** argv) {
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (!FLAGS_benchmark_compare.empty()) {
+    return CompareResults(FLAGS_benchmark_compare);
+  }
+  const bool json = FLAGS_benchmark_format == "json";
+  if (!json && FLAGS_benchmark_format != "text") {
+    LOG(ERROR) << "Unknown --benchmark_format: " << FLAGS_benchmark_format;
+    return 2;
+  }
+
   int max_name_len = 0;
   for (int i = 0; i < nbenchmarks; ++i) {
     max_name_len = max(max_name_len,
                        static_cast<int>(strlen(benchmarks[i]->name)));
   }
+  if (json) printf("{\n  \"benchmarks\": [\n");
   for (int i = 0; i < nbenchmarks; ++i) {
     Benchmark* b = benchmarks[i];
     if (match(b->name, argc, argv)) {
@@ -183,4 +672,5 @@ int main(int argc, const char** argv) {
       }
     }
   }
+  if (json) printf("\n  ]\n}\n");
 }
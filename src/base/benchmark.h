@@ -41,6 +41,8 @@ struct Benchmark {
   void Clear(const char* n) {
     name = n; fn = 0; fnr = 0; lo = 0; hi = 0; threadlo = 0; threadhi = 0;
   }
+  // Runs the benchmark with each thread count in [lo, hi]. With N threads,
+  // the function runs concurrently on N threads, each with its own timing.
   Benchmark* ThreadRange(int lo, int hi) {
     threadlo = lo; threadhi = hi; return this;
   }
@@ -53,6 +55,7 @@ void StartBenchmarkTiming();
 void SetBenchmarkBytesProcessed(int64);
 void SetBenchmarkItemsProcessed(int);
 
+// Returns the number of online CPUs.
 int NumCPUs();
 
 #define BENCHMARK(f)                                                    \
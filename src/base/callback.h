@@ -243,7 +243,7 @@ inline Closure* NewPermanentCallback(
 
 // A function which does nothing.
 // Useful for creating no-op callbacks, e.g. NewCallback(&DoNothing).
-void DoNothing() {}
+inline void DoNothing() {}
 
 
 // Executes a Closure upon deletion. Similar to scoped_ptr.
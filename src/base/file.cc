@@ -15,10 +15,13 @@
 #include "base/file.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glob.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <string>
 #include <vector>
@@ -68,6 +71,21 @@ void File::ReadFileToStringOrDie(const string& fname, string* output) {
   CHECK(ReadFileToString(fname, output)) << "Failed to read file: " << fname;
 }
 
+/* static */
+bool File::WriteStringToFile(const string& data, const string& fname) {
+  FILE* file = fopen(fname.c_str(), "wb");
+  if (file == NULL) return false;
+  const size_t n = fwrite(data.data(), 1, data.size(), file);
+  const int error = ferror(file);
+  if (fclose(file) != 0) return false;
+  return error == 0 && n == data.size();
+}
+
+/* static */
+void File::WriteStringToFileOrDie(const string& data, const string& fname) {
+  CHECK(WriteStringToFile(data, fname)) << "Failed to write file: " << fname;
+}
+
 namespace {
 
 // Used by Match(). We use this function rather than just passing GLOB_ERR and
@@ -118,4 +136,43 @@ bool File::Match(const string& pattern, vector<string>* output) {
   return result == 0 || result == GLOB_NOMATCH;
 }
 
+MappedFile::MappedFile()
+    : data_(NULL), size_(0) {}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const string& fname) {
+  Close();
+  const int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat buf;
+  if (fstat(fd, &buf) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = buf.st_size;
+  if (size_ > 0) {
+    void* addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      size_ = 0;
+      close(fd);
+      return false;
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  // The mapping remains valid after the descriptor is closed.
+  close(fd);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != NULL) {
+    CHECK_EQ(munmap(const_cast<char*>(data_), size_), 0);
+  }
+  data_ = NULL;
+  size_ = 0;
+}
+
 }  // namespace xpaf
@@ -18,6 +18,7 @@
 #include <string>
 #include <vector>
 
+#include "base/macros.h"
 #include "base/stl_decl.h"
 
 namespace xpaf {
@@ -40,6 +41,13 @@ class File {
   // Calls CHECK(ReadFileToString(fname, output)).
   static void ReadFileToStringOrDie(const string& fname, string* output);
 
+  // Writes "data" to file "fname", replacing any existing content. Returns true
+  // on success, false otherwise.
+  static bool WriteStringToFile(const string& data, const string& fname);
+
+  // Calls CHECK(WriteStringToFile(data, fname)).
+  static void WriteStringToFileOrDie(const string& data, const string& fname);
+
   // Appends the names of all files matching "pattern" to "output".
   // Returns true on success, false on failure. Finding no files is not
   // considered a failure.
@@ -47,6 +55,31 @@ class File {
   static bool Match(const string& pattern, vector<string>* output);
 };
 
+// A read-only memory mapping of an entire file. Pages are faulted in on first
+// access, so opening a large file is cheap.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Maps file "fname", unmapping any previously mapped file. Returns true on
+  // success, false otherwise.
+  bool Open(const string& fname);
+
+  // Unmaps the file, if any.
+  void Close();
+
+  // Returns the mapped contents. Valid until Close() or destruction.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
 }  // namespace xpaf
 
 #endif  // XPAF_BASE_FILE_H_
@@ -0,0 +1,73 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/hash.h"
+
+#include <string.h>  // for memcpy
+
+#include "base/integral_types.h"
+
+namespace xpaf {
+
+namespace {
+
+// Loads the 8 bytes at 'data' as a little-endian word, so that hash values
+// don't depend on the host's byte order. Uses memcpy rather than a cast,
+// since 'data' need not be aligned.
+inline uint64 LoadLittleEndian64(const char* data) {
+  uint64 k;
+  memcpy(&k, data, sizeof(k));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  k = __builtin_bswap64(k);
+#endif
+  return k;
+}
+
+}  // namespace
+
+uint64 Hash64WithSeed(const char* data, size_t len, uint64 seed) {
+  const uint64 m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+
+  uint64 h = seed ^ (len * m);
+
+  const char* end = data + (len & ~static_cast<size_t>(7));
+  for (; data != end; data += 8) {
+    uint64 k = LoadLittleEndian64(data);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+
+  const unsigned char* tail = reinterpret_cast<const unsigned char*>(data);
+  switch (len & 7) {
+    case 7: h ^= static_cast<uint64>(tail[6]) << 48;
+    case 6: h ^= static_cast<uint64>(tail[5]) << 40;
+    case 5: h ^= static_cast<uint64>(tail[4]) << 32;
+    case 4: h ^= static_cast<uint64>(tail[3]) << 24;
+    case 3: h ^= static_cast<uint64>(tail[2]) << 16;
+    case 2: h ^= static_cast<uint64>(tail[1]) << 8;
+    case 1: h ^= static_cast<uint64>(tail[0]);
+            h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+}  // namespace xpaf
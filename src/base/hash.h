@@ -0,0 +1,48 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Fast non-cryptographic hashing. Hash values are stable across processes and
+// platforms, but are not suitable for security-sensitive uses.
+
+#ifndef XPAF_BASE_HASH_H_
+#define XPAF_BASE_HASH_H_
+
+#include <stddef.h>
+
+#include "base/integral_types.h"
+#include "base/stringpiece.h"
+
+namespace xpaf {
+
+// Returns a 64-bit hash of the given bytes. Based on MurmurHash64A.
+uint64 Hash64WithSeed(const char* data, size_t len, uint64 seed);
+
+inline uint64 Hash64(const char* data, size_t len) {
+  return Hash64WithSeed(data, len, 0xc70f6907UL);
+}
+
+inline uint64 Hash64(const StringPiece& str) {
+  return Hash64(str.data(), str.size());
+}
+
+// Hash functor for StringPiece keys in unordered containers.
+struct StringPieceHash {
+  size_t operator()(const StringPiece& str) const {
+    return static_cast<size_t>(Hash64(str));
+  }
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_HASH_H_
@@ -29,6 +29,9 @@ typedef uint32_t uint32;
 typedef int64_t int64;
 typedef uint64_t uint64;
 
+const int32 kint32max = static_cast<int32>(0x7FFFFFFF);
+const int64 kint64max = static_cast<int64>(0x7FFFFFFFFFFFFFFFLL);
+
 }  // namespace xpaf
 
 #endif  // XPAF_BASE_INTEGRAL_TYPES_H_
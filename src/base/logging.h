@@ -17,6 +17,9 @@
 #ifndef XPAF_BASE_LOGGING_H_
 #define XPAF_BASE_LOGGING_H_
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "base/macros.h"
 #include "base/stl_decl.h"
 
@@ -79,15 +82,27 @@ namespace xpaf {
 
 #define LOG(severity) LOG_ ## severity.stream()
 
+// Buffers a message and writes it to stderr with a single fwrite() when
+// destroyed. stdio locks the stream for each call, so messages logged
+// concurrently by different threads don't interleave.
 class LogMessage {
  public:
   LogMessage(const char* file, int line) {
-    std::cerr << file << ":" << line << ": ";
+    stream_ << file << ":" << line << ": ";
+  }
+  ~LogMessage() { Flush(); }
+  std::ostream& stream() { return stream_; }
+
+ protected:
+  void Flush() {
+    stream_ << "\n";
+    const string message = stream_.str();
+    fwrite(message.data(), 1, message.size(), stderr);
   }
-  ~LogMessage() { std::cerr << "\n"; }
-  std::ostream& stream() { return std::cerr; }
 
  private:
+  std::ostringstream stream_;
+
   DISALLOW_COPY_AND_ASSIGN(LogMessage);
 };
 
@@ -95,7 +110,7 @@ class LogMessageFatal : public LogMessage {
  public:
   LogMessageFatal(const char* file, int line) : LogMessage(file, line) {}
   ~LogMessageFatal() {
-    std::cerr << "\n";
+    Flush();
     abort();
   }
  private:
@@ -15,6 +15,8 @@
 #ifndef XPAF_BASE_MACROS_H_
 #define XPAF_BASE_MACROS_H_
 
+#include <stddef.h>  // for size_t
+
 namespace xpaf {
 
 #define DISALLOW_COPY_AND_ASSIGN(TypeName)      \
@@ -25,6 +27,12 @@ namespace xpaf {
   TypeName();                                           \
   DISALLOW_COPY_AND_ASSIGN(TypeName)
 
+// Returns the number of elements in a statically sized array. Fails to compile
+// if given a pointer.
+template <typename T, size_t N>
+char (&ArraySizeHelper(T (&array)[N]))[N];
+#define arraysize(array) (sizeof(ArraySizeHelper(array)))
+
 }  // namespace xpaf
 
 #endif  // XPAF_BASE_MACROS_H_
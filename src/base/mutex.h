@@ -0,0 +1,75 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thin wrappers around pthread mutexes and condition variables.
+
+#ifndef XPAF_BASE_MUTEX_H_
+#define XPAF_BASE_MUTEX_H_
+
+#include <pthread.h>
+
+#include "base/logging.h"
+#include "base/macros.h"
+
+namespace xpaf {
+
+class Mutex {
+ public:
+  Mutex() { CHECK_EQ(pthread_mutex_init(&mutex_, NULL), 0); }
+  ~Mutex() { CHECK_EQ(pthread_mutex_destroy(&mutex_), 0); }
+
+  void Lock() { CHECK_EQ(pthread_mutex_lock(&mutex_), 0); }
+  void Unlock() { CHECK_EQ(pthread_mutex_unlock(&mutex_), 0); }
+
+ private:
+  friend class CondVar;
+
+  pthread_mutex_t mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(Mutex);
+};
+
+// Locks a Mutex for the lifetime of this object.
+class MutexLock {
+ public:
+  explicit MutexLock(Mutex* mu) : mu_(mu) { mu_->Lock(); }
+  ~MutexLock() { mu_->Unlock(); }
+
+ private:
+  Mutex* const mu_;
+
+  DISALLOW_COPY_AND_ASSIGN(MutexLock);
+};
+
+class CondVar {
+ public:
+  CondVar() { CHECK_EQ(pthread_cond_init(&cv_, NULL), 0); }
+  ~CondVar() { CHECK_EQ(pthread_cond_destroy(&cv_), 0); }
+
+  // Atomically unlocks 'mu' and waits to be signaled, then relocks 'mu'. May
+  // return spuriously, so callers should wait in a loop.
+  void Wait(Mutex* mu) { CHECK_EQ(pthread_cond_wait(&cv_, &mu->mutex_), 0); }
+
+  void Signal() { CHECK_EQ(pthread_cond_signal(&cv_), 0); }
+  void SignalAll() { CHECK_EQ(pthread_cond_broadcast(&cv_), 0); }
+
+ private:
+  pthread_cond_t cv_;
+
+  DISALLOW_COPY_AND_ASSIGN(CondVar);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_MUTEX_H_
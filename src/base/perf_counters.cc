@@ -0,0 +1,137 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/perf_counters.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "base/logging.h"
+
+namespace xpaf {
+
+#ifdef __linux__
+
+namespace {
+
+struct CounterConfig {
+  uint32 type;
+  uint64 config;
+};
+
+const CounterConfig kCounterConfigs[PerfCounters::kNumCounters] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+int OpenCounter(const CounterConfig& config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // pid 0 and cpu -1: the calling thread, on any CPU.
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < kNumCounters; ++i) {
+    fds_[i] = OpenCounter(kCounterConfigs[i]);
+    if (fds_[i] < 0) {
+      VLOG(1) << "perf_event_open failed for " << Name(Counter(i)) << ": "
+              << strerror(errno);
+    }
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (fds_[i] >= 0) close(fds_[i]);
+  }
+}
+
+void PerfCounters::Start() {
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (fds_[i] >= 0) ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void PerfCounters::Stop() {
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (fds_[i] >= 0) ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+}
+
+int64 PerfCounters::Value(Counter counter) const {
+  if (fds_[counter] < 0) return -1;
+  // Layout given by read_format: value, time enabled, time running.
+  uint64 values[3];
+  if (read(fds_[counter], values, sizeof(values)) != sizeof(values)) {
+    return -1;
+  }
+  if (values[2] == 0) return 0;
+  if (values[2] == values[1]) return values[0];
+  return static_cast<int64>(
+      static_cast<double>(values[0]) * values[1] / values[2]);
+}
+
+#else  // !__linux__
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < kNumCounters; ++i) fds_[i] = -1;
+}
+
+PerfCounters::~PerfCounters() {}
+
+void PerfCounters::Start() {}
+
+void PerfCounters::Stop() {}
+
+int64 PerfCounters::Value(Counter counter) const { return -1; }
+
+#endif  // __linux__
+
+const char* PerfCounters::Name(Counter counter) {
+  switch (counter) {
+    case CYCLES: return "cycles";
+    case INSTRUCTIONS: return "instructions";
+    case LLC_MISSES: return "llc_misses";
+    case BRANCH_MISSES: return "branch_misses";
+    default: return "unknown";
+  }
+}
+
+bool PerfCounters::any_available() const {
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (available(Counter(i))) return true;
+  }
+  return false;
+}
+
+}  // namespace xpaf
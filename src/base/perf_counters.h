@@ -0,0 +1,68 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hardware performance counters for the calling thread, read via Linux's
+// perf_event_open(2). Counters that can't be opened (e.g. on other
+// platforms, in VMs without a PMU, or with a restrictive
+// kernel.perf_event_paranoid) are simply reported as unavailable.
+
+#ifndef XPAF_BASE_PERF_COUNTERS_H_
+#define XPAF_BASE_PERF_COUNTERS_H_
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+
+namespace xpaf {
+
+class PerfCounters {
+ public:
+  enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    kNumCounters
+  };
+
+  // Opens all counters for the calling thread. Counters start out stopped,
+  // at zero.
+  PerfCounters();
+  ~PerfCounters();
+
+  // Returns a short name for 'counter', e.g. "cycles".
+  static const char* Name(Counter counter);
+
+  // Returns true if 'counter', or any counter, could be opened.
+  bool available(Counter counter) const { return fds_[counter] >= 0; }
+  bool any_available() const;
+
+  // Starts or stops counting on all available counters. Only the calling
+  // thread's events are counted, so these must be called on the thread
+  // that created this object.
+  void Start();
+  void Stop();
+
+  // Returns the count accumulated while started, scaled up if the kernel
+  // multiplexed the counter. Returns -1 if 'counter' is unavailable.
+  int64 Value(Counter counter) const;
+
+ private:
+  int fds_[kNumCounters];
+
+  DISALLOW_COPY_AND_ASSIGN(PerfCounters);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_PERF_COUNTERS_H_
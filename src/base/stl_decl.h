@@ -16,6 +16,7 @@
 #define XPAF_BASE_STL_DECL_H_
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <set>
@@ -25,17 +26,21 @@
 #include <vector>
 
 #ifdef __clang__
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #else
+#include <tr1/memory>
 #include <tr1/unordered_map>
 #include <tr1/unordered_set>
 #endif  // __clang__
 
+using std::deque;
 using std::make_pair;
 using std::map;
 using std::max;
 using std::min;
+using std::multiset;
 using std::ostream;
 using std::pair;
 using std::set;
@@ -46,9 +51,11 @@ using std::swap;
 using std::vector;
 
 #ifdef __clang__
+using std::shared_ptr;
 using std::unordered_map;
 using std::unordered_set;
 #else
+using std::tr1::shared_ptr;
 using std::tr1::unordered_map;
 using std::tr1::unordered_set;
 #endif  // __clang__
@@ -58,7 +58,7 @@ const int kFastToBufferSize = 32;
 // Not actually fast, but maybe someday!
 inline char* FastInt32ToBuffer(int32 i, char* buffer) {
   const string s = SimpleItoa(i);
-  safestrncpy(buffer, s.c_str(), s.size());
+  safestrncpy(buffer, s.c_str(), s.size() + 1);
   return buffer + s.size();
 }
 
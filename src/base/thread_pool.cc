@@ -0,0 +1,93 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/thread_pool.h"
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "base/callback.h"
+#include "base/logging.h"
+#include "base/mutex.h"
+
+namespace xpaf {
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_pending_(0), stopping_(false) {
+  CHECK_GT(num_threads, 0);
+  threads_.resize(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    CHECK_EQ(pthread_create(&threads_[i], NULL, &ThreadPool::WorkerMain, this),
+             0);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    MutexLock l(&mu_);
+    stopping_ = true;
+    work_available_.SignalAll();
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    CHECK_EQ(pthread_join(threads_[i], NULL), 0);
+  }
+}
+
+void ThreadPool::Schedule(Closure* closure) {
+  MutexLock l(&mu_);
+  CHECK(!stopping_);
+  queue_.push_back(closure);
+  ++num_pending_;
+  work_available_.Signal();
+}
+
+void ThreadPool::Wait() {
+  MutexLock l(&mu_);
+  while (num_pending_ > 0) {
+    work_done_.Wait(&mu_);
+  }
+}
+
+/* static */
+void* ThreadPool::WorkerMain(void* pool) {
+  static_cast<ThreadPool*>(pool)->WorkerLoop();
+  return NULL;
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    Closure* closure;
+    {
+      MutexLock l(&mu_);
+      while (queue_.empty() && !stopping_) {
+        work_available_.Wait(&mu_);
+      }
+      if (queue_.empty()) return;  // stopping_
+      closure = queue_.front();
+      queue_.pop_front();
+    }
+    closure->Run();
+    {
+      MutexLock l(&mu_);
+      if (--num_pending_ == 0) {
+        work_done_.SignalAll();
+      }
+    }
+  }
+}
+
+}  // namespace xpaf
@@ -0,0 +1,75 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A fixed-size pool of worker threads that run Closures in FIFO order.
+//
+// Example:
+//   ThreadPool pool(4);
+//   for (int i = 0; i < n; ++i) {
+//     pool.Schedule(NewCallback(&DoWork, i));
+//   }
+//   pool.Wait();  // or just let 'pool' go out of scope
+
+#ifndef XPAF_BASE_THREAD_POOL_H_
+#define XPAF_BASE_THREAD_POOL_H_
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class Closure;
+
+class ThreadPool {
+ public:
+  // Starts 'num_threads' worker threads. Requires num_threads > 0.
+  explicit ThreadPool(int num_threads);
+
+  // Waits for all scheduled closures to finish, then stops the workers.
+  ~ThreadPool();
+
+  // Schedules 'closure' to run on some worker thread. Closures created with
+  // NewCallback() delete themselves after running.
+  void Schedule(Closure* closure);
+
+  // Blocks until all closures scheduled so far have finished running.
+  void Wait();
+
+  int num_threads() const { return threads_.size(); }
+
+ private:
+  static void* WorkerMain(void* pool);
+  void WorkerLoop();
+
+  vector<pthread_t> threads_;
+
+  Mutex mu_;
+  CondVar work_available_;  // signaled when queue_ is nonempty or stopping_
+  CondVar work_done_;       // signaled when num_pending_ reaches zero
+  deque<Closure*> queue_;
+  int num_pending_;         // queued plus running closures
+  bool stopping_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_THREAD_POOL_H_
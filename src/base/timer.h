@@ -0,0 +1,43 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Monotonic and CPU-time clocks for lightweight instrumentation.
+
+#ifndef XPAF_BASE_TIMER_H_
+#define XPAF_BASE_TIMER_H_
+
+#include <time.h>
+
+#include "base/integral_types.h"
+
+namespace xpaf {
+
+// Returns nanoseconds since some unspecified starting point. Not affected by
+// changes to the system time.
+inline int64 MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns nanoseconds of CPU time consumed by the calling thread.
+inline int64 ThreadCpuNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace xpaf
+
+#endif  // XPAF_BASE_TIMER_H_
@@ -17,6 +17,7 @@
 #include <string.h>  // for memchr
 
 #include "base/integral_types.h"
+#include "base/stringpiece.h"
 
 namespace xpaf {
 namespace {
@@ -79,4 +80,11 @@ const char* HTTPUtils::SkipHttpHeaders(const char* content,
   return found + 4;
 }
 
+/* static */
+StringPiece HTTPUtils::HttpBody(const StringPiece& content) {
+  const char* body = SkipHttpHeaders(content.data(), content.size());
+  if (body == NULL) return content;
+  return StringPiece(body, content.size() - (body - content.data()));
+}
+
 }  // namespace xpaf
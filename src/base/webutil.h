@@ -16,6 +16,7 @@
 #define XPAF_BASE_WEBUTIL_H_
 
 #include "base/integral_types.h"
+#include "base/stringpiece.h"
 
 namespace xpaf {
 
@@ -32,6 +33,10 @@ class HTTPUtils {
   // makes no attempt to parse the headers or detect a malformed HTTP response.
   //
   static const char* SkipHttpHeaders(const char* content, uint32 content_len);
+
+  // Returns the body of 'content' as found by SkipHttpHeaders(), or all of
+  // 'content' if the end of headers was not found.
+  static StringPiece HttpBody(const StringPiece& content);
 };
 
 }  // namespace xpaf
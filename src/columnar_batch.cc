@@ -0,0 +1,483 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Block layout: a BlockHeader, followed by one section per Section enum value,
+// in enum order. Each section starts at an 8-byte aligned offset from the
+// start of the block, and the header records every section's offset and size.
+
+#include "columnar_batch.h"
+
+#include <string.h>  // for memcpy
+
+#include <string>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+#include "relation_sink.h"
+
+namespace xpaf {
+
+namespace {
+
+const uint32 kMagic = 0x42435058;  // "XPCB" in little-endian byte order
+const uint32 kVersion = 2;
+const int kAlignment = 8;
+
+enum Section {
+  SECTION_DOC_FIRST_RELATION = 0,
+  SECTION_DOC_URL_OFFSETS,
+  SECTION_DOC_URL_DATA,
+  SECTION_DOC_TRUNCATED,
+  SECTION_REL_PARSER_IDS,
+  SECTION_REL_PREDICATE_IDS,
+  SECTION_REL_USERDATA_IDS,
+  SECTION_REL_FIRST_ANNOTATION,
+  SECTION_REL_SUBJECT_OFFSETS,
+  SECTION_REL_SUBJECT_DATA,
+  SECTION_REL_OBJECT_OFFSETS,
+  SECTION_REL_OBJECT_DATA,
+  SECTION_ANNOTATION_NAME_IDS,
+  SECTION_ANNOTATION_VALUE_OFFSETS,
+  SECTION_ANNOTATION_VALUE_DATA,
+  SECTION_DICTIONARY_OFFSETS,
+  SECTION_DICTIONARY_DATA,
+  NUM_SECTIONS,
+};
+
+struct BlockHeader {
+  uint32 magic;
+  uint32 version;
+  uint32 num_documents;
+  uint32 num_relations;
+  uint32 num_annotations;
+  uint32 num_dictionary_entries;
+  uint64 block_size;
+  uint64 section_offsets[NUM_SECTIONS];
+  uint64 section_sizes[NUM_SECTIONS];
+};
+
+inline size_t Align(size_t offset) {
+  return (offset + kAlignment - 1) & ~static_cast<size_t>(kAlignment - 1);
+}
+
+// Appends 'size' bytes at 'data' to 'block' as section 'section', padding
+// 'block' first as needed.
+void AppendSection(Section section, const void* data, size_t size,
+                   BlockHeader* header, string* block) {
+  block->resize(Align(block->size()), '\0');
+  header->section_offsets[section] = block->size();
+  header->section_sizes[section] = size;
+  block->append(static_cast<const char*>(data), size);
+}
+
+void AppendUint32Section(Section section, const vector<uint32>& values,
+                         BlockHeader* header, string* block) {
+  AppendSection(section, values.empty() ? NULL : &values[0],
+                values.size() * sizeof(uint32), header, block);
+}
+
+// Returns true if 'values' (of length 'n') is nondecreasing, starts at zero,
+// and ends at 'last'.
+bool IsValidOffsetArray(const uint32* values, int n, uint32 last) {
+  if (n < 1 || values[0] != 0 || values[n - 1] != last) return false;
+  for (int i = 1; i < n; ++i) {
+    if (values[i] < values[i - 1]) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ColumnarBatchBuilder
+
+void ColumnarBatchBuilder::StringColumn::Add(const StringPiece& str) {
+  data.append(str.data(), str.size());
+  CHECK_LE(data.size(), 0xffffffffUL) << "Columnar batch too large";
+  offsets.push_back(data.size());
+}
+
+void ColumnarBatchBuilder::StringColumn::Clear() {
+  offsets.assign(1, 0);
+  data.clear();
+}
+
+ColumnarBatchBuilder::ColumnarBatchBuilder() : parser_id_(0) {
+  Clear();
+}
+
+ColumnarBatchBuilder::~ColumnarBatchBuilder() {
+}
+
+void ColumnarBatchBuilder::Clear() {
+  dictionary_.Clear();
+  parser_id_ = 0;
+  doc_first_relation_.clear();
+  doc_urls_.Clear();
+  doc_truncated_.clear();
+  rel_parser_ids_.clear();
+  rel_predicate_ids_.clear();
+  rel_userdata_ids_.clear();
+  rel_first_annotation_.clear();
+  rel_subjects_.Clear();
+  rel_objects_.Clear();
+  annotation_name_ids_.clear();
+  annotation_values_.Clear();
+}
+
+void ColumnarBatchBuilder::BeginDocument(const StringPiece& url) {
+  doc_first_relation_.push_back(rel_parser_ids_.size());
+  doc_urls_.Add(url);
+  doc_truncated_.push_back(0);
+}
+
+void ColumnarBatchBuilder::BeginParser(const StringPiece& parser_name) {
+  parser_id_ = dictionary_.Intern(parser_name);
+}
+
+void ColumnarBatchBuilder::AddRelation(const RelationView& relation) {
+  rel_parser_ids_.push_back(parser_id_);
+  rel_predicate_ids_.push_back(dictionary_.Intern(relation.predicate));
+  rel_userdata_ids_.push_back(relation.has_userdata ?
+                              dictionary_.Intern(relation.userdata) :
+                              ColumnarBatchReader::kNoUserdata);
+  rel_first_annotation_.push_back(annotation_name_ids_.size());
+  rel_subjects_.Add(relation.subject);
+  rel_objects_.Add(relation.object);
+
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+  for (int i = 0; i < annotations.size(); ++i) {
+    annotation_name_ids_.push_back(dictionary_.Intern(annotations[i].name));
+    annotation_values_.Add(annotations[i].value);
+  }
+}
+
+void ColumnarBatchBuilder::EndParser() {
+}
+
+void ColumnarBatchBuilder::SetTruncated() {
+  DCHECK(!doc_truncated_.empty());
+  doc_truncated_[doc_truncated_.size() - 1] = 1;
+}
+
+void ColumnarBatchBuilder::EndDocument() {
+}
+
+void ColumnarBatchBuilder::AddParsedDocument(
+    const ParsedDocument& parsed_document) {
+  CHECK_EQ(parsed_document.interned_strings_size(), 0)
+      << "Call ExpandInternedStrings() first";
+  BeginDocument(parsed_document.url());
+  vector<RelationView::Annotation> annotations;
+  RelationView relation;
+  relation.annotations = &annotations;
+  for (int i = 0; i < parsed_document.parser_outputs_size(); ++i) {
+    const ParserOutput& output = parsed_document.parser_outputs(i);
+    BeginParser(output.parser_name());
+    for (int j = 0; j < output.relations_size(); ++j) {
+      const Relation& rel = output.relations(j);
+      relation.subject = rel.subject();
+      relation.predicate = rel.predicate();
+      relation.object = rel.object();
+      relation.has_userdata = rel.has_userdata();
+      relation.userdata = rel.userdata();
+      annotations.resize(rel.annotations_size());
+      for (int k = 0; k < rel.annotations_size(); ++k) {
+        annotations[k].name = rel.annotations(k).name();
+        annotations[k].value = rel.annotations(k).value();
+      }
+      AddRelation(relation);
+    }
+    EndParser();
+  }
+  if (parsed_document.truncated()) SetTruncated();
+  EndDocument();
+}
+
+void ColumnarBatchBuilder::Finish(string* block) {
+  // Terminate the per-document and per-relation start arrays.
+  doc_first_relation_.push_back(rel_parser_ids_.size());
+  rel_first_annotation_.push_back(annotation_name_ids_.size());
+
+  StringColumn dictionary;
+  for (int i = 0; i < dictionary_.size(); ++i) {
+    dictionary.Add(dictionary_.Lookup(i));
+  }
+
+  BlockHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.num_documents = doc_urls_.offsets.size() - 1;
+  header.num_relations = rel_parser_ids_.size();
+  header.num_annotations = annotation_name_ids_.size();
+  header.num_dictionary_entries = dictionary_.size();
+
+  block->clear();
+  block->append(sizeof(header), '\0');  // filled in below
+  AppendUint32Section(SECTION_DOC_FIRST_RELATION, doc_first_relation_,
+                      &header, block);
+  AppendUint32Section(SECTION_DOC_URL_OFFSETS, doc_urls_.offsets,
+                      &header, block);
+  AppendSection(SECTION_DOC_URL_DATA, doc_urls_.data.data(),
+                doc_urls_.data.size(), &header, block);
+  AppendSection(SECTION_DOC_TRUNCATED, doc_truncated_.data(),
+                doc_truncated_.size(), &header, block);
+  AppendUint32Section(SECTION_REL_PARSER_IDS, rel_parser_ids_,
+                      &header, block);
+  AppendUint32Section(SECTION_REL_PREDICATE_IDS, rel_predicate_ids_,
+                      &header, block);
+  AppendUint32Section(SECTION_REL_USERDATA_IDS, rel_userdata_ids_,
+                      &header, block);
+  AppendUint32Section(SECTION_REL_FIRST_ANNOTATION, rel_first_annotation_,
+                      &header, block);
+  AppendUint32Section(SECTION_REL_SUBJECT_OFFSETS, rel_subjects_.offsets,
+                      &header, block);
+  AppendSection(SECTION_REL_SUBJECT_DATA, rel_subjects_.data.data(),
+                rel_subjects_.data.size(), &header, block);
+  AppendUint32Section(SECTION_REL_OBJECT_OFFSETS, rel_objects_.offsets,
+                      &header, block);
+  AppendSection(SECTION_REL_OBJECT_DATA, rel_objects_.data.data(),
+                rel_objects_.data.size(), &header, block);
+  AppendUint32Section(SECTION_ANNOTATION_NAME_IDS, annotation_name_ids_,
+                      &header, block);
+  AppendUint32Section(SECTION_ANNOTATION_VALUE_OFFSETS,
+                      annotation_values_.offsets, &header, block);
+  AppendSection(SECTION_ANNOTATION_VALUE_DATA, annotation_values_.data.data(),
+                annotation_values_.data.size(), &header, block);
+  AppendUint32Section(SECTION_DICTIONARY_OFFSETS, dictionary.offsets,
+                      &header, block);
+  AppendSection(SECTION_DICTIONARY_DATA, dictionary.data.data(),
+                dictionary.data.size(), &header, block);
+  block->resize(Align(block->size()), '\0');
+  header.block_size = block->size();
+  memcpy(&(*block)[0], &header, sizeof(header));
+
+  Clear();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ColumnarBatchReader
+
+const uint32 ColumnarBatchReader::kNoUserdata;
+
+ColumnarBatchReader::ColumnarBatchReader()
+    : num_documents_(0),
+      num_relations_(0),
+      num_annotations_(0),
+      num_dictionary_entries_(0) {
+}
+
+ColumnarBatchReader::~ColumnarBatchReader() {
+}
+
+bool ColumnarBatchReader::Init(const StringPiece& block) {
+  if (reinterpret_cast<uintptr_t>(block.data()) % kAlignment != 0) {
+    LOG(ERROR) << "Columnar batch is not " << kAlignment << "-byte aligned";
+    return false;
+  }
+  if (block.size() < sizeof(BlockHeader)) return false;
+  const BlockHeader& header =
+      *reinterpret_cast<const BlockHeader*>(block.data());
+  if (header.magic != kMagic || header.version != kVersion ||
+      header.block_size != block.size()) {
+    return false;
+  }
+
+  // Check that each section lies within the block and has the expected size.
+  const uint64 nd = header.num_documents;
+  const uint64 nr = header.num_relations;
+  const uint64 na = header.num_annotations;
+  const uint64 ndict = header.num_dictionary_entries;
+  const uint64 expected_uint32s[NUM_SECTIONS] = {
+    nd + 1, nd + 1, 0, 0, nr, nr, nr, nr + 1, nr + 1, 0, nr + 1, 0, na,
+    na + 1, 0, ndict + 1, 0,
+  };
+  const char* sections[NUM_SECTIONS];
+  for (int i = 0; i < NUM_SECTIONS; ++i) {
+    const uint64 offset = header.section_offsets[i];
+    const uint64 size = header.section_sizes[i];
+    if (offset % kAlignment != 0 || offset < sizeof(BlockHeader) ||
+        offset > block.size() || size > block.size() - offset) {
+      return false;
+    }
+    if (expected_uint32s[i] != 0 &&
+        size != expected_uint32s[i] * sizeof(uint32)) {
+      return false;
+    }
+    sections[i] = block.data() + offset;
+  }
+
+  num_documents_ = nd;
+  num_relations_ = nr;
+  num_annotations_ = na;
+  num_dictionary_entries_ = ndict;
+
+  doc_first_relation_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_DOC_FIRST_RELATION]);
+  doc_truncated_ = sections[SECTION_DOC_TRUNCATED];
+  rel_parser_ids_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_REL_PARSER_IDS]);
+  rel_predicate_ids_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_REL_PREDICATE_IDS]);
+  rel_userdata_ids_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_REL_USERDATA_IDS]);
+  rel_first_annotation_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_REL_FIRST_ANNOTATION]);
+  annotation_name_ids_ =
+      reinterpret_cast<const uint32*>(sections[SECTION_ANNOTATION_NAME_IDS]);
+
+  StringColumn* string_columns[] = {
+    &doc_urls_, &rel_subjects_, &rel_objects_, &annotation_values_,
+    &dictionary_,
+  };
+  const Section offset_sections[] = {
+    SECTION_DOC_URL_OFFSETS, SECTION_REL_SUBJECT_OFFSETS,
+    SECTION_REL_OBJECT_OFFSETS, SECTION_ANNOTATION_VALUE_OFFSETS,
+    SECTION_DICTIONARY_OFFSETS,
+  };
+  for (int i = 0; i < arraysize(string_columns); ++i) {
+    const Section offsets = offset_sections[i];
+    const Section data = static_cast<Section>(offsets + 1);
+    string_columns[i]->offsets =
+        reinterpret_cast<const uint32*>(sections[offsets]);
+    string_columns[i]->data = sections[data];
+    if (!IsValidOffsetArray(string_columns[i]->offsets,
+                            expected_uint32s[offsets],
+                            header.section_sizes[data])) {
+      return false;
+    }
+  }
+
+  // Check index and id columns, so that accessors needn't.
+  if (!IsValidOffsetArray(doc_first_relation_, nd + 1, nr) ||
+      !IsValidOffsetArray(rel_first_annotation_, nr + 1, na) ||
+      header.section_sizes[SECTION_DOC_TRUNCATED] != nd) {
+    return false;
+  }
+  for (int i = 0; i < nd; ++i) {
+    if (doc_truncated_[i] != 0 && doc_truncated_[i] != 1) return false;
+  }
+  for (int i = 0; i < nr; ++i) {
+    if (rel_parser_ids_[i] >= ndict || rel_predicate_ids_[i] >= ndict ||
+        (rel_userdata_ids_[i] >= ndict &&
+         rel_userdata_ids_[i] != kNoUserdata)) {
+      return false;
+    }
+  }
+  for (int i = 0; i < na; ++i) {
+    if (annotation_name_ids_[i] >= ndict) return false;
+  }
+  return true;
+}
+
+StringPiece ColumnarBatchReader::url(int doc) const {
+  DCHECK_LT(doc, num_documents_);
+  return doc_urls_.Get(doc);
+}
+
+int ColumnarBatchReader::first_relation(int doc) const {
+  DCHECK_LE(doc, num_documents_);
+  return doc_first_relation_[doc];
+}
+
+bool ColumnarBatchReader::truncated(int doc) const {
+  DCHECK_LT(doc, num_documents_);
+  return doc_truncated_[doc] != 0;
+}
+
+StringPiece ColumnarBatchReader::subject(int rel) const {
+  DCHECK_LT(rel, num_relations_);
+  return rel_subjects_.Get(rel);
+}
+
+StringPiece ColumnarBatchReader::object(int rel) const {
+  DCHECK_LT(rel, num_relations_);
+  return rel_objects_.Get(rel);
+}
+
+StringPiece ColumnarBatchReader::parser_name(int rel) const {
+  return dictionary_entry(parser_name_id(rel));
+}
+
+StringPiece ColumnarBatchReader::predicate(int rel) const {
+  return dictionary_entry(predicate_id(rel));
+}
+
+bool ColumnarBatchReader::has_userdata(int rel) const {
+  return userdata_id(rel) != kNoUserdata;
+}
+
+StringPiece ColumnarBatchReader::userdata(int rel) const {
+  return has_userdata(rel) ? dictionary_entry(userdata_id(rel)) :
+      StringPiece();
+}
+
+int ColumnarBatchReader::first_annotation(int rel) const {
+  DCHECK_LE(rel, num_relations_);
+  return rel_first_annotation_[rel];
+}
+
+uint32 ColumnarBatchReader::annotation_name_id(int annotation) const {
+  DCHECK_LT(annotation, num_annotations_);
+  return annotation_name_ids_[annotation];
+}
+
+StringPiece ColumnarBatchReader::annotation_name(int annotation) const {
+  return dictionary_entry(annotation_name_id(annotation));
+}
+
+StringPiece ColumnarBatchReader::annotation_value(int annotation) const {
+  DCHECK_LT(annotation, num_annotations_);
+  return annotation_values_.Get(annotation);
+}
+
+StringPiece ColumnarBatchReader::dictionary_entry(uint32 id) const {
+  DCHECK_LT(id, num_dictionary_entries_);
+  return dictionary_.Get(id);
+}
+
+void ColumnarBatchReader::ToParsedDocument(
+    int doc, ParsedDocument* parsed_document) const {
+  parsed_document->set_url(url(doc).as_string());
+  if (truncated(doc)) parsed_document->set_truncated(true);
+  ParserOutput* output = NULL;
+  for (int i = first_relation(doc); i < first_relation(doc + 1); ++i) {
+    // Relations from the same parser are contiguous.
+    if (output == NULL || parser_name_id(i) != parser_name_id(i - 1)) {
+      output = parsed_document->add_parser_outputs();
+      output->set_parser_name(parser_name(i).as_string());
+    }
+    Relation* rel = output->add_relations();
+    rel->set_subject(subject(i).as_string());
+    rel->set_predicate(predicate(i).as_string());
+    rel->set_object(object(i).as_string());
+    for (int j = first_annotation(i); j < first_annotation(i + 1); ++j) {
+      Relation::Annotation* annotation = rel->add_annotations();
+      annotation->set_name(annotation_name(j).as_string());
+      annotation->set_value(annotation_value(j).as_string());
+    }
+    if (has_userdata(i)) {
+      rel->set_userdata(userdata(i).as_string());
+    }
+  }
+}
+
+}  // namespace xpaf
@@ -0,0 +1,196 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Columnar output format for bulk loading. A batch holds the relations from
+// any number of documents, laid out column by column in a single contiguous
+// block that can be written to disk and later memory-mapped and read in place
+// with ColumnarBatchReader.
+//
+// The columns mirror the ParsedDocument schema (see parsed_document.proto):
+//  * per document: url, the index of its first relation, and whether its
+//    output is truncated (see ParsedDocument.truncated);
+//  * per relation: subject, object, and dictionary ids for parser name,
+//    predicate, and userdata, plus the index of its first annotation;
+//  * per annotation: dictionary id for name, and value;
+//  * a dictionary of distinct parser names, predicates, userdata strings, and
+//    annotation names.
+// String columns are stored as an offsets array followed by the concatenated
+// bytes. Integers are stored in host byte order; readers reject blocks written
+// with a different byte order.
+//
+// Interned strings (ParseOptions.intern_strings) are not used here; the
+// dictionary serves the same purpose for the columns that benefit from it.
+
+#ifndef XPAF_COLUMNAR_BATCH_H_
+#define XPAF_COLUMNAR_BATCH_H_
+
+#include <string>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "relation_sink.h"
+#include "string_interner.h"
+
+namespace xpaf {
+
+class ParsedDocument;
+
+// Accumulates relations from one or more documents and writes them as a
+// columnar block. Pass this to XpafParserMaster::ParseDocument() once per
+// document, then call Finish(). Not thread-safe.
+class ColumnarBatchBuilder : public RelationSink {
+ public:
+  ColumnarBatchBuilder();
+  virtual ~ColumnarBatchBuilder();
+
+  virtual void BeginDocument(const StringPiece& url);
+  virtual void BeginParser(const StringPiece& parser_name);
+  virtual void AddRelation(const RelationView& relation);
+  virtual void EndParser();
+  virtual void SetTruncated();
+  virtual void EndDocument();
+
+  // Adds the contents of an existing, non-interned ParsedDocument.
+  void AddParsedDocument(const ParsedDocument& parsed_document);
+
+  int num_documents() const { return doc_first_relation_.size(); }
+  int num_relations() const { return rel_parser_ids_.size(); }
+
+  // Replaces the contents of 'block' with the columnar block for everything
+  // added so far, and resets this builder for the next batch.
+  void Finish(string* block);
+
+ private:
+  // A string column: element i is [offsets[i], offsets[i+1]) in 'data'.
+  struct StringColumn {
+    vector<uint32> offsets;
+    string data;
+
+    StringColumn() : offsets(1, 0) {}
+    void Add(const StringPiece& str);
+    void Clear();
+  };
+
+  void Clear();
+
+  // Dictionary for parser names, predicates, userdata, and annotation names.
+  StringInterner dictionary_;
+
+  // Dictionary id of the current parser.
+  uint32 parser_id_;
+
+  vector<uint32> doc_first_relation_;
+  StringColumn doc_urls_;
+  // One byte per document, 1 if truncated and 0 otherwise.
+  string doc_truncated_;
+
+  vector<uint32> rel_parser_ids_;
+  vector<uint32> rel_predicate_ids_;
+  vector<uint32> rel_userdata_ids_;
+  vector<uint32> rel_first_annotation_;
+  StringColumn rel_subjects_;
+  StringColumn rel_objects_;
+
+  vector<uint32> annotation_name_ids_;
+  StringColumn annotation_values_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnarBatchBuilder);
+};
+
+// Reads a block written by ColumnarBatchBuilder::Finish() in place. All
+// returned StringPieces point into the block. Thread-safe after Init().
+class ColumnarBatchReader {
+ public:
+  // Value of userdata_id() for relations without userdata.
+  static const uint32 kNoUserdata = 0xffffffff;
+
+  ColumnarBatchReader();
+  ~ColumnarBatchReader();
+
+  // Does not copy 'block', which must persist for the lifetime of this reader
+  // and must be 8-byte aligned (as is the case for mmap()ed files and for
+  // heap-allocated strings). Returns false if 'block' is not a valid block.
+  bool Init(const StringPiece& block);
+
+  int num_documents() const { return num_documents_; }
+  int num_relations() const { return num_relations_; }
+  int num_annotations() const { return num_annotations_; }
+  int num_dictionary_entries() const { return num_dictionary_entries_; }
+
+  StringPiece url(int doc) const;
+  // Relations for document 'doc' are [first_relation(doc),
+  // first_relation(doc + 1)). Valid for doc in [0, num_documents()].
+  int first_relation(int doc) const;
+  bool truncated(int doc) const;
+
+  StringPiece subject(int rel) const;
+  StringPiece object(int rel) const;
+  uint32 parser_name_id(int rel) const { return rel_parser_ids_[rel]; }
+  uint32 predicate_id(int rel) const { return rel_predicate_ids_[rel]; }
+  uint32 userdata_id(int rel) const { return rel_userdata_ids_[rel]; }
+  StringPiece parser_name(int rel) const;
+  StringPiece predicate(int rel) const;
+  bool has_userdata(int rel) const;
+  StringPiece userdata(int rel) const;
+  // Annotations for relation 'rel' are [first_annotation(rel),
+  // first_annotation(rel + 1)). Valid for rel in [0, num_relations()].
+  int first_annotation(int rel) const;
+
+  uint32 annotation_name_id(int annotation) const;
+  StringPiece annotation_name(int annotation) const;
+  StringPiece annotation_value(int annotation) const;
+
+  StringPiece dictionary_entry(uint32 id) const;
+
+  // Appends the relations for document 'doc' to 'parsed_document' in
+  // ParsedDocument form. Mostly useful for testing and debugging.
+  void ToParsedDocument(int doc, ParsedDocument* parsed_document) const;
+
+ private:
+  struct StringColumn {
+    const uint32* offsets;
+    const char* data;
+
+    StringPiece Get(int i) const {
+      return StringPiece(data + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+  };
+
+  int num_documents_;
+  int num_relations_;
+  int num_annotations_;
+  int num_dictionary_entries_;
+
+  const uint32* doc_first_relation_;
+  StringColumn doc_urls_;
+  const char* doc_truncated_;
+  const uint32* rel_parser_ids_;
+  const uint32* rel_predicate_ids_;
+  const uint32* rel_userdata_ids_;
+  const uint32* rel_first_annotation_;
+  StringColumn rel_subjects_;
+  StringColumn rel_objects_;
+  const uint32* annotation_name_ids_;
+  StringColumn annotation_values_;
+  StringColumn dictionary_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnarBatchReader);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_COLUMNAR_BATCH_H_
@@ -0,0 +1,72 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compiles parser defs into a binary snapshot that XpafParserMaster can load
+// much faster than text parser defs. See parser_snapshot.h.
+//
+// Example:
+// ./compile_xpd
+//      --parser_defs_glob=./testing/parser_defs/*.xpd
+//      --output_file_path=/tmp/parsers.xps
+
+#include <stdio.h>
+
+#include <string>
+
+#include "base/commandlineflags.h"
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "parser_snapshot.h"
+#include "util.h"
+#include "xpaf_parser.h"
+#include "xpaf_parser_def.pb.h"
+#include "xpaf_parser_master.h"
+
+DEFINE_string(parser_defs_glob, "",
+              "File pattern for parser def files. E.g., '/path/to/*.xpd'.");
+DEFINE_string(output_file_path, "",
+              "Path of snapshot file to write.");
+
+namespace xpaf {
+
+void Run() {
+  File::Init();
+
+  CHECK(!FLAGS_parser_defs_glob.empty());
+  CHECK(!FLAGS_output_file_path.empty());
+
+  XpafParserDefs parser_defs;
+  ReadXpafParserDefs(FLAGS_parser_defs_glob, &parser_defs);
+
+  // Constructing the master runs all the usual validation.
+  XpafParserMaster master(parser_defs, ParseOptions());
+  CompiledXpafParserDefs compiled_defs;
+  master.Compile(&compiled_defs);
+
+  string snapshot;
+  SerializeParserSnapshot(compiled_defs, &snapshot);
+  File::WriteStringToFileOrDie(snapshot, FLAGS_output_file_path);
+  printf("Wrote %d parsers (%d bytes) to %s\n",
+         compiled_defs.parser_defs_size(), static_cast<int>(snapshot.size()),
+         FLAGS_output_file_path.c_str());
+}
+
+}  // namespace xpaf
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  xpaf::Run();
+  return 0;
+}
@@ -0,0 +1,180 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "delta_sink.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+
+namespace xpaf {
+
+namespace {
+
+// Chains Hash64WithSeed() over successive strings. Each string's length is
+// mixed into the hash, so ("ab", "c") and ("a", "bc") differ.
+inline uint64 HashNext(const StringPiece& str, uint64 hash) {
+  return Hash64WithSeed(str.data(), str.size(), hash);
+}
+
+// Collects the fingerprints of a ParsedDocument's relations.
+class FingerprintingSink : public RelationSink {
+ public:
+  explicit FingerprintingSink(RelationFingerprints* fingerprints)
+      : fingerprints_(fingerprints), parser_(NULL) {}
+
+  virtual void BeginParser(const StringPiece& parser_name) {
+    parser_ = fingerprints_->add_parsers();
+    parser_->set_parser_name(parser_name.data(), parser_name.size());
+  }
+
+  virtual void AddRelation(const RelationView& relation) {
+    parser_->add_fingerprints(RelationFingerprint(relation));
+  }
+
+  virtual void EndParser() {
+    if (parser_->fingerprints_size() == 0) {
+      fingerprints_->mutable_parsers()->RemoveLast();
+    }
+    parser_ = NULL;
+  }
+
+ private:
+  RelationFingerprints* const fingerprints_;
+  RelationFingerprints::Parser* parser_;
+
+  DISALLOW_COPY_AND_ASSIGN(FingerprintingSink);
+};
+
+}  // namespace
+
+uint64 RelationFingerprint(const RelationView& relation) {
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+  uint64 hash = 0x51ed27b4a3c1e8f9ULL + annotations.size() * 2 +
+                (relation.has_userdata ? 1 : 0);
+  hash = HashNext(relation.subject, hash);
+  hash = HashNext(relation.predicate, hash);
+  hash = HashNext(relation.object, hash);
+  if (relation.has_userdata) {
+    hash = HashNext(relation.userdata, hash);
+  }
+  for (int i = 0; i < annotations.size(); ++i) {
+    hash = HashNext(annotations[i].name, hash);
+    hash = HashNext(annotations[i].value, hash);
+  }
+  return hash;
+}
+
+void ComputeRelationFingerprints(const ParsedDocument& parsed_document,
+                                 RelationFingerprints* fingerprints) {
+  fingerprints->Clear();
+  FingerprintingSink sink(fingerprints);
+  for (int i = 0; i < parsed_document.parser_outputs_size(); ++i) {
+    const ParserOutput& output = parsed_document.parser_outputs(i);
+    sink.BeginParser(output.parser_name());
+    AddParserOutputRelations(parsed_document, output, &sink);
+    sink.EndParser();
+  }
+}
+
+DeltaSink::DeltaSink(const RelationFingerprints& previous, RelationSink* sink)
+    : sink_(sink),
+      current_(NULL),
+      truncated_(false),
+      num_added_(0),
+      num_unchanged_(0) {
+  for (int i = 0; i < previous.parsers_size(); ++i) {
+    const RelationFingerprints::Parser& parser = previous.parsers(i);
+    FingerprintCounts* counts = &remaining_[parser.parser_name()];
+    for (int j = 0; j < parser.fingerprints_size(); ++j) {
+      ++(*counts)[parser.fingerprints(j)];
+    }
+  }
+}
+
+DeltaSink::~DeltaSink() {
+}
+
+void DeltaSink::BeginDocument(const StringPiece& url) {
+  sink_->BeginDocument(url);
+}
+
+void DeltaSink::BeginParser(const StringPiece& parser_name) {
+  DCHECK(current_ == NULL);
+  map<string, FingerprintCounts>::iterator it =
+      remaining_.find(parser_name.as_string());
+  current_ = it != remaining_.end() ? &it->second : NULL;
+  sink_->BeginParser(parser_name);
+}
+
+void DeltaSink::AddRelation(const RelationView& relation) {
+  if (current_ != NULL) {
+    FingerprintCounts::iterator it =
+        current_->find(RelationFingerprint(relation));
+    if (it != current_->end()) {
+      if (--it->second == 0) current_->erase(it);
+      ++num_unchanged_;
+      return;
+    }
+  }
+  ++num_added_;
+  sink_->AddRelation(relation);
+}
+
+void DeltaSink::EndParser() {
+  current_ = NULL;
+  sink_->EndParser();
+}
+
+void DeltaSink::AddError(const ParseError& error) {
+  sink_->AddError(error);
+}
+
+void DeltaSink::SetTruncated() {
+  truncated_ = true;
+  sink_->SetTruncated();
+}
+
+void DeltaSink::EndDocument() {
+  sink_->EndDocument();
+}
+
+void DeltaSink::RemovedRelations(RelationFingerprints* removed) const {
+  removed->Clear();
+  if (truncated_) return;
+  for (map<string, FingerprintCounts>::const_iterator it = remaining_.begin();
+       it != remaining_.end(); ++it) {
+    if (it->second.empty()) continue;
+    RelationFingerprints::Parser* parser = removed->add_parsers();
+    parser->set_parser_name(it->first);
+    for (FingerprintCounts::const_iterator count_it = it->second.begin();
+         count_it != it->second.end(); ++count_it) {
+      for (int i = 0; i < count_it->second; ++i) {
+        parser->add_fingerprints(count_it->first);
+      }
+    }
+    // Sorted so that output doesn't depend on hash table order.
+    sort(parser->mutable_fingerprints()->begin(),
+         parser->mutable_fingerprints()->end());
+  }
+}
+
+}  // namespace xpaf
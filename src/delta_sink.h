@@ -0,0 +1,108 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Delta output: rather than all of a document's relations, only those added
+// or removed since a previous parse of the document.
+//
+// Relations are compared by RelationFingerprint(), a 64-bit hash of all of
+// their strings, and matched as multisets per parser, so a relation output
+// twice before and once now counts as one removal. DeltaSink filters
+// relations as they're produced, so unchanged relations are hashed but never
+// copied.
+//
+// Example:
+//   RelationFingerprints previous;  // e.g. loaded from storage
+//   ParsedDocument delta;
+//   master.ParseDocumentDelta(doc, previous, &delta, NULL);
+//   // Write delta.parser_outputs(i).relations, delete the relations listed in
+//   // delta.parser_outputs(i).removed_relation_fingerprints.
+
+#ifndef XPAF_DELTA_SINK_H_
+#define XPAF_DELTA_SINK_H_
+
+#include <map>
+#include <string>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "relation_sink.h"
+
+namespace xpaf {
+
+class ParsedDocument;
+class RelationFingerprints;
+
+// Returns a fingerprint of all of the strings in 'relation', including
+// whether it has userdata. Stable across processes and platforms.
+uint64 RelationFingerprint(const RelationView& relation);
+
+// Replaces the contents of 'fingerprints' with the fingerprint of each relation
+// in 'parsed_document', which may have interned strings. Parsers without
+// relations are omitted.
+void ComputeRelationFingerprints(const ParsedDocument& parsed_document,
+                                 RelationFingerprints* fingerprints);
+
+// Forwards to another sink only the relations not found in a previous output,
+// and records which of the previous relations weren't output again. All other
+// calls are forwarded unchanged. Handles a single document. Not thread-safe.
+class DeltaSink : public RelationSink {
+ public:
+  // Does not take ownership of 'sink', which must outlive this sink.
+  DeltaSink(const RelationFingerprints& previous, RelationSink* sink);
+  virtual ~DeltaSink();
+
+  virtual void BeginDocument(const StringPiece& url);
+  virtual void BeginParser(const StringPiece& parser_name);
+  virtual void AddRelation(const RelationView& relation);
+  virtual void EndParser();
+  virtual void AddError(const ParseError& error);
+  virtual void SetTruncated();
+  virtual void EndDocument();
+
+  // Replaces the contents of 'removed' with the fingerprints of the previous
+  // relations that weren't output, listing each as many times as it was
+  // removed. Call after EndDocument(). If the output was truncated, nothing is
+  // reported as removed, since the missing relations may just not have been
+  // reached.
+  void RemovedRelations(RelationFingerprints* removed) const;
+
+  // Numbers of relations forwarded and dropped as unchanged.
+  int64 num_added() const { return num_added_; }
+  int64 num_unchanged() const { return num_unchanged_; }
+
+ private:
+  // Maps relation fingerprint to the number of times it's still expected.
+  typedef unordered_map<uint64, int> FingerprintCounts;
+
+  RelationSink* const sink_;
+
+  // Previous relations of each parser not yet seen in this document's output.
+  map<string, FingerprintCounts> remaining_;
+
+  // Entry of remaining_ for the current parser, or NULL if it had no previous
+  // relations.
+  FingerprintCounts* current_;
+
+  bool truncated_;
+  int64 num_added_;
+  int64 num_unchanged_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeltaSink);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_DELTA_SINK_H_
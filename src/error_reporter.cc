@@ -0,0 +1,210 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "error_reporter.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/message.h>
+
+#include "base/logging.h"
+#include "base/mutex.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "base/strutil.h"
+#include "base/timer.h"
+#include "parsed_document.pb.h"
+#include "relation_sink.h"
+
+namespace xpaf {
+
+namespace {
+
+const int64 kDefaultSummaryIntervalNanos = 60 * 1000000000LL;
+
+string KeyString(const StringPiece& parser_name, ParseError::Kind kind,
+                 const StringPiece& location) {
+  return StrCat(parser_name, " ", location, " ",
+                ParseError::Kind_Name(kind));
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// ErrorReporter
+
+const int ErrorReporter::kMaxExemplars;
+
+bool ErrorReporter::Key::operator<(const Key& other) const {
+  if (parser_name != other.parser_name) return parser_name < other.parser_name;
+  if (location != other.location) return location < other.location;
+  return kind < other.kind;
+}
+
+ErrorReporter::ErrorReporter()
+    : mu_(new Mutex),
+      summary_interval_nanos_(kDefaultSummaryIntervalNanos),
+      last_summary_nanos_(MonotonicNanos()),
+      random_state_(1) {
+}
+
+ErrorReporter::~ErrorReporter() {
+}
+
+/* static */
+ErrorReporter* ErrorReporter::Global() {
+  // Never deleted, so it can be used during static destruction.
+  static ErrorReporter* const reporter = new ErrorReporter();
+  return reporter;
+}
+
+void ErrorReporter::set_summary_interval_nanos(int64 nanos) {
+  MutexLock lock(mu_.get());
+  summary_interval_nanos_ = nanos;
+}
+
+void ErrorReporter::Report(const StringPiece& parser_name,
+                           ParseError::Kind kind,
+                           const StringPiece& location,
+                           const StringPiece& url,
+                           const StringPiece& message) {
+  Key key;
+  parser_name.CopyToString(&key.parser_name);
+  key.kind = kind;
+  location.CopyToString(&key.location);
+
+  MutexLock lock(mu_.get());
+  Entry* entry = &entries_[key];
+  ++entry->count;
+  ++entry->count_since_summary;
+  if (entry->count == 1) {
+    LOG(ERROR) << "First parse error for "
+               << KeyString(parser_name, kind, location) << ": " << url << ": "
+               << message;
+  }
+
+  // Reservoir sampling: keep each of the n errors since the last summary with
+  // probability kMaxExemplars / n.
+  int slot = entry->exemplars.size();
+  if (slot == kMaxExemplars) {
+    random_state_ = random_state_ * 1103515245 + 12345;
+    slot = (random_state_ >> 8) % entry->count_since_summary;
+  }
+  if (slot < kMaxExemplars) {
+    const string exemplar = StrCat(url, ": ", message);
+    if (slot == entry->exemplars.size()) {
+      entry->exemplars.push_back(exemplar);
+    } else {
+      entry->exemplars[slot] = exemplar;
+    }
+  }
+
+  if (MonotonicNanos() - last_summary_nanos_ >= summary_interval_nanos_) {
+    LogSummaryLocked();
+  }
+}
+
+void ErrorReporter::LogSummary() {
+  MutexLock lock(mu_.get());
+  LogSummaryLocked();
+}
+
+void ErrorReporter::LogSummaryLocked() {
+  last_summary_nanos_ = MonotonicNanos();
+  std::ostringstream summary;
+  for (map<Key, Entry>::iterator it = entries_.begin(); it != entries_.end();
+       ++it) {
+    Entry* entry = &it->second;
+    if (entry->count_since_summary == 0) continue;
+    const Key& key = it->first;
+    summary << "\n  " << KeyString(key.parser_name, key.kind, key.location)
+            << ": " << entry->count_since_summary << " new, " << entry->count
+            << " total";
+    for (int i = 0; i < entry->exemplars.size(); ++i) {
+      summary << "\n    e.g. " << entry->exemplars[i];
+    }
+    entry->count_since_summary = 0;
+    entry->exemplars.clear();
+  }
+  if (summary.tellp() > 0) {
+    LOG(ERROR) << "Parse errors since last summary:" << summary.str();
+  }
+}
+
+void ErrorReporter::GetErrorStats(vector<ErrorStats>* stats) const {
+  MutexLock lock(mu_.get());
+  stats->clear();
+  stats->reserve(entries_.size());
+  for (map<Key, Entry>::const_iterator it = entries_.begin();
+       it != entries_.end(); ++it) {
+    stats->resize(stats->size() + 1);
+    ErrorStats* curr = &stats->back();
+    curr->parser_name = it->first.parser_name;
+    curr->kind = it->first.kind;
+    curr->location = it->first.location;
+    curr->count = it->second.count;
+    curr->exemplars = it->second.exemplars;
+  }
+}
+
+void ErrorReporter::Clear() {
+  MutexLock lock(mu_.get());
+  entries_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ParseErrorHandler
+
+namespace internal {
+
+ParseErrorHandler::ParseErrorHandler(const StringPiece& parser_name,
+                                     const StringPiece& url,
+                                     ErrorHandlingMode error_handling_mode,
+                                     RelationSink* sink)
+    : parser_name_(parser_name),
+      url_(url),
+      error_handling_mode_(error_handling_mode),
+      sink_(sink) {
+}
+
+void ParseErrorHandler::HandleError(
+    ParseError::Kind kind,
+    const StringPiece& location,
+    const StringPiece& message,
+    const google::protobuf::Message& def) const {
+  if (error_handling_mode_ == EHM_ABORT_PROCESS) {
+    LOG(FATAL) << KeyString(parser_name_, kind, location) << ": " << message
+               << "\nurl: " << url_
+               << "\n" << def.GetDescriptor()->name() << ":\n"
+               << def.DebugString();
+  }
+  if (sink_ != NULL) {
+    ParseError error;
+    error.set_parser_name(parser_name_.data(), parser_name_.size());
+    error.set_kind(kind);
+    error.set_location(location.data(), location.size());
+    error.set_message(message.data(), message.size());
+    sink_->AddError(error);
+  }
+  if (error_handling_mode_ >= EHM_LOG_ERROR) {
+    ErrorReporter::Global()->Report(parser_name_, kind, location, url_,
+                                    message);
+  }
+}
+
+}  // namespace internal
+}  // namespace xpaf
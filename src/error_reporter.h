@@ -0,0 +1,168 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Aggregated reporting of errors found while parsing documents (see
+// ParseError in parsed_document.proto).
+//
+// Logging every error as it happens doesn't scale: a single broken parser can
+// fail on every document it sees. Instead, with ParseOptions.error_handling_mode
+// set to EHM_LOG_ERROR, errors are counted by (parser name, location, kind) in
+// ErrorReporter::Global(). The first error for each key is logged right away;
+// after that, a summary of new errors, with a few sampled exemplars per key, is
+// logged at most once per summary interval.
+//
+// Summaries are only logged from Report(), so errors followed by a quiet
+// period aren't summarized until the next error arrives. Callers should call
+// ErrorReporter::Global()->LogSummary() before exiting, and long-running
+// callers should also call it periodically, e.g. from a monitoring thread.
+
+#ifndef XPAF_ERROR_REPORTER_H_
+#define XPAF_ERROR_REPORTER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+#include "xpaf_parser.h"  // for ErrorHandlingMode
+
+namespace google { namespace protobuf { class Message; } }
+
+namespace xpaf {
+
+class Mutex;
+class RelationSink;
+
+// Thread-safe.
+class ErrorReporter {
+ public:
+  // Maximum number of exemplars kept per key per summary interval.
+  static const int kMaxExemplars = 3;
+
+  // Aggregated errors for one key.
+  struct ErrorStats {
+    string parser_name;
+    ParseError::Kind kind;
+    string location;
+    int64 count;  // since construction or Clear()
+    // "<url>: <message>" for up to kMaxExemplars errors, sampled uniformly
+    // from the errors since the last summary.
+    vector<string> exemplars;
+  };
+
+  ErrorReporter();
+  ~ErrorReporter();
+
+  // Returns the process-wide reporter.
+  static ErrorReporter* Global();
+
+  // Defaults to one minute. Zero means log a summary on every Report() call.
+  void set_summary_interval_nanos(int64 nanos);
+
+  // Records an error. Copies 'url' and 'message' only if they're kept as an
+  // exemplar.
+  void Report(const StringPiece& parser_name,
+              ParseError::Kind kind,
+              const StringPiece& location,
+              const StringPiece& url,
+              const StringPiece& message);
+
+  // Logs a summary of the errors reported since the last summary, if any. See
+  // the file comment for when to call this.
+  void LogSummary();
+
+  // Replaces the contents of 'stats' with all keys seen so far, sorted by key.
+  void GetErrorStats(vector<ErrorStats>* stats) const;
+
+  // Forgets all errors.
+  void Clear();
+
+ private:
+  struct Key {
+    string parser_name;
+    ParseError::Kind kind;
+    string location;
+
+    bool operator<(const Key& other) const;
+  };
+
+  struct Entry {
+    int64 count;
+    // Errors since the last summary; exemplars are sampled from these.
+    int64 count_since_summary;
+    vector<string> exemplars;
+
+    Entry() : count(0), count_since_summary(0) {}
+  };
+
+  void LogSummaryLocked();
+
+  const scoped_ptr<Mutex> mu_;
+  map<Key, Entry> entries_;
+  int64 summary_interval_nanos_;
+  int64 last_summary_nanos_;
+  uint32 random_state_;  // for exemplar sampling
+
+  DISALLOW_COPY_AND_ASSIGN(ErrorReporter);
+};
+
+namespace internal {
+
+// Handles the errors found by one XpafParser::Parse() call, as specified by
+// ParseOptions.error_handling_mode and ParseOptions.output_errors.
+class ParseErrorHandler {
+ public:
+  // Does not copy the strings 'parser_name' and 'url' point to, which must
+  // outlive this handler. If 'sink' is non-NULL, each error is also passed to
+  // sink->AddError().
+  ParseErrorHandler(const StringPiece& parser_name,
+                    const StringPiece& url,
+                    ErrorHandlingMode error_handling_mode,
+                    RelationSink* sink);
+
+  const StringPiece& parser_name() const { return parser_name_; }
+  ErrorHandlingMode error_handling_mode() const { return error_handling_mode_; }
+
+  // Returns false if HandleError() would do nothing, so that callers can skip
+  // building the error message.
+  bool enabled() const {
+    return error_handling_mode_ >= EHM_LOG_ERROR || sink_ != NULL;
+  }
+
+  // 'def' is the part of the parser def that the error is about. It's logged
+  // in full only when aborting, since DebugString() is too expensive to call
+  // for every error.
+  void HandleError(ParseError::Kind kind,
+                   const StringPiece& location,
+                   const StringPiece& message,
+                   const google::protobuf::Message& def) const;
+
+ private:
+  const StringPiece parser_name_;
+  const StringPiece url_;
+  const ErrorHandlingMode error_handling_mode_;
+  RelationSink* const sink_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParseErrorHandler);
+};
+
+}  // namespace internal
+}  // namespace xpaf
+
+#endif  // XPAF_ERROR_REPORTER_H_
@@ -0,0 +1,249 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/logging.h"
+#include "base/mutex.h"
+#include "base/stl_decl.h"
+#include "base/stl_util.h"
+#include "metrics.pb.h"
+
+namespace xpaf {
+
+namespace internal {
+
+int CurrentMetricShard() {
+  static volatile int32 next_shard = 0;
+  static __thread int shard = -1;
+  if (shard < 0) {
+    shard = (NoBarrier_AtomicIncrement(&next_shard, 1) - 1) % kNumMetricShards;
+  }
+  return shard;
+}
+
+}  // namespace internal
+
+using internal::CurrentMetricShard;
+using internal::kNumMetricShards;
+
+////////////////////////////////////////////////////////////////////////////////
+// Counter
+
+Counter::Counter() {
+  memset(shards_, 0, sizeof(shards_));
+}
+
+void Counter::IncrementBy(int64 n) {
+  NoBarrier_AtomicIncrement(&shards_[CurrentMetricShard()].value, n);
+}
+
+int64 Counter::Value() const {
+  int64 value = 0;
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    value += NoBarrier_Load(&shards_[i].value);
+  }
+  return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Histogram
+
+const int Histogram::kNumBuckets;
+
+Histogram::Histogram()
+    : shards_(new Shard[kNumMetricShards]) {
+  memset(shards_, 0, sizeof(Shard) * kNumMetricShards);
+}
+
+Histogram::~Histogram() {
+  delete[] shards_;
+}
+
+void Histogram::Add(int64 value) {
+  if (value < 0) value = 0;
+  Shard* shard = &shards_[CurrentMetricShard()];
+  NoBarrier_AtomicIncrement(&shard->count, static_cast<int64>(1));
+  NoBarrier_AtomicIncrement(&shard->sum, value);
+  NoBarrier_AtomicIncrement(&shard->buckets[BucketForValue(value)],
+                            static_cast<int64>(1));
+}
+
+int64 Histogram::Count() const {
+  int64 count = 0;
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    count += NoBarrier_Load(&shards_[i].count);
+  }
+  return count;
+}
+
+int64 Histogram::Sum() const {
+  int64 sum = 0;
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    sum += NoBarrier_Load(&shards_[i].sum);
+  }
+  return sum;
+}
+
+// Values 0-3 get their own buckets. Above that, bucket 4*k+j holds values whose
+// most significant bit is bit k and whose next two bits are j.
+/* static */
+int Histogram::BucketForValue(int64 value) {
+  if (value < 4) return value < 0 ? 0 : value;
+  const int msb = 63 - __builtin_clzll(value);
+  return 4 * (msb - 1) + ((value >> (msb - 2)) & 3);
+}
+
+/* static */
+int64 Histogram::BucketLowerBound(int bucket) {
+  if (bucket < 4) return bucket;
+  return static_cast<int64>(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+/* static */
+int64 Histogram::BucketUpperBound(int bucket) {
+  if (bucket < 4) return bucket + 1;
+  if (bucket == kNumBuckets - 1) return kint64max;
+  return BucketLowerBound(bucket + 1);
+}
+
+void Histogram::BucketCounts(vector<int64>* counts) const {
+  counts->assign(kNumBuckets, 0);
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    for (int j = 0; j < kNumBuckets; ++j) {
+      (*counts)[j] += NoBarrier_Load(&shards_[i].buckets[j]);
+    }
+  }
+}
+
+double Histogram::Percentile(double p) const {
+  vector<int64> counts;
+  BucketCounts(&counts);
+  int64 total = 0;
+  for (int i = 0; i < kNumBuckets; ++i) total += counts[i];
+  if (total == 0) return 0;
+
+  // Find the bucket holding the value with the target rank, then interpolate
+  // linearly within it.
+  const double rank = p * total;
+  int64 seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    if (counts[i] == 0) continue;
+    if (seen + counts[i] >= rank) {
+      const double fraction = (rank - seen) / counts[i];
+      const double lower = BucketLowerBound(i);
+      const double upper = BucketUpperBound(i);
+      return lower + fraction * (upper - lower);
+    }
+    seen += counts[i];
+  }
+  return BucketLowerBound(kNumBuckets - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MetricsRegistry
+
+MetricsRegistry::MetricsRegistry() : mu_(new Mutex) {
+}
+
+MetricsRegistry::~MetricsRegistry() {
+  STLDeleteValues(&counters_);
+  STLDeleteValues(&histograms_);
+}
+
+/* static */
+MetricsRegistry* MetricsRegistry::Global() {
+  // Never deleted, so metrics can be updated during static destruction.
+  static MetricsRegistry* const registry = new MetricsRegistry();
+  return registry;
+}
+
+Counter* MetricsRegistry::GetCounter(const string& name) {
+  MutexLock l(mu_.get());
+  Counter*& counter = counters_[name];
+  if (counter == NULL) counter = new Counter();
+  return counter;
+}
+
+Histogram* MetricsRegistry::GetHistogram(const string& name) {
+  MutexLock l(mu_.get());
+  Histogram*& histogram = histograms_[name];
+  if (histogram == NULL) histogram = new Histogram();
+  return histogram;
+}
+
+void MetricsRegistry::ExportText(string* output) const {
+  MetricsSnapshot snapshot;
+  ExportProto(&snapshot);
+  char buf[256];
+  for (int i = 0; i < snapshot.counters_size(); ++i) {
+    const MetricsSnapshot::CounterValue& counter = snapshot.counters(i);
+    snprintf(buf, sizeof(buf), " %lld\n",
+             static_cast<long long>(counter.value()));  // NOLINT
+    output->append(counter.name());
+    output->append(buf);
+  }
+  for (int i = 0; i < snapshot.histograms_size(); ++i) {
+    const MetricsSnapshot::HistogramValue& histogram = snapshot.histograms(i);
+    snprintf(buf, sizeof(buf),
+             " count=%lld mean=%.1f p50=%.1f p90=%.1f p99=%.1f\n",
+             static_cast<long long>(histogram.count()),  // NOLINT
+             histogram.count() > 0 ?
+             static_cast<double>(histogram.sum()) / histogram.count() : 0.0,
+             histogram.p50(), histogram.p90(), histogram.p99());
+    output->append(histogram.name());
+    output->append(buf);
+  }
+}
+
+void MetricsRegistry::ExportProto(MetricsSnapshot* snapshot) const {
+  snapshot->Clear();
+  MutexLock l(mu_.get());
+  for (map<string, Counter*>::const_iterator it = counters_.begin();
+       it != counters_.end(); ++it) {
+    MetricsSnapshot::CounterValue* counter = snapshot->add_counters();
+    counter->set_name(it->first);
+    counter->set_value(it->second->Value());
+  }
+  vector<int64> counts;
+  for (map<string, Histogram*>::const_iterator it = histograms_.begin();
+       it != histograms_.end(); ++it) {
+    const Histogram& histogram = *it->second;
+    MetricsSnapshot::HistogramValue* value = snapshot->add_histograms();
+    value->set_name(it->first);
+    value->set_count(histogram.Count());
+    value->set_sum(histogram.Sum());
+    value->set_p50(histogram.Percentile(0.5));
+    value->set_p90(histogram.Percentile(0.9));
+    value->set_p99(histogram.Percentile(0.99));
+    histogram.BucketCounts(&counts);
+    for (int i = 0; i < counts.size(); ++i) {
+      if (counts[i] == 0) continue;
+      MetricsSnapshot::HistogramValue::Bucket* bucket = value->add_buckets();
+      bucket->set_lower_bound(Histogram::BucketLowerBound(i));
+      bucket->set_upper_bound(Histogram::BucketUpperBound(i));
+      bucket->set_count(counts[i]);
+    }
+  }
+}
+
+}  // namespace xpaf
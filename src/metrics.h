@@ -0,0 +1,160 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Process-wide counters and histograms.
+//
+// Updates are lock-free and touch a per-thread shard, so they stay cheap when
+// many threads update the same metric. Reads (Value(), exports) sum over all
+// shards and may be slightly stale relative to concurrent updates.
+//
+// Example:
+//   static Counter* const docs = MetricsRegistry::Global()->GetCounter("docs");
+//   docs->Increment();
+//
+// Metrics recorded by XpafParserMaster and XpafParser when
+// ParseOptions.record_metrics is true:
+//   xpaf/docs_parsed                  documents given to at least one parser
+//   xpaf/docs_skipped                 documents no parser wanted to parse
+//   xpaf/docs_truncated               documents whose parse budget ran out
+//   xpaf/docs_reused                  documents ReparseDocument() handled by
+//                                     copying previous output, without a DOM
+//   xpaf/result_cache_hits            documents found in ParseOptions.result_cache
+//   xpaf/result_cache_misses          documents not found there
+//   xpaf/relations                    relations emitted by parsers, before
+//                                     ParseOptions.max_relations and
+//                                     max_output_bytes drop any
+//   xpaf/parse_latency_nanos          ParseDocument() latency (histogram)
+//   xpaf/doc_bytes                    size of parsed documents (histogram)
+//   xpaf/parser/<name>/invocations    XpafParser::Parse() calls
+//   xpaf/parser/<name>/empty_invocations
+//                                     calls that emitted no relations
+
+#ifndef XPAF_METRICS_H_
+#define XPAF_METRICS_H_
+
+#include <map>
+#include <string>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class MetricsSnapshot;
+class Mutex;
+
+namespace internal {
+
+const int kNumMetricShards = 16;
+
+// Returns the calling thread's shard index in [0, kNumMetricShards).
+int CurrentMetricShard();
+
+}  // namespace internal
+
+class Counter {
+ public:
+  Counter();
+
+  void Increment() { IncrementBy(1); }
+  void IncrementBy(int64 n);
+
+  // Returns the sum of all increments so far.
+  int64 Value() const;
+
+ private:
+  // Padded to a cache line to avoid false sharing between shards.
+  struct Shard {
+    volatile int64 value;
+    char padding[64 - sizeof(int64)];
+  };
+  Shard shards_[internal::kNumMetricShards];
+
+  DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+// Histogram of non-negative values (negative values are counted as 0), with
+// four logarithmically spaced buckets per power of two, so percentile
+// estimates are within about 25% of the true value.
+class Histogram {
+ public:
+  // Values 0-3 get a bucket each, then four buckets per power of two up to
+  // kint64max.
+  static const int kNumBuckets = 4 + 4 * 61;
+
+  Histogram();
+  ~Histogram();
+
+  void Add(int64 value);
+
+  int64 Count() const;
+  int64 Sum() const;
+
+  // Returns an estimate of the given percentile, with 0 <= p <= 1, or 0 if the
+  // histogram is empty.
+  double Percentile(double p) const;
+
+  // Returns the bucket for 'value', and the range of values in a bucket.
+  static int BucketForValue(int64 value);
+  static int64 BucketLowerBound(int bucket);
+  static int64 BucketUpperBound(int bucket);
+
+  // Sets 'counts' to the total count in each bucket.
+  void BucketCounts(vector<int64>* counts) const;
+
+ private:
+  struct Shard {
+    volatile int64 count;
+    volatile int64 sum;
+    volatile int64 buckets[kNumBuckets];
+  } __attribute__((aligned(64)));
+  Shard* shards_;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// Thread-safe.
+class MetricsRegistry {
+ public:
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  // Returns the process-wide registry.
+  static MetricsRegistry* Global();
+
+  // Returns the metric with the given name, creating it if needed. The
+  // returned pointer is valid for the lifetime of this registry, so callers on
+  // hot paths should look metrics up once and keep the pointer.
+  Counter* GetCounter(const string& name);
+  Histogram* GetHistogram(const string& name);
+
+  // Appends one line per metric to 'output', sorted by name.
+  void ExportText(string* output) const;
+
+  // Replaces the contents of 'snapshot' with the current metric values.
+  void ExportProto(MetricsSnapshot* snapshot) const;
+
+ private:
+  const scoped_ptr<Mutex> mu_;
+  map<string, Counter*> counters_;
+  map<string, Histogram*> histograms_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_METRICS_H_
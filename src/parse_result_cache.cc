@@ -0,0 +1,140 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parse_result_cache.h"
+
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/mutex.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+
+namespace xpaf {
+
+ParseResultCache::ParseResultCache(int64 max_bytes)
+    : max_bytes_(max_bytes), mu_(new Mutex), hand_(0), bytes_(0) {
+  CHECK_GT(max_bytes_, 0);
+}
+
+ParseResultCache::~ParseResultCache() {
+}
+
+bool ParseResultCache::Lookup(uint64 key, const StringPiece& url,
+                              ParsedDocument* parsed_document) {
+  shared_ptr<const ParsedDocument> found;
+  {
+    MutexLock l(mu_.get());
+    unordered_map<uint64, int>::const_iterator it = slots_.find(key);
+    if (it != slots_.end()) {
+      Entry* entry = &entries_[it->second];
+      // Guards against fingerprint collisions between urls; collisions for the
+      // same url are as unlikely as they are undetectable here.
+      if (url == entry->parsed_document->url()) {
+        entry->referenced = true;
+        found = entry->parsed_document;
+      }
+    }
+  }
+  if (found == NULL) {
+    misses_.Increment();
+    return false;
+  }
+  hits_.Increment();
+  // Entries are immutable, so we can copy outside the lock.
+  parsed_document->CopyFrom(*found);
+  return true;
+}
+
+void ParseResultCache::Insert(uint64 key,
+                              const ParsedDocument& parsed_document) {
+  ParsedDocument* copy = new ParsedDocument(parsed_document);
+  shared_ptr<const ParsedDocument> entry_document(copy);
+  const int64 bytes = copy->SpaceUsedLong();
+  if (bytes > max_bytes_) return;
+
+  MutexLock l(mu_.get());
+  unordered_map<uint64, int>::iterator it = slots_.find(key);
+  if (it != slots_.end()) {
+    RemoveLocked(it->second);
+  }
+  while (bytes_ + bytes > max_bytes_) {
+    EvictLocked();
+  }
+  int slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = entries_.size();
+    entries_.push_back(Entry());
+  }
+  Entry* entry = &entries_[slot];
+  entry->key = key;
+  entry->parsed_document = entry_document;
+  entry->bytes = bytes;
+  entry->referenced = false;
+  slots_[key] = slot;
+  bytes_ += bytes;
+}
+
+void ParseResultCache::Clear() {
+  MutexLock l(mu_.get());
+  entries_.clear();
+  free_slots_.clear();
+  slots_.clear();
+  hand_ = 0;
+  bytes_ = 0;
+}
+
+int ParseResultCache::size() const {
+  MutexLock l(mu_.get());
+  return slots_.size();
+}
+
+int64 ParseResultCache::bytes() const {
+  MutexLock l(mu_.get());
+  return bytes_;
+}
+
+void ParseResultCache::RemoveLocked(int slot) {
+  Entry* entry = &entries_[slot];
+  DCHECK(entry->parsed_document != NULL);
+  slots_.erase(entry->key);
+  bytes_ -= entry->bytes;
+  entry->parsed_document.reset();
+  free_slots_.push_back(slot);
+}
+
+void ParseResultCache::EvictLocked() {
+  DCHECK(!slots_.empty());
+  // Terminates within two sweeps, since the first clears every bit.
+  while (true) {
+    if (hand_ >= entries_.size()) hand_ = 0;
+    const int slot = hand_++;
+    Entry* entry = &entries_[slot];
+    if (entry->parsed_document == NULL) continue;
+    if (entry->referenced) {
+      entry->referenced = false;
+      continue;
+    }
+    RemoveLocked(slot);
+    evictions_.Increment();
+    return;
+  }
+}
+
+}  // namespace xpaf
@@ -0,0 +1,115 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A bounded cache of ParsedDocuments, for skipping documents whose content
+// hasn't changed since they were last parsed. See ParseOptions.result_cache.
+//
+// Entries are keyed by a 64-bit fingerprint computed by the caller (see
+// XpafParserMaster::ResultCacheKey()) and evicted with the CLOCK algorithm: a
+// hand sweeps over the entries, evicting the first one that hasn't been looked
+// up since the hand last passed it. This approximates LRU, but a hit only sets
+// a bit rather than reordering a list.
+//
+// Example:
+//   ParseResultCache cache(256 << 20);
+//   ParseOptions opt;
+//   opt.result_cache = &cache;
+//   XpafParserMaster master(parser_defs, opt);
+//   master.ParseDocument(doc, &parsed_document);  // parses 'doc'
+//   master.ParseDocument(doc, &parsed_document);  // copies the cached result
+
+#ifndef XPAF_PARSE_RESULT_CACHE_H_
+#define XPAF_PARSE_RESULT_CACHE_H_
+
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+#include "metrics.h"
+
+namespace xpaf {
+
+class Mutex;
+class ParsedDocument;
+class StringPiece;
+
+// Thread-safe.
+class ParseResultCache {
+ public:
+  // Holds up to 'max_bytes' of ParsedDocuments, as measured by
+  // ParsedDocument::SpaceUsedLong().
+  explicit ParseResultCache(int64 max_bytes);
+  ~ParseResultCache();
+
+  // If we have an entry for 'key' whose url is 'url', replaces the contents of
+  // 'parsed_document' with it and returns true. Otherwise returns false.
+  bool Lookup(uint64 key, const StringPiece& url,
+              ParsedDocument* parsed_document);
+
+  // Stores a copy of 'parsed_document' under 'key', replacing any existing
+  // entry and evicting others as needed. Documents larger than the whole cache
+  // are not stored.
+  void Insert(uint64 key, const ParsedDocument& parsed_document);
+
+  // Removes all entries. Does not reset the counters below.
+  void Clear();
+
+  // Numbers of Lookup() calls that did and did not find an entry, and of
+  // entries evicted to make room for others.
+  int64 hits() const { return hits_.Value(); }
+  int64 misses() const { return misses_.Value(); }
+  int64 evictions() const { return evictions_.Value(); }
+
+  // Current number of entries, and their total size.
+  int size() const;
+  int64 bytes() const;
+
+ private:
+  struct Entry {
+    uint64 key;
+    shared_ptr<const ParsedDocument> parsed_document;
+    int64 bytes;
+    bool referenced;  // set by Lookup(), cleared by the clock hand
+  };
+
+  // Removes the entry in 'slot', leaving the slot free. Requires mu_.
+  void RemoveLocked(int slot);
+
+  // Advances the clock hand until it evicts an entry. There must be at least
+  // one entry. Requires mu_.
+  void EvictLocked();
+
+  const int64 max_bytes_;
+
+  const scoped_ptr<Mutex> mu_;
+  // Slots in clock order. Free slots have a NULL parsed_document.
+  vector<Entry> entries_;
+  vector<int> free_slots_;
+  // Maps key to slot.
+  unordered_map<uint64, int> slots_;
+  int hand_;
+  int64 bytes_;
+
+  Counter hits_;
+  Counter misses_;
+  Counter evictions_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParseResultCache);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_PARSE_RESULT_CACHE_H_
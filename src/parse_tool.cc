@@ -28,7 +28,11 @@
 #include "base/stl_decl.h"
 #include "base/strutil.h"
 #include "document.h"
+#include "error_reporter.h"
+#include "metrics.h"
+#include "parse_stats.pb.h"
 #include "parsed_document.pb.h"
+#include "parser_snapshot.h"
 #include "util.h"
 #include "xpaf_parser.h"
 #include "xpaf_parser_def.pb.h"
@@ -38,8 +42,25 @@ DEFINE_string(input_file_path, "",
               "Path of file to parse.");
 DEFINE_string(parser_defs_glob, "",
               "File pattern for parser def files. E.g., '/path/to/*.xpd'.");
+DEFINE_string(parser_snapshot, "",
+              "Parser snapshot file written by compile_xpd. Used instead of "
+              "--parser_defs_glob.");
 DEFINE_bool(abort_on_parse_error, false,
             "If true, we abort on parse errors.");
+DEFINE_int32(num_init_threads, 1,
+             "Number of threads to use for reading and initializing parsers.");
+DEFINE_bool(lazy_init, false,
+            "If true, we defer parser initialization until first use.");
+DEFINE_bool(print_parse_stats, false,
+            "If true, we also print per-parser and per-query statistics.");
+DEFINE_bool(dump_metrics, false,
+            "If true, we record process-wide metrics and print them at exit.");
+DEFINE_int64(time_budget_nanos, 0,
+             "Per-document parse time budget. Zero means no limit.");
+DEFINE_int64(max_xpath_ops, 0,
+             "Per-document XPath operation budget. Zero means no limit.");
+DEFINE_bool(intern_strings, false,
+            "If true, we output relations with interned strings.");
 
 namespace xpaf {
 
@@ -47,24 +68,50 @@ void Run() {
   File::Init();
 
   CHECK(!FLAGS_input_file_path.empty());
-  CHECK(!FLAGS_parser_defs_glob.empty());
-
-  XpafParserDefs parser_defs;
-  ReadXpafParserDefs(FLAGS_parser_defs_glob, &parser_defs);
+  CHECK_NE(FLAGS_parser_defs_glob.empty(), FLAGS_parser_snapshot.empty())
+      << "Exactly one of --parser_defs_glob, --parser_snapshot must be set";
 
   ParseOptions opt;
   if (FLAGS_abort_on_parse_error) {
     opt.error_handling_mode = EHM_ABORT_PROCESS;
   }
-  XpafParserMaster master(parser_defs, opt);
+  opt.intern_strings = FLAGS_intern_strings;
+  opt.num_init_threads = FLAGS_num_init_threads;
+  opt.lazy_init = FLAGS_lazy_init;
+  opt.record_metrics = FLAGS_dump_metrics;
+  opt.time_budget_nanos = FLAGS_time_budget_nanos;
+  opt.max_xpath_ops = FLAGS_max_xpath_ops;
+
+  scoped_ptr<XpafParserMaster> master;
+  if (!FLAGS_parser_snapshot.empty()) {
+    CompiledXpafParserDefs compiled_defs;
+    ReadParserSnapshot(FLAGS_parser_snapshot, &compiled_defs);
+    master.reset(new XpafParserMaster(&compiled_defs, opt));
+  } else {
+    XpafParserDefs parser_defs;
+    ReadXpafParserDefsParallel(FLAGS_parser_defs_glob, FLAGS_num_init_threads,
+                               &parser_defs);
+    master.reset(new XpafParserMaster(parser_defs, opt));
+  }
 
   string url, content;
   scoped_ptr<Document> doc(
       MakeDocFromFile(FLAGS_input_file_path, &url, &content));
 
   ParsedDocument parsed_document;
-  master.ParseDocument(*doc, &parsed_document);
+  ParseStats stats;
+  master->ParseDocument(*doc, &parsed_document,
+                        FLAGS_print_parse_stats ? &stats : NULL);
   printf("%s", parsed_document.DebugString().c_str());
+  if (FLAGS_print_parse_stats) {
+    printf("\n%s", stats.DebugString().c_str());
+  }
+  if (FLAGS_dump_metrics) {
+    string metrics;
+    MetricsRegistry::Global()->ExportText(&metrics);
+    printf("\n%s", metrics.c_str());
+  }
+  ErrorReporter::Global()->LogSummary();
 }
 
 }  // namespace xpaf
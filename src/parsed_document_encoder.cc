@@ -0,0 +1,255 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// To match SerializeToString() byte for byte, we must write fields in field
+// number order, omit unset optional fields, and use minimal-length varints,
+// exactly as the generated code does. All field numbers in
+// parsed_document.proto are below 16, so every tag fits in a single byte.
+
+#include "parsed_document_encoder.h"
+
+#include <string>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+#include "relation_sink.h"
+#include "string_interner.h"
+
+namespace xpaf {
+
+namespace {
+
+const int kWireTypeVarint = 0;
+const int kWireTypeLengthDelimited = 2;
+
+inline char Tag(int field_number, int wire_type) {
+  DCHECK_LT(field_number, 16);
+  return static_cast<char>((field_number << 3) | wire_type);
+}
+
+inline int VarintSize(uint32 value) {
+  int size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+inline void AppendVarint(uint32 value, string* out) {
+  char buf[5];
+  int size = 0;
+  while (value >= 0x80) {
+    buf[size++] = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  buf[size++] = static_cast<char>(value);
+  out->append(buf, size);
+}
+
+// Returns the encoded size of a length-delimited field with a payload of
+// 'len' bytes, including its tag.
+inline int LengthDelimitedFieldSize(int len) {
+  return 1 + VarintSize(len) + len;
+}
+
+// Returns the encoded size of an int32 field holding the non-negative value
+// 'value', including its tag.
+inline int VarintFieldSize(int value) {
+  DCHECK_GE(value, 0);
+  return 1 + VarintSize(value);
+}
+
+inline void AppendLengthDelimitedHeader(int field_number, int len,
+                                        string* out) {
+  out->push_back(Tag(field_number, kWireTypeLengthDelimited));
+  AppendVarint(len, out);
+}
+
+inline void AppendStringField(int field_number, const StringPiece& str,
+                              string* out) {
+  AppendLengthDelimitedHeader(field_number, str.size(), out);
+  out->append(str.data(), str.size());
+}
+
+inline void AppendVarintField(int field_number, int value, string* out) {
+  DCHECK_GE(value, 0);
+  out->push_back(Tag(field_number, kWireTypeVarint));
+  AppendVarint(value, out);
+}
+
+// Appends a Relation with string fields to 'out' as field 'field_number'.
+void AppendRelation(int field_number, const RelationView& relation,
+                    string* out) {
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+
+  // First pass: compute sizes, so that we can write length prefixes.
+  int size = LengthDelimitedFieldSize(relation.subject.size()) +
+      LengthDelimitedFieldSize(relation.predicate.size()) +
+      LengthDelimitedFieldSize(relation.object.size());
+  for (int i = 0; i < annotations.size(); ++i) {
+    size += LengthDelimitedFieldSize(
+        LengthDelimitedFieldSize(annotations[i].name.size()) +
+        LengthDelimitedFieldSize(annotations[i].value.size()));
+  }
+  if (relation.has_userdata) {
+    size += LengthDelimitedFieldSize(relation.userdata.size());
+  }
+
+  // Second pass: write.
+  AppendLengthDelimitedHeader(field_number, size, out);
+  AppendStringField(Relation::kSubjectFieldNumber, relation.subject, out);
+  AppendStringField(Relation::kPredicateFieldNumber, relation.predicate, out);
+  AppendStringField(Relation::kObjectFieldNumber, relation.object, out);
+  for (int i = 0; i < annotations.size(); ++i) {
+    const StringPiece& name = annotations[i].name;
+    const StringPiece& value = annotations[i].value;
+    AppendLengthDelimitedHeader(
+        Relation::kAnnotationsFieldNumber,
+        LengthDelimitedFieldSize(name.size()) +
+        LengthDelimitedFieldSize(value.size()),
+        out);
+    AppendStringField(Relation::Annotation::kNameFieldNumber, name, out);
+    AppendStringField(Relation::Annotation::kValueFieldNumber, value, out);
+  }
+  if (relation.has_userdata) {
+    AppendStringField(Relation::kUserdataFieldNumber, relation.userdata, out);
+  }
+}
+
+// Like AppendRelation(), but writes interned ids instead of strings.
+void AppendInternedRelation(int field_number, const RelationView& relation,
+                            StringInterner* interner, string* out) {
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+
+  // Intern everything up front, in the same order as ParsedDocumentSink, so
+  // that ids match.
+  const int subject_id = interner->Intern(relation.subject);
+  const int predicate_id = interner->Intern(relation.predicate);
+  const int object_id = interner->Intern(relation.object);
+  const int userdata_id =
+      relation.has_userdata ? interner->Intern(relation.userdata) : -1;
+  // Annotation ids, as (name_id, value_id) pairs. Small enough that we don't
+  // bother reusing the vector.
+  vector<pair<int, int> > annotation_ids(annotations.size());
+  int size = VarintFieldSize(subject_id) + VarintFieldSize(predicate_id) +
+      VarintFieldSize(object_id);
+  for (int i = 0; i < annotations.size(); ++i) {
+    annotation_ids[i].first = interner->Intern(annotations[i].name);
+    annotation_ids[i].second = interner->Intern(annotations[i].value);
+    size += LengthDelimitedFieldSize(
+        VarintFieldSize(annotation_ids[i].first) +
+        VarintFieldSize(annotation_ids[i].second));
+  }
+  if (userdata_id != -1) {
+    size += VarintFieldSize(userdata_id);
+  }
+
+  AppendLengthDelimitedHeader(field_number, size, out);
+  for (int i = 0; i < annotation_ids.size(); ++i) {
+    const int name_id = annotation_ids[i].first;
+    const int value_id = annotation_ids[i].second;
+    AppendLengthDelimitedHeader(
+        Relation::kAnnotationsFieldNumber,
+        VarintFieldSize(name_id) + VarintFieldSize(value_id),
+        out);
+    AppendVarintField(Relation::Annotation::kNameIdFieldNumber, name_id, out);
+    AppendVarintField(Relation::Annotation::kValueIdFieldNumber, value_id,
+                      out);
+  }
+  AppendVarintField(Relation::kSubjectIdFieldNumber, subject_id, out);
+  AppendVarintField(Relation::kPredicateIdFieldNumber, predicate_id, out);
+  AppendVarintField(Relation::kObjectIdFieldNumber, object_id, out);
+  if (userdata_id != -1) {
+    AppendVarintField(Relation::kUserdataIdFieldNumber, userdata_id, out);
+  }
+}
+
+}  // namespace
+
+ParsedDocumentEncoder::ParsedDocumentEncoder(string* output,
+                                             bool intern_strings)
+    : output_(output),
+      interner_(intern_strings ? new StringInterner() : NULL),
+      num_relations_(0),
+      truncated_(false) {
+}
+
+ParsedDocumentEncoder::~ParsedDocumentEncoder() {
+}
+
+void ParsedDocumentEncoder::BeginDocument(const StringPiece& url) {
+  output_->clear();
+  truncated_ = false;
+  errors_.clear();
+  if (interner_ != NULL) {
+    interner_->Clear();
+  }
+  AppendStringField(ParsedDocument::kUrlFieldNumber, url, output_);
+}
+
+void ParsedDocumentEncoder::BeginParser(const StringPiece& parser_name) {
+  parser_output_.clear();
+  num_relations_ = 0;
+  AppendStringField(ParserOutput::kParserNameFieldNumber, parser_name,
+                    &parser_output_);
+}
+
+void ParsedDocumentEncoder::AddRelation(const RelationView& relation) {
+  if (interner_ != NULL) {
+    AppendInternedRelation(ParserOutput::kRelationsFieldNumber, relation,
+                           interner_.get(), &parser_output_);
+  } else {
+    AppendRelation(ParserOutput::kRelationsFieldNumber, relation,
+                   &parser_output_);
+  }
+  ++num_relations_;
+}
+
+void ParsedDocumentEncoder::EndParser() {
+  // Like ParsedDocumentSink, we omit ParserOutputs with no relations.
+  if (num_relations_ == 0) return;
+  AppendLengthDelimitedHeader(ParsedDocument::kParserOutputsFieldNumber,
+                              parser_output_.size(), output_);
+  output_->append(parser_output_);
+}
+
+void ParsedDocumentEncoder::AddError(const ParseError& error) {
+  AppendStringField(ParsedDocument::kErrorsFieldNumber,
+                    error.SerializeAsString(), &errors_);
+}
+
+void ParsedDocumentEncoder::SetTruncated() {
+  truncated_ = true;
+}
+
+void ParsedDocumentEncoder::EndDocument() {
+  if (interner_ != NULL) {
+    for (int i = 0; i < interner_->size(); ++i) {
+      AppendStringField(ParsedDocument::kInternedStringsFieldNumber,
+                        interner_->Lookup(i), output_);
+    }
+    interner_->Clear();
+  }
+  if (truncated_) {
+    AppendVarintField(ParsedDocument::kTruncatedFieldNumber, 1, output_);
+  }
+  output_->append(errors_);
+}
+
+}  // namespace xpaf
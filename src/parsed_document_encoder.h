@@ -0,0 +1,81 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A RelationSink that writes serialized ParsedDocument bytes directly, without
+// building ParsedDocument, ParserOutput, or Relation messages.
+//
+// Example:
+//   string bytes;  // reuse across documents to avoid reallocation
+//   ParsedDocumentEncoder encoder(&bytes, false);
+//   master.ParseDocument(doc, &encoder);
+//   // 'bytes' now holds a serialized ParsedDocument.
+
+#ifndef XPAF_PARSED_DOCUMENT_ENCODER_H_
+#define XPAF_PARSED_DOCUMENT_ENCODER_H_
+
+#include <string>
+
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "relation_sink.h"
+
+namespace xpaf {
+
+class StringInterner;
+
+// Output is byte-for-byte identical to what ParsedDocument::SerializeToString()
+// produces for a ParsedDocument populated by ParsedDocumentSink with the same
+// 'intern_strings' value. Not thread-safe.
+class ParsedDocumentEncoder : public RelationSink {
+ public:
+  // Does not take ownership of 'output', which must outlive this encoder.
+  // BeginDocument() clears *output (preserving its capacity), and once
+  // EndDocument() returns, *output holds the serialized ParsedDocument.
+  ParsedDocumentEncoder(string* output, bool intern_strings);
+  virtual ~ParsedDocumentEncoder();
+
+  virtual void BeginDocument(const StringPiece& url);
+  virtual void BeginParser(const StringPiece& parser_name);
+  virtual void AddRelation(const RelationView& relation);
+  virtual void EndParser();
+  virtual void AddError(const ParseError& error);
+  virtual void SetTruncated();
+  virtual void EndDocument();
+
+ private:
+  string* const output_;
+
+  // NULL unless we're interning strings.
+  scoped_ptr<StringInterner> interner_;
+
+  // Serialized ParserOutput for the current parser. Its length must precede it
+  // in the output, so we can't write it to output_ until EndParser().
+  string parser_output_;
+  int num_relations_;
+
+  // Set by SetTruncated(). Written in EndDocument(), since 'truncated' follows
+  // the fields written before that in field number order.
+  bool truncated_;
+
+  // Serialized 'errors' fields, which must also come last.
+  string errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParsedDocumentEncoder);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_PARSED_DOCUMENT_ENCODER_H_
@@ -0,0 +1,98 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parser_snapshot.h"
+
+#include <string.h>  // for memcpy
+
+#include <string>
+
+#include "base/file.h"
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "xpaf_parser_def.pb.h"
+
+namespace xpaf {
+
+const uint32 kParserSnapshotVersion = 2;
+
+namespace {
+
+const uint32 kMagic = 0x53535058;  // "XPSS" in little-endian byte order
+
+struct SnapshotHeader {
+  uint32 magic;
+  uint32 version;
+  uint64 payload_size;
+};
+
+}  // namespace
+
+void SerializeParserSnapshot(const CompiledXpafParserDefs& compiled_defs,
+                             string* snapshot) {
+  string payload;
+  CHECK(compiled_defs.SerializeToString(&payload));
+
+  SnapshotHeader header;
+  header.magic = kMagic;
+  header.version = kParserSnapshotVersion;
+  header.payload_size = payload.size();
+
+  snapshot->assign(reinterpret_cast<const char*>(&header), sizeof(header));
+  snapshot->append(payload);
+}
+
+bool ParseParserSnapshot(const StringPiece& snapshot,
+                         CompiledXpafParserDefs* compiled_defs) {
+  if (snapshot.size() < sizeof(SnapshotHeader)) {
+    LOG(ERROR) << "Parser snapshot too small: " << snapshot.size();
+    return false;
+  }
+  SnapshotHeader header;
+  memcpy(&header, snapshot.data(), sizeof(header));
+  if (header.magic != kMagic) {
+    LOG(ERROR) << "Not a parser snapshot, or wrong byte order";
+    return false;
+  }
+  if (header.version != kParserSnapshotVersion) {
+    LOG(ERROR) << "Unsupported parser snapshot version " << header.version
+               << " (expected " << kParserSnapshotVersion << ")";
+    return false;
+  }
+  if (header.payload_size != snapshot.size() - sizeof(header)) {
+    LOG(ERROR) << "Truncated parser snapshot: expected "
+               << header.payload_size << " payload bytes, got "
+               << snapshot.size() - sizeof(header);
+    return false;
+  }
+  if (!compiled_defs->ParseFromArray(snapshot.data() + sizeof(header),
+                                     header.payload_size)) {
+    LOG(ERROR) << "Corrupt parser snapshot payload";
+    return false;
+  }
+  return true;
+}
+
+void ReadParserSnapshot(const string& file_path,
+                        CompiledXpafParserDefs* compiled_defs) {
+  MappedFile file;
+  CHECK(file.Open(file_path)) << "Failed to map file: " << file_path;
+  CHECK(ParseParserSnapshot(StringPiece(file.data(), file.size()),
+                            compiled_defs))
+      << file_path;
+}
+
+}  // namespace xpaf
@@ -0,0 +1,66 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Binary snapshots of fully processed parser definitions, for fast startup.
+//
+// A snapshot holds a CompiledXpafParserDefs proto (see xpaf_parser_def.proto),
+// i.e. parser defs whose references have already been validated and whose
+// inlined queries have already been resolved, preceded by a small header:
+//  * 4-byte magic "XPSS";
+//  * uint32 format version (kParserSnapshotVersion);
+//  * uint64 payload size.
+// Integers are stored in host byte order; readers reject snapshots written
+// with a different byte order or format version.
+//
+// Snapshots are written by compile_xpd and loaded via ReadParserSnapshot(),
+// which maps the file rather than reading it. Compiled RE2 and XPath
+// expressions are not serializable, so url_regexp patterns and queries are
+// stored as strings and compiled at use, exactly as with text parser defs.
+
+#ifndef XPAF_PARSER_SNAPSHOT_H_
+#define XPAF_PARSER_SNAPSHOT_H_
+
+#include <string>
+
+#include "base/integral_types.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class CompiledXpafParserDefs;
+class StringPiece;
+
+// Bump whenever CompiledXpafParserDef semantics change in a way that old
+// snapshots can't express.
+extern const uint32 kParserSnapshotVersion;
+
+// Replaces the contents of 'snapshot' with a serialized snapshot of
+// 'compiled_defs'.
+void SerializeParserSnapshot(const CompiledXpafParserDefs& compiled_defs,
+                             string* snapshot);
+
+// Parses a snapshot produced by SerializeParserSnapshot() into
+// 'compiled_defs'. Returns false (and logs why) if 'snapshot' is not a valid
+// snapshot for this build.
+bool ParseParserSnapshot(const StringPiece& snapshot,
+                         CompiledXpafParserDefs* compiled_defs);
+
+// Maps the snapshot file at 'file_path' and parses it into 'compiled_defs'.
+// Dies on failure.
+void ReadParserSnapshot(const string& file_path,
+                        CompiledXpafParserDefs* compiled_defs);
+
+}  // namespace xpaf
+
+#endif  // XPAF_PARSER_SNAPSHOT_H_
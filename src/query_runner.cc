@@ -30,10 +30,13 @@
 #include "base/stl_decl.h"
 #include "base/stringpiece.h"
 #include "base/strutil.h"
+#include "base/timer.h"
 #include "base/url.h"
+#include "error_reporter.h"
+#include "parse_stats.pb.h"
+#include "parsed_document.pb.h"
 #include "post_processing_ops.pb.h"
 #include "xpaf_parser_def.pb.h"
-#include "xpaf_parser.h"  // for ErrorHandlingMode
 #include "xpath_wrapper.h"
 
 namespace xpaf {
@@ -48,9 +51,18 @@ bool QueryReturnsUrls(const string& query) {
   return HasSuffixString(query, "/@href") || HasSuffixString(query, "/@src");
 }
 
-// Converts 'url' into an absolute url with 'base_url' as its base.
-// Return value indicates whether conversion succeeded. If this returns false,
-// *absolute_url should not be used.
+// Adds 'nanos' to query_stats->post_processing_op_nanos(op_index).
+void AddPostProcessingOpNanos(int op_index, int64 nanos,
+                              QueryStats* query_stats) {
+  while (query_stats->post_processing_op_nanos_size() <= op_index) {
+    query_stats->add_post_processing_op_nanos(0);
+  }
+  query_stats->set_post_processing_op_nanos(
+      op_index, query_stats->post_processing_op_nanos(op_index) + nanos);
+}
+
+}  // namespace
+
 bool AbsolutizeUrl(const string& url,
                    const URL& base_url,
                    string* absolute_url) {
@@ -59,15 +71,43 @@ bool AbsolutizeUrl(const string& url,
   return absolute_url_obj.is_valid();
 }
 
-}  // namespace
+bool ApplyPostProcessingOp(const PostProcessingOp& op,
+                           string* result,
+                           string* scratch) {
+  // TODO(sadovsky): Implement SubstrOp and ConvertOp.
+  if (op.has_replace_op()) {
+    if (op.replace_op().global()) {
+      RE2::GlobalReplace(result, op.replace_op().regexp(),
+                         op.replace_op().rewrite());
+    } else {
+      RE2::Replace(result, op.replace_op().regexp(),
+                   op.replace_op().rewrite());
+    }
+    return true;
+  } else if (op.has_extract_op()) {
+    scratch->swap(*result);
+    return RE2::PartialMatch(*scratch, op.extract_op().regexp(), result);
+  } else if (op.has_substr_op()) {
+    LOG(FATAL) << kInvalidPostProcessingOpError;
+  } else if (op.has_convert_op()) {
+    LOG(FATAL) << kInvalidPostProcessingOpError;
+  } else {
+    LOG(FATAL) << kInvalidPostProcessingOpError;
+  }
+  return false;
+}
 
 QueryRunner::QueryRunner(const StringPiece& url,
                          const XPathWrapper& xpath_wrapper,
-                         ErrorHandlingMode error_handling_mode)
+                         const ParseErrorHandler& error_handler,
+                         int max_results,
+                         ParserStats* stats)
     : url_(url),
       url_obj_(new URL(url_)),
       xpath_wrapper_(xpath_wrapper),
-      error_handling_mode_(error_handling_mode) {
+      error_handler_(error_handler),
+      max_results_(max_results),
+      stats_(stats) {
 }
 
 QueryRunner::~QueryRunner() {
@@ -78,6 +118,7 @@ QueryRunner::~QueryRunner() {
 // *processed_result will be unchanged.
 bool QueryRunner::PostProcessResult(const QueryDef& query_def,
                                     const char* orig_result,
+                                    QueryStats* query_stats,
                                     string* processed_result) const {
   bool ok = true;
   string in;
@@ -89,35 +130,21 @@ bool QueryRunner::PostProcessResult(const QueryDef& query_def,
   for (int i = 0; i < query_def.post_processing_ops_size(); ++i) {
     if (!ok) break;
     const PostProcessingOp& op = query_def.post_processing_ops(i);
-    // TODO(sadovsky): Implement SubstrOp and ConvertOp.
-    if (op.has_replace_op()) {
-      if (op.replace_op().global()) {
-        RE2::GlobalReplace(&out, op.replace_op().regexp(),
-                           op.replace_op().rewrite());
-      } else {
-        RE2::Replace(&out, op.replace_op().regexp(),
-                     op.replace_op().rewrite());
-      }
-    } else if (op.has_extract_op()) {
-      in.swap(out);
-      ok = RE2::PartialMatch(in, op.extract_op().regexp(), &out);
-    } else if (op.has_substr_op()) {
-      LOG(FATAL) << kInvalidPostProcessingOpError;
-    } else if (op.has_convert_op()) {
-      LOG(FATAL) << kInvalidPostProcessingOpError;
-    } else {
-      LOG(FATAL) << kInvalidPostProcessingOpError;
+    const int64 op_start_nanos = query_stats != NULL ? MonotonicNanos() : 0;
+    ok = ApplyPostProcessingOp(op, &out, &in);
+    if (query_stats != NULL) {
+      AddPostProcessingOpNanos(i, MonotonicNanos() - op_start_nanos,
+                               query_stats);
     }
   }
 
   if (!ok) {
-    if (error_handling_mode_ >= EHM_LOG_ERROR) {
-      LOG(ERROR) << "PostProcessResult() failed"
-                 << "\nurl: " << url_
-                 << "\norig_result: " << orig_result
-                 << "\nquery_def:\n" << query_def.DebugString();
+    if (error_handler_.enabled()) {
+      error_handler_.HandleError(
+          ParseError::POST_PROCESSING_FAILED, query_def.name(),
+          StrCat("Post-processing failed for result: ", orig_result),
+          query_def);
     }
-    if (error_handling_mode_ == EHM_ABORT_PROCESS) LOG(FATAL);
   } else {
     processed_result->swap(out);
   }
@@ -129,43 +156,62 @@ bool QueryRunner::PostProcessResult(const QueryDef& query_def,
 inline void QueryRunner::PostProcessAndAppendResult(
     const QueryDef& query_def,
     const char* result_str,
+    QueryStats* query_stats,
     QueryResults* results) const {
   string processed_result;
-  const bool ok = PostProcessResult(query_def, result_str, &processed_result);
+  const bool ok = PostProcessResult(query_def, result_str, query_stats,
+                                    &processed_result);
   results->push_back(make_pair(ok ? processed_result : "", ok));
 }
 
+xmlXPathObjectPtr QueryRunner::EvalExpression(const string& expr,
+                                              QueryStats** query_stats) const {
+  if (stats_ == NULL) {
+    *query_stats = NULL;
+    return xpath_wrapper_.EvalExpression(expr);
+  }
+  *query_stats = stats_->add_query_stats();
+  (*query_stats)->set_query(expr);
+  const int64 start_nanos = MonotonicNanos();
+  xmlXPathObjectPtr xpath_obj = xpath_wrapper_.EvalExpression(expr);
+  (*query_stats)->set_eval_nanos(MonotonicNanos() - start_nanos);
+  return xpath_obj;
+}
+
 void QueryRunner::RunStandaloneQuery(const QueryDef& query_def,
                                      QueryResults* results) const {
   DCHECK(results->empty());
 
+  QueryStats* query_stats;
   xmlXPathObjectPtr xpath_obj =
-      xpath_wrapper_.EvalExpressionOrDie(query_def.query());
+      EvalExpression(query_def.query(), &query_stats);
+  if (xpath_obj == NULL) return;  // out of budget
   const AutoClosureRunner xpath_obj_deleter(
       NewCallback(&xmlXPathFreeObject, xpath_obj));
   if (xpath_obj->type == XPATH_BOOLEAN) {
     // Note: We could use xmlXPathCastBooleanToString, but that returns "true"
     // or "false". "1" or "0" is more concise.
     PostProcessAndAppendResult(
-        query_def, xpath_obj->boolval ? "1" : "0", results);
+        query_def, xpath_obj->boolval ? "1" : "0", query_stats, results);
   } else if (xpath_obj->type == XPATH_NUMBER) {
     xmlChar* str = xmlXPathCastNumberToString(xpath_obj->floatval);
     PostProcessAndAppendResult(
-        query_def, reinterpret_cast<const char*>(str), results);
+        query_def, reinterpret_cast<const char*>(str), query_stats, results);
     xmlFree(str);
   } else if (xpath_obj->type == XPATH_STRING) {
     PostProcessAndAppendResult(
         query_def, reinterpret_cast<const char*>(xpath_obj->stringval),
-        results);
+        query_stats, results);
   } else if (xpath_obj->type == XPATH_NODESET) {
     if (xpath_obj->nodesetval != NULL) {
-      for (int i = 0; i < xpath_obj->nodesetval->nodeNr; ++i) {
+      const int num_nodes = NumResultsToKeep(xpath_obj->nodesetval->nodeNr);
+      for (int i = 0; i < num_nodes; ++i) {
         xmlNodePtr node = xpath_obj->nodesetval->nodeTab[i];
         xmlChar* content = xmlNodeGetContent(node);
         if (content != NULL) {
           PostProcessAndAppendResult(query_def,
                                      reinterpret_cast<const char*>(content),
-                                     results);
+                                     query_stats, results);
         }
         xmlFree(content);
       }
@@ -173,20 +219,25 @@ void QueryRunner::RunStandaloneQuery(const QueryDef& query_def,
   } else {
     LOG(FATAL) << "Can't handle xmlXPathObjectType: " << xpath_obj->type;
   }
+  if (query_stats != NULL) {
+    query_stats->set_num_results(results->size());
+  }
 
   VLOG(1) << "Got " << results->size() << " results for query: "
           << query_def.query();
 }
 
-void QueryRunner::RunGroupedQueriesLogError(
-    const QueryGroupDef& query_group_def, const StringPiece& error) const {
-  if (error_handling_mode_ >= EHM_LOG_ERROR) {
-    LOG(ERROR) << "Error in RunGroupedQueries()"
-               << "\nurl: " << url_
-               << "\nerror: " << error
-               << "\nquery_group_def: " << query_group_def.DebugString();
-  }
-  if (error_handling_mode_ == EHM_ABORT_PROCESS) LOG(FATAL);
+int QueryRunner::NumResultsToKeep(int num_nodes) const {
+  if (max_results_ <= 0 || num_nodes <= max_results_) return num_nodes;
+  VLOG(1) << "Keeping " << max_results_ << " of " << num_nodes << " results";
+  xpath_wrapper_.SetResultsTruncated();
+  return max_results_;
+}
+
+void QueryRunner::RunGroupedQueriesError(const QueryGroupDef& query_group_def,
+                                         const StringPiece& error) const {
+  error_handler_.HandleError(ParseError::QUERY_GROUP_MISMATCH,
+                             query_group_def.name(), error, query_group_def);
 }
 
 void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
@@ -196,11 +247,13 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
   DCHECK_GE(num_subqueries, 1);
 
   const string& root_query = query_group_def.root_query();
-  xmlXPathObjectPtr xpath_obj = xpath_wrapper_.EvalExpressionOrDie(root_query);
+  QueryStats* root_query_stats;
+  xmlXPathObjectPtr xpath_obj = EvalExpression(root_query, &root_query_stats);
+  if (xpath_obj == NULL) return;  // out of budget
   const AutoClosureRunner xpath_obj_deleter(
       NewCallback(&xmlXPathFreeObject, xpath_obj));
   if (xpath_obj->type != XPATH_NODESET) {
-    RunGroupedQueriesLogError(query_group_def, "Root query must return nodes");
+    RunGroupedQueriesError(query_group_def, "Root query must return nodes");
     // Effect of error: All subqueries will have no results.
     return;
   } else if (xpath_obj->nodesetval == NULL) {
@@ -208,7 +261,15 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
     return;
   }
 
-  const int num_results_per_subquery = xpath_obj->nodesetval->nodeNr;
+  const int num_results_per_subquery =
+      NumResultsToKeep(xpath_obj->nodesetval->nodeNr);
+  // If true, subquery results under the dropped root nodes are expected to
+  // have no root node index, and are silently dropped.
+  const bool dropped_root_nodes =
+      num_results_per_subquery < xpath_obj->nodesetval->nodeNr;
+  if (root_query_stats != NULL) {
+    root_query_stats->set_num_results(num_results_per_subquery);
+  }
   VLOG(1) << "Got " << num_results_per_subquery << " results for root query: "
           << root_query;
 
@@ -229,14 +290,16 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
     // Initialize all results to ("", false).
     results->assign(num_results_per_subquery, make_pair("", false));
 
+    QueryStats* subquery_stats;
     xmlXPathObjectPtr subquery_xpath_obj =
-        xpath_wrapper_.EvalExpressionOrDie(subquery);
+        EvalExpression(subquery, &subquery_stats);
+    if (subquery_xpath_obj == NULL) return;  // out of budget
     const AutoClosureRunner subquery_xpath_obj_deleter(
         NewCallback(&xmlXPathFreeObject, subquery_xpath_obj));
     if (subquery_xpath_obj->type != XPATH_NODESET) {
       // NOTE(sadovsky): I'm not sure this can actually happen, conditional on
       // subquery being a valid XPath expression.
-      RunGroupedQueriesLogError(
+      RunGroupedQueriesError(
           query_group_def,
           StrCat("Subquery ", subquery, " must return nodes"));
       // Effect of error: Current subquery will have no results.
@@ -247,18 +310,20 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
     }
 
     const int num_subquery_results = subquery_xpath_obj->nodesetval->nodeNr;
+    if (subquery_stats != NULL) {
+      subquery_stats->set_num_results(num_subquery_results);
+    }
     VLOG(1) << "Got " << num_subquery_results << " results for subquery: "
             << subquery;
 
     if (num_subquery_results > num_results_per_subquery &&
-        error_handling_mode_ >= EHM_LOG_ERROR) {
-      // Log a warning, but let the consequences play out below. By the
-      // pigeonhole principle, at least one result has no root node or has the
-      // same root node as some other result, so we'll definitely trigger an
-      // error below.
-      LOG(WARNING) << StrCat("Subquery ", subquery, " has more results than"
-                             " root query (", num_subquery_results, " > ",
-                             num_results_per_subquery, ")");
+        !dropped_root_nodes) {
+      // Let the consequences play out below. By the pigeonhole principle, at
+      // least one result has no root node or has the same root node as some
+      // other result, so we'll definitely report an error below.
+      VLOG(1) << "Subquery " << subquery << " has more results than root query"
+              << " (" << num_subquery_results << " > "
+              << num_results_per_subquery << ")";
     }
 
     // For each subquery result, find the corresponding root node, get its
@@ -275,22 +340,27 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
         curr_node = curr_node->parent;
       }
       if (curr_node == NULL) {
+        if (dropped_root_nodes) continue;
         // This can happen, for example, if root_query is "//span" and subquery
         // is "/parent::*".
-        RunGroupedQueriesLogError(
-            query_group_def,
-            StrCat("Failed to find root node for subquery ", subquery,
-                   " result index ", j));
+        if (error_handler_.enabled()) {
+          RunGroupedQueriesError(
+              query_group_def,
+              StrCat("Failed to find root node for subquery ", subquery,
+                     " result index ", j));
+        }
         // Effect of error: Current subquery result will be missing.
         continue;
       }
       const int root_node_index = it->second;
       if (used_root_node_indices[root_node_index]) {
-        RunGroupedQueriesLogError(
-            query_group_def,
-            StrCat("Result index ", j, " for subquery ", subquery, " has same"
-                   " root node (index ", root_node_index, ") as some other"
-                   " result"));
+        if (error_handler_.enabled()) {
+          RunGroupedQueriesError(
+              query_group_def,
+              StrCat("Result index ", j, " for subquery ", subquery, " has same"
+                     " root node (index ", root_node_index, ") as some other"
+                     " result"));
+        }
         // Effect of error: Current result index will retain old value.
         continue;
       }
@@ -303,7 +373,7 @@ void QueryRunner::RunGroupedQueries(const QueryGroupDef& query_group_def,
         const bool ok =
             PostProcessResult(query_group_def.query_defs(i),
                               reinterpret_cast<const char*>(content),
-                              &processed_result);
+                              subquery_stats, &processed_result);
         if (ok) {
           result->first.swap(processed_result);
           result->second = true;
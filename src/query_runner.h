@@ -20,29 +20,55 @@
 #include <utility>
 #include <vector>
 
+#include <libxml/xpath.h>  // for xmlXPathObjectPtr
+
 #include "base/macros.h"
 #include "base/scoped_ptr.h"
-#include "xpaf_parser.h"  // for ErrorHandlingMode
+#include "base/stl_decl.h"
 
 namespace xpaf {
 
+class ParserStats;
+class PostProcessingOp;
 class QueryDef;
 class QueryGroupDef;
+class QueryStats;
 class StringPiece;
 class URL;
 class XPathWrapper;
 
 namespace internal {
 
+class ParseErrorHandler;
+
 typedef vector<pair<string, bool> > QueryResults;
 
+// Converts 'url' into an absolute url with 'base_url' as its base.
+// Return value indicates whether conversion succeeded. If this returns false,
+// *absolute_url should not be used.
+bool AbsolutizeUrl(const string& url,
+                   const URL& base_url,
+                   string* absolute_url);
+
+// Applies 'op' to *result in place. Returns false if the op fails (e.g. an
+// ExtractOp that doesn't match), in which case *result should not be used.
+// 'scratch' is working space, reused across calls to avoid reallocating.
+bool ApplyPostProcessingOp(const PostProcessingOp& op,
+                           string* result,
+                           string* scratch);
+
 class QueryRunner {
  public:
   // Note: 'url' and 'xpath_wrapper' must persist for the lifetime of this
-  // object.
+  // object. If 'stats' is non-NULL, a QueryStats is added to it for each XPath
+  // evaluation. If 'max_results' is positive, each evaluation keeps at most
+  // that many results; see ParseOptions.max_results_per_query. Errors are
+  // passed to 'error_handler', which must also outlive this object.
   QueryRunner(const StringPiece& url,
               const XPathWrapper& xpath_wrapper,
-              ErrorHandlingMode error_handling_mode);
+              const ParseErrorHandler& error_handler,
+              int max_results,
+              ParserStats* stats);
 
   ~QueryRunner();
 
@@ -54,23 +80,39 @@ class QueryRunner {
 
  private:
   // Takes const char* rather than const string& to avoid an extra conversion.
+  // 'query_stats' may be NULL.
   bool PostProcessResult(const QueryDef& query_def,
                          const char* orig_result,
+                         QueryStats* query_stats,
                          string* processed_result) const;
 
   // Used by RunStandaloneQuery() but not RunGroupedQueries().
   void PostProcessAndAppendResult(const QueryDef& query_def,
                                   const char* result_str,
+                                  QueryStats* query_stats,
                                   QueryResults* results) const;
 
-  void RunGroupedQueriesLogError(const QueryGroupDef& query_group_def,
-                                 const StringPiece& error) const;
+  // Evaluates 'expr', or returns NULL if the document's parse budget is
+  // exhausted (see XPathWrapper::EvalExpression()). If stats_ is non-NULL,
+  // also adds a QueryStats for this evaluation to stats_ and sets *query_stats
+  // to it; otherwise sets *query_stats to NULL.
+  xmlXPathObjectPtr EvalExpression(const string& expr,
+                                   QueryStats** query_stats) const;
+
+  void RunGroupedQueriesError(const QueryGroupDef& query_group_def,
+                              const StringPiece& error) const;
+
+  // Returns the number of results to keep from a node set with 'num_nodes'
+  // nodes, and marks the document truncated if that's fewer than 'num_nodes'.
+  int NumResultsToKeep(int num_nodes) const;
 
   const StringPiece& url_;
   const scoped_ptr<const URL> url_obj_;
 
   const XPathWrapper& xpath_wrapper_;
-  const ErrorHandlingMode error_handling_mode_;
+  const ParseErrorHandler& error_handler_;
+  const int max_results_;
+  ParserStats* const stats_;
 
   DISALLOW_COPY_AND_ASSIGN(QueryRunner);
 };
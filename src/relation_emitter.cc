@@ -0,0 +1,236 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "relation_emitter.h"
+
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "base/strutil.h"
+#include "error_reporter.h"
+#include "parsed_document.pb.h"
+#include "relation_sink.h"
+#include "xpaf_parser_def.pb.h"
+
+namespace xpaf {
+namespace internal {
+
+namespace {
+
+// Location of errors in relation template 'index', for ParseError.location.
+string RelationTemplateLocation(int index) {
+  return StrCat("relation_tmpls[", index, "]");
+}
+
+void MaybeReportCardinalityOneError(const ParseErrorHandler& error_handler,
+                                    const RelationTemplate& rel_tmpl,
+                                    int rel_tmpl_index,
+                                    const StringPiece& name,
+                                    int results_size) {
+  if (results_size > 1 && error_handler.enabled()) {
+    error_handler.HandleError(
+        ParseError::CARDINALITY_ONE_VIOLATED,
+        RelationTemplateLocation(rel_tmpl_index),
+        StrCat("Too many results for ", name, " (", results_size, ")"),
+        rel_tmpl);
+  }
+}
+
+void ReportCardinalityManyError(const ParseErrorHandler& error_handler,
+                                const RelationTemplate& rel_tmpl,
+                                int rel_tmpl_index,
+                                const StringPiece& name,
+                                int results_size,
+                                int num_relations) {
+  if (error_handler.enabled()) {
+    error_handler.HandleError(
+        ParseError::CARDINALITY_MANY_MISMATCH,
+        RelationTemplateLocation(rel_tmpl_index),
+        StrCat(name, " has cardinality MANY and ", results_size,
+               " results, but something else has cardinality MANY and ",
+               num_relations, " results"),
+        rel_tmpl);
+  }
+}
+
+// Returns the name of annotation template 'annotation_tmpl' for error
+// messages.
+string AnnotationPseudonym(
+    const RelationTemplate::AnnotationTemplate& annotation_tmpl) {
+  return StrCat("annotation \"", annotation_tmpl.name(), "\"");
+}
+
+// Determines the number of relations to emit for the given RelationTemplate
+// given the result counts and cardinalities of subject, object, and annotation
+// values.
+//
+// The number of relations to emit is equal to the number of results in the
+// first cardinality-MANY query in {subject, object, annot_1, annot_2, ...},
+// with the following exceptions:
+//  * If either subject or object has cardinality ONE and num results != 1, no
+//    relations are emitted.
+//  * If subject and object both have cardinality MANY but have different
+//    numbers of results, no relations are emitted.
+//
+// Also, any annotation with cardinality ONE and num results != 1, or with
+// cardinality MANY and num results != num_relations (as determined above), will
+// be skipped (i.e. will not be emitted).
+//
+int ComputeNumRelations(
+    const ParseErrorHandler& error_handler,
+    const RelationTemplate& rel_tmpl,
+    int rel_tmpl_index,
+    const QueryResults& subject_results,
+    const QueryResults& object_results,
+    const vector<const QueryResults*>& annotation_results_vec,
+    vector<bool>* skip_annotation_vec) {
+  int num_relations = -1;
+  bool skip_relation = false;
+
+  if (rel_tmpl.subject_cardinality() == RelationTemplate::ONE) {
+    if (subject_results.size() != 1) {
+      MaybeReportCardinalityOneError(error_handler, rel_tmpl, rel_tmpl_index,
+                                     "subject", subject_results.size());
+      skip_relation = true;
+    }
+  } else {
+    num_relations = subject_results.size();
+  }
+
+  if (rel_tmpl.object_cardinality() == RelationTemplate::ONE) {
+    if (object_results.size() != 1) {
+      MaybeReportCardinalityOneError(error_handler, rel_tmpl, rel_tmpl_index,
+                                     "object", object_results.size());
+      skip_relation = true;
+    }
+  } else {
+    if (num_relations == -1) {
+      num_relations = object_results.size();
+    } else if (num_relations != object_results.size()) {
+      ReportCardinalityManyError(error_handler, rel_tmpl, rel_tmpl_index,
+                                 "object", object_results.size(),
+                                 num_relations);
+      skip_relation = true;
+    }
+  }
+
+  for (int i = 0; i < annotation_results_vec.size(); ++i) {
+    const RelationTemplate::AnnotationTemplate& annotation_tmpl =
+        rel_tmpl.annotation_tmpls(i);
+    const int results_size = annotation_results_vec[i]->size();
+    bool skip_annotation = false;
+
+    if (annotation_tmpl.value_cardinality() == RelationTemplate::ONE) {
+      if (results_size != 1) {
+        MaybeReportCardinalityOneError(
+            error_handler, rel_tmpl, rel_tmpl_index,
+            AnnotationPseudonym(annotation_tmpl), results_size);
+        skip_annotation = true;
+      }
+    } else {
+      if (num_relations == -1) {
+        num_relations = results_size;
+      } else if (num_relations != results_size) {
+        ReportCardinalityManyError(
+            error_handler, rel_tmpl, rel_tmpl_index,
+            AnnotationPseudonym(annotation_tmpl), results_size, num_relations);
+        skip_annotation = true;
+      }
+    }
+    skip_annotation_vec->push_back(skip_annotation);
+  }
+
+  if (skip_relation) {
+    return 0;
+  } else if (num_relations == -1) {
+    num_relations = 1;
+  }
+  return num_relations;
+}
+
+}  // namespace
+
+int EmitRelations(const ParseErrorHandler& error_handler,
+                  const RelationTemplate& rel_tmpl,
+                  int rel_tmpl_index,
+                  const QueryResults& subject_results,
+                  const QueryResults& object_results,
+                  const vector<const QueryResults*>& annotation_results_vec,
+                  RelationSink* sink,
+                  int64* output_bytes) {
+  vector<bool> skip_annotation_vec;
+  const int num_relations =
+      ComputeNumRelations(error_handler, rel_tmpl, rel_tmpl_index,
+                          subject_results, object_results,
+                          annotation_results_vec, &skip_annotation_vec);
+
+  // Reused across relations to avoid reallocating.
+  vector<RelationView::Annotation> annotations;
+  RelationView relation;
+  relation.annotations = &annotations;
+
+  int num_output_relations = 0;
+  for (int j = 0; j < num_relations; ++j) {
+    const int subject_idx =
+        rel_tmpl.subject_cardinality() == RelationTemplate::MANY ? j : 0;
+    const int object_idx =
+        rel_tmpl.object_cardinality() == RelationTemplate::MANY ? j : 0;
+    if (!subject_results[subject_idx].second ||
+        !object_results[object_idx].second) {
+      continue;
+    }
+
+    const string& subject = subject_results[subject_idx].first;
+    const string& object = object_results[object_idx].first;
+    relation.subject = subject;
+    relation.predicate = rel_tmpl.predicate();
+    relation.object = object;
+    relation.has_userdata = rel_tmpl.has_userdata();
+    relation.userdata = rel_tmpl.userdata();
+
+    VLOG(1) << "Relation[" << error_handler.parser_name() << "]: '" << subject
+            << "', '" << rel_tmpl.predicate() << "', '" << object << "'";
+
+    annotations.clear();
+    for (int k = 0; k < annotation_results_vec.size(); ++k) {
+      if (skip_annotation_vec[k]) {
+        // This annotation has the wrong number of results, so we skip it.
+        // See ComputeNumRelations() implementation for more information.
+        continue;
+      }
+      const int annotation_idx =
+          rel_tmpl.annotation_tmpls(k).value_cardinality() ==
+          RelationTemplate::MANY ? j : 0;
+      const QueryResults& annotation_results = *annotation_results_vec[k];
+      if (!annotation_results[annotation_idx].second) {
+        continue;
+      }
+
+      annotations.resize(annotations.size() + 1);
+      annotations.back().name = rel_tmpl.annotation_tmpls(k).name();
+      annotations.back().value = annotation_results[annotation_idx].first;
+    }
+
+    sink->AddRelation(relation);
+    ++num_output_relations;
+    if (output_bytes != NULL) *output_bytes += RelationViewBytes(relation);
+  }
+  return num_output_relations;
+}
+
+}  // namespace internal
+}  // namespace xpaf
@@ -0,0 +1,59 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Turns the query results for a RelationTemplate into relations. Split out
+// of XpafParser::Parse() so that relation emission can be benchmarked on its
+// own.
+
+#ifndef XPAF_RELATION_EMITTER_H_
+#define XPAF_RELATION_EMITTER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class RelationSink;
+class RelationTemplate;
+
+namespace internal {
+
+class ParseErrorHandler;
+
+typedef vector<pair<string, bool> > QueryResults;
+
+// Passes to 'sink' the relations described by 'rel_tmpl', which is relation
+// template 'rel_tmpl_index' of its parser def, given the results of its
+// subject, object, and annotation value queries. Results marked false (i.e.
+// voided by post-processing) produce no relation or annotation. Cardinality
+// errors go to 'error_handler'. Returns the number of relations passed to
+// 'sink'. If 'output_bytes' is non-NULL, adds RelationViewBytes() of each
+// relation to it.
+int EmitRelations(const ParseErrorHandler& error_handler,
+                  const RelationTemplate& rel_tmpl,
+                  int rel_tmpl_index,
+                  const QueryResults& subject_results,
+                  const QueryResults& object_results,
+                  const vector<const QueryResults*>& annotation_results_vec,
+                  RelationSink* sink,
+                  int64* output_bytes);
+
+}  // namespace internal
+}  // namespace xpaf
+
+#endif  // XPAF_RELATION_EMITTER_H_
@@ -0,0 +1,169 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "relation_sink.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+#include "string_interner.h"
+
+namespace xpaf {
+
+int64 RelationViewBytes(const RelationView& relation) {
+  int64 bytes = relation.subject.size() + relation.predicate.size() +
+      relation.object.size() + relation.userdata.size();
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+  for (int i = 0; i < annotations.size(); ++i) {
+    bytes += annotations[i].name.size() + annotations[i].value.size();
+  }
+  return bytes;
+}
+
+void RelationViewToProto(const RelationView& relation, Relation* rel) {
+  // TODO(sadovsky): Consider not setting these fields if string is empty.
+  rel->set_subject(relation.subject.data(), relation.subject.size());
+  rel->set_predicate(relation.predicate.data(), relation.predicate.size());
+  rel->set_object(relation.object.data(), relation.object.size());
+  if (relation.has_userdata) {
+    rel->set_userdata(relation.userdata.data(), relation.userdata.size());
+  }
+  const vector<RelationView::Annotation>& annotations = *relation.annotations;
+  for (int i = 0; i < annotations.size(); ++i) {
+    Relation::Annotation* annotation = rel->add_annotations();
+    annotation->set_name(annotations[i].name.data(),
+                         annotations[i].name.size());
+    annotation->set_value(annotations[i].value.data(),
+                          annotations[i].value.size());
+  }
+}
+
+namespace {
+
+// Returns the string with index 'id' in 'strings' if 'has_id' is true,
+// otherwise 'str'.
+StringPiece InternedOrString(
+    const google::protobuf::RepeatedPtrField<string>& strings,
+    bool has_id, int32 id, const string& str) {
+  if (!has_id) return str;
+  CHECK_GE(id, 0);
+  CHECK_LT(id, strings.size());
+  return strings.Get(id);
+}
+
+}  // namespace
+
+void AddParserOutputRelations(const ParsedDocument& parsed_document,
+                              const ParserOutput& output,
+                              RelationSink* sink) {
+  const google::protobuf::RepeatedPtrField<string>& strings =
+      parsed_document.interned_strings();
+  vector<RelationView::Annotation> annotations;
+  RelationView view;
+  view.annotations = &annotations;
+  for (int i = 0; i < output.relations_size(); ++i) {
+    const Relation& rel = output.relations(i);
+    view.subject = InternedOrString(strings, rel.has_subject_id(),
+                                    rel.subject_id(), rel.subject());
+    view.predicate = InternedOrString(strings, rel.has_predicate_id(),
+                                      rel.predicate_id(), rel.predicate());
+    view.object = InternedOrString(strings, rel.has_object_id(),
+                                   rel.object_id(), rel.object());
+    view.has_userdata = rel.has_userdata() || rel.has_userdata_id();
+    view.userdata = InternedOrString(strings, rel.has_userdata_id(),
+                                     rel.userdata_id(), rel.userdata());
+    annotations.resize(rel.annotations_size());
+    for (int j = 0; j < rel.annotations_size(); ++j) {
+      const Relation::Annotation& annotation = rel.annotations(j);
+      annotations[j].name = InternedOrString(
+          strings, annotation.has_name_id(), annotation.name_id(),
+          annotation.name());
+      annotations[j].value = InternedOrString(
+          strings, annotation.has_value_id(), annotation.value_id(),
+          annotation.value());
+    }
+    sink->AddRelation(view);
+  }
+}
+
+ParsedDocumentSink::ParsedDocumentSink(ParsedDocument* parsed_document,
+                                       bool intern_strings)
+    : parsed_document_(parsed_document),
+      interner_(intern_strings ? new StringInterner() : NULL),
+      output_(NULL) {
+}
+
+ParsedDocumentSink::~ParsedDocumentSink() {
+}
+
+void ParsedDocumentSink::BeginDocument(const StringPiece& url) {
+  parsed_document_->Clear();
+  parsed_document_->set_url(url.data(), url.size());
+}
+
+void ParsedDocumentSink::BeginParser(const StringPiece& parser_name) {
+  DCHECK(output_ == NULL);
+  output_ = parsed_document_->add_parser_outputs();
+  output_->set_parser_name(parser_name.data(), parser_name.size());
+}
+
+void ParsedDocumentSink::AddRelation(const RelationView& relation) {
+  DCHECK(output_ != NULL);
+  Relation* rel = output_->add_relations();
+  if (interner_ != NULL) {
+    const vector<RelationView::Annotation>& annotations =
+        *relation.annotations;
+    rel->set_subject_id(interner_->Intern(relation.subject));
+    rel->set_predicate_id(interner_->Intern(relation.predicate));
+    rel->set_object_id(interner_->Intern(relation.object));
+    if (relation.has_userdata) {
+      rel->set_userdata_id(interner_->Intern(relation.userdata));
+    }
+    for (int i = 0; i < annotations.size(); ++i) {
+      Relation::Annotation* annotation = rel->add_annotations();
+      annotation->set_name_id(interner_->Intern(annotations[i].name));
+      annotation->set_value_id(interner_->Intern(annotations[i].value));
+    }
+  } else {
+    RelationViewToProto(relation, rel);
+  }
+}
+
+void ParsedDocumentSink::EndParser() {
+  DCHECK(output_ != NULL);
+  // If the ParserOutput is empty, remove it.
+  if (output_->relations_size() == 0) {
+    parsed_document_->mutable_parser_outputs()->RemoveLast();
+  }
+  output_ = NULL;
+}
+
+void ParsedDocumentSink::AddError(const ParseError& error) {
+  parsed_document_->add_errors()->CopyFrom(error);
+}
+
+void ParsedDocumentSink::SetTruncated() {
+  parsed_document_->set_truncated(true);
+}
+
+void ParsedDocumentSink::EndDocument() {
+  if (interner_ != NULL) {
+    interner_->Release(parsed_document_->mutable_interned_strings());
+  }
+}
+
+}  // namespace xpaf
@@ -0,0 +1,139 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Defines the RelationSink interface, through which XpafParser and
+// XpafParserMaster stream relations to their callers, and ParsedDocumentSink,
+// the RelationSink that builds ParsedDocument protos.
+
+#ifndef XPAF_RELATION_SINK_H_
+#define XPAF_RELATION_SINK_H_
+
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+
+namespace xpaf {
+
+class ParseError;
+class ParsedDocument;
+class ParserOutput;
+class Relation;
+class StringInterner;
+
+// A single relation, as seen by a RelationSink. All StringPieces point to
+// memory owned by the caller and are only valid for the duration of the
+// RelationSink::AddRelation() call.
+struct RelationView {
+  struct Annotation {
+    StringPiece name;
+    StringPiece value;
+  };
+
+  StringPiece subject;
+  StringPiece predicate;
+  StringPiece object;
+
+  // Empty unless has_userdata is true. See RelationTemplate.userdata.
+  bool has_userdata;
+  StringPiece userdata;
+
+  // Not owned. Never NULL, but may be empty.
+  const vector<Annotation>* annotations;
+
+  RelationView() : has_userdata(false), annotations(NULL) {}
+};
+
+// Receives the output of XpafParser::Parse() and
+// XpafParserMaster::ParseDocument() as it's produced.
+//
+// For each document, XpafParserMaster::ParseDocument() calls BeginDocument(),
+// then BeginParser(), AddRelation() zero or more times, and EndParser() for
+// each relevant parser, and finally EndDocument(). If the document's parse
+// budget ran out (see ParseOptions.time_budget_nanos), SetTruncated() is called
+// just before EndDocument(). XpafParser::Parse() makes only the BeginParser(),
+// AddRelation(), and EndParser() calls, plus, if ParseOptions.output_errors is
+// true, an AddError() call between BeginParser() and EndParser() for each
+// error it finds.
+//
+// Implementations need not be thread-safe; use one sink per thread.
+class RelationSink {
+ public:
+  RelationSink() {}
+  virtual ~RelationSink() {}
+
+  virtual void BeginDocument(const StringPiece& url) {}
+  virtual void BeginParser(const StringPiece& parser_name) = 0;
+  virtual void AddRelation(const RelationView& relation) = 0;
+  virtual void EndParser() = 0;
+  virtual void AddError(const ParseError& error) {}
+  virtual void SetTruncated() {}
+  virtual void EndDocument() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RelationSink);
+};
+
+// Returns the total size of the strings in 'relation', including annotation
+// names and values.
+int64 RelationViewBytes(const RelationView& relation);
+
+// Populates 'rel' with the (non-interned) contents of 'relation'.
+void RelationViewToProto(const RelationView& relation, Relation* rel);
+
+// Calls sink->AddRelation() for each relation in 'output', which must be one
+// of parsed_document.parser_outputs. Interned strings are looked up in
+// parsed_document.interned_strings.
+void AddParserOutputRelations(const ParsedDocument& parsed_document,
+                              const ParserOutput& output,
+                              RelationSink* sink);
+
+// Populates a ParsedDocument. Each parser with at least one relation gets a
+// ParserOutput; parsers with no relations are omitted. BeginDocument() clears
+// the ParsedDocument, so interned string ids always index this document's own
+// interned_strings.
+class ParsedDocumentSink : public RelationSink {
+ public:
+  // Does not take ownership of 'parsed_document', which must outlive this sink.
+  // If 'intern_strings' is true, relation strings are interned as described
+  // for ParseOptions.intern_strings.
+  ParsedDocumentSink(ParsedDocument* parsed_document, bool intern_strings);
+  virtual ~ParsedDocumentSink();
+
+  virtual void BeginDocument(const StringPiece& url);
+  virtual void BeginParser(const StringPiece& parser_name);
+  virtual void AddRelation(const RelationView& relation);
+  virtual void EndParser();
+  virtual void AddError(const ParseError& error);
+  virtual void SetTruncated();
+  virtual void EndDocument();
+
+ private:
+  ParsedDocument* const parsed_document_;
+
+  // NULL unless we're interning strings.
+  scoped_ptr<StringInterner> interner_;
+
+  // The output for the current parser, or NULL if we're between parsers.
+  ParserOutput* output_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParsedDocumentSink);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_RELATION_SINK_H_
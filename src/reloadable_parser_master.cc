@@ -0,0 +1,117 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reloadable_parser_master.h"
+
+#include <sched.h>
+
+#include "base/atomicops.h"
+#include "base/logging.h"
+#include "base/mutex.h"
+#include "xpaf_parser_master.h"
+
+namespace xpaf {
+
+ReloadableParserMaster::ReloadableParserMaster(XpafParserMaster* master)
+    : master_(master), epoch_(0), generation_(0), reload_mu_(new Mutex) {
+  CHECK(master != NULL);
+  readers_[0] = 0;
+  readers_[1] = 0;
+}
+
+ReloadableParserMaster::~ReloadableParserMaster() {
+  CHECK_EQ(readers_[0] + readers_[1], 0) << "In-flight calls at destruction";
+  delete master_;
+}
+
+void ReloadableParserMaster::Reload(XpafParserMaster* master) {
+  CHECK(master != NULL);
+  MutexLock l(reload_mu_.get());
+  ReloadLocked(master);
+}
+
+void ReloadableParserMaster::AddParser(const XpafParserDef& parser_def,
+                                       const ParseOptions& parse_options) {
+  MutexLock l(reload_mu_.get());
+  ReloadLocked(master_->CopyWithAddedParser(parser_def, parse_options));
+}
+
+void ReloadableParserMaster::ReplaceParser(const XpafParserDef& parser_def,
+                                           const ParseOptions& parse_options) {
+  MutexLock l(reload_mu_.get());
+  ReloadLocked(master_->CopyWithReplacedParser(parser_def, parse_options));
+}
+
+void ReloadableParserMaster::RemoveParser(const string& parser_name) {
+  MutexLock l(reload_mu_.get());
+  ReloadLocked(master_->CopyWithRemovedParser(parser_name));
+}
+
+void ReloadableParserMaster::ReloadLocked(XpafParserMaster* master) {
+  XpafParserMaster* const old_master = master_;
+  Release_Store(&master_, master);
+  MemoryBarrier();
+
+  // A reader registers in a counter and then loads master_. Once both
+  // counters have drained after the store above, any reader that could have
+  // loaded old_master has finished: a reader that registers after we observe
+  // its counter at zero must also load master_ after the store. Two flips are
+  // needed because a reader may read epoch_ long before it registers.
+  for (int phase = 0; phase < 2; ++phase) {
+    const int32 old_slot = epoch_ & 1;
+    Release_Store(&epoch_, epoch_ + 1);
+    MemoryBarrier();
+    while (Acquire_Load(&readers_[old_slot]) != 0) {
+      sched_yield();
+    }
+  }
+
+  delete old_master;
+  Release_Store(&generation_, generation_ + 1);
+}
+
+int64 ReloadableParserMaster::generation() const {
+  return Acquire_Load(&generation_);
+}
+
+ReloadableParserMaster::Snapshot::Snapshot(
+    const ReloadableParserMaster* handle)
+    : handle_(handle) {
+  slot_ = Acquire_Load(&handle_->epoch_) & 1;
+  Barrier_AtomicIncrement(&handle_->readers_[slot_], 1);
+  master_ = Acquire_Load(&handle_->master_);
+}
+
+ReloadableParserMaster::Snapshot::~Snapshot() {
+  Barrier_AtomicIncrement(&handle_->readers_[slot_], -1);
+}
+
+bool ReloadableParserMaster::ShouldParse(const StringPiece& url) const {
+  const Snapshot snapshot(this);
+  return snapshot.master().ShouldParse(url);
+}
+
+void ReloadableParserMaster::ParseDocument(
+    const Document& doc, ParsedDocument* parsed_document) const {
+  const Snapshot snapshot(this);
+  snapshot.master().ParseDocument(doc, parsed_document);
+}
+
+void ReloadableParserMaster::ParseDocument(const Document& doc,
+                                           RelationSink* sink) const {
+  const Snapshot snapshot(this);
+  snapshot.master().ParseDocument(doc, sink);
+}
+
+}  // namespace xpaf
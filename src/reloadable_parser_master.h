@@ -0,0 +1,129 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A handle to an XpafParserMaster that can be replaced while other threads are
+// parsing with it.
+//
+// Readers never block: each parse call registers itself in one of two reader
+// counters, loads the current master, and deregisters when done. Reload()
+// publishes the new master and then waits (RCU-style, flipping between the two
+// counters) until every reader that might have seen the old master has
+// finished, before deleting it. In-flight calls thus finish with the master
+// they started with, and new calls pick up the new one.
+//
+// Example:
+//   ReloadableParserMaster handle(new XpafParserMaster(parser_defs, opt));
+//   ...
+//   // Any thread:
+//   handle.ParseDocument(doc, &parsed_document);
+//   ...
+//   // Deploy thread:
+//   handle.Reload(new XpafParserMaster(new_parser_defs, opt));
+
+#ifndef XPAF_RELOADABLE_PARSER_MASTER_H_
+#define XPAF_RELOADABLE_PARSER_MASTER_H_
+
+#include <string>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class Document;
+class Mutex;
+class ParseOptions;
+class ParsedDocument;
+class RelationSink;
+class StringPiece;
+class XpafParserDef;
+class XpafParserMaster;
+
+// Thread-safe.
+class ReloadableParserMaster {
+ public:
+  // Takes ownership of 'master'.
+  explicit ReloadableParserMaster(XpafParserMaster* master);
+
+  // There must be no in-flight calls.
+  ~ReloadableParserMaster();
+
+  // Replaces the current master with 'master', taking ownership of it. Blocks
+  // until all calls using the previous master have returned, then deletes it.
+  // Concurrent Reload() calls are serialized.
+  void Reload(XpafParserMaster* master);
+
+  // Like Reload(), with the result of calling the corresponding
+  // XpafParserMaster::CopyWith*Parser() method on the current master. Only the
+  // affected parser is initialized; all others are shared with the previous
+  // master.
+  void AddParser(const XpafParserDef& parser_def,
+                 const ParseOptions& parse_options);
+  void ReplaceParser(const XpafParserDef& parser_def,
+                     const ParseOptions& parse_options);
+  void RemoveParser(const string& parser_name);
+
+  // Returns the number of completed reloads.
+  int64 generation() const;
+
+  // These forward to the current master.
+  bool ShouldParse(const StringPiece& url) const;
+  void ParseDocument(const Document& doc,
+                     ParsedDocument* parsed_document) const;
+  void ParseDocument(const Document& doc, RelationSink* sink) const;
+
+  // Pins the current master for the lifetime of this object, e.g. to make
+  // several calls against the same parser set. Holding a Snapshot blocks
+  // Reload(), so keep it short-lived.
+  class Snapshot {
+   public:
+    explicit Snapshot(const ReloadableParserMaster* handle);
+    ~Snapshot();
+
+    const XpafParserMaster& master() const { return *master_; }
+
+   private:
+    const ReloadableParserMaster* const handle_;
+    int slot_;
+    const XpafParserMaster* master_;
+
+    DISALLOW_COPY_AND_ASSIGN(Snapshot);
+  };
+
+ private:
+  // Publishes 'master' and deletes the previous master once it's unused.
+  // Requires reload_mu_.
+  void ReloadLocked(XpafParserMaster* master);
+
+  // Current master. Written only with reload_mu_ held, so holding reload_mu_
+  // also keeps it alive.
+  XpafParserMaster* volatile master_;
+
+  // Readers register in readers_[epoch_ & 1]. Reload() flips epoch_ twice,
+  // each time waiting for the previously current counter to drain.
+  volatile int32 epoch_;
+  mutable volatile int32 readers_[2];
+
+  volatile int64 generation_;
+
+  const scoped_ptr<Mutex> reload_mu_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReloadableParserMaster);
+};
+
+}  // namespace xpaf
+
+#endif  // XPAF_RELOADABLE_PARSER_MASTER_H_
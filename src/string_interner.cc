@@ -0,0 +1,120 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "string_interner.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stl_decl.h"
+#include "base/stl_util.h"
+#include "base/stringpiece.h"
+#include "parsed_document.pb.h"
+
+namespace xpaf {
+
+StringInterner::StringInterner() {
+}
+
+StringInterner::~StringInterner() {
+  STLDeleteElements(&strings_);
+}
+
+int StringInterner::Intern(const StringPiece& str) {
+  IdMap::const_iterator it = ids_.find(str);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const int id = strings_.size();
+  string* copy = new string(str.data(), str.size());
+  strings_.push_back(copy);
+  ids_.insert(make_pair(StringPiece(*copy), id));
+  return id;
+}
+
+const string& StringInterner::Lookup(int id) const {
+  DCHECK_GE(id, 0);
+  DCHECK_LT(id, strings_.size());
+  return *strings_[id];
+}
+
+void StringInterner::Clear() {
+  ids_.clear();
+  STLDeleteElements(&strings_);
+}
+
+void StringInterner::Release(
+    google::protobuf::RepeatedPtrField<string>* output) {
+  ids_.clear();
+  output->Reserve(output->size() + strings_.size());
+  for (int i = 0; i < strings_.size(); ++i) {
+    output->AddAllocated(strings_[i]);
+  }
+  strings_.clear();
+}
+
+namespace {
+
+const char* kInvalidInternedId = "Invalid interned string id: ";
+
+const string& LookupInterned(const ParsedDocument& parsed_document, int id) {
+  CHECK(id >= 0 && id < parsed_document.interned_strings_size())
+      << kInvalidInternedId << id;
+  return parsed_document.interned_strings(id);
+}
+
+}  // namespace
+
+void ExpandInternedStrings(ParsedDocument* parsed_document) {
+  if (parsed_document->interned_strings_size() == 0) return;
+  const ParsedDocument& doc = *parsed_document;
+  for (int i = 0; i < parsed_document->parser_outputs_size(); ++i) {
+    ParserOutput* output = parsed_document->mutable_parser_outputs(i);
+    for (int j = 0; j < output->relations_size(); ++j) {
+      Relation* rel = output->mutable_relations(j);
+      if (rel->has_subject_id()) {
+        rel->set_subject(LookupInterned(doc, rel->subject_id()));
+        rel->clear_subject_id();
+      }
+      if (rel->has_predicate_id()) {
+        rel->set_predicate(LookupInterned(doc, rel->predicate_id()));
+        rel->clear_predicate_id();
+      }
+      if (rel->has_object_id()) {
+        rel->set_object(LookupInterned(doc, rel->object_id()));
+        rel->clear_object_id();
+      }
+      if (rel->has_userdata_id()) {
+        rel->set_userdata(LookupInterned(doc, rel->userdata_id()));
+        rel->clear_userdata_id();
+      }
+      for (int k = 0; k < rel->annotations_size(); ++k) {
+        Relation::Annotation* annotation = rel->mutable_annotations(k);
+        if (annotation->has_name_id()) {
+          annotation->set_name(LookupInterned(doc, annotation->name_id()));
+          annotation->clear_name_id();
+        }
+        if (annotation->has_value_id()) {
+          annotation->set_value(LookupInterned(doc, annotation->value_id()));
+          annotation->clear_value_id();
+        }
+      }
+    }
+  }
+  parsed_document->clear_interned_strings();
+}
+
+}  // namespace xpaf
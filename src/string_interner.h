@@ -0,0 +1,78 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-document string interning, used when ParseOptions.intern_strings is set.
+// Each distinct subject, predicate, object, userdata, and annotation string is
+// stored once in ParsedDocument.interned_strings, and relations refer to these
+// strings by index.
+
+#ifndef XPAF_STRING_INTERNER_H_
+#define XPAF_STRING_INTERNER_H_
+
+#include <string>
+#include <vector>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "base/hash.h"
+#include "base/macros.h"
+#include "base/stl_decl.h"
+#include "base/stringpiece.h"
+
+namespace xpaf {
+
+class ParsedDocument;
+
+// Maps strings to dense ids, starting from zero. Not thread-safe.
+class StringInterner {
+ public:
+  StringInterner();
+  ~StringInterner();
+
+  // Returns the id for 'str', storing a copy of 'str' if we haven't seen it
+  // before.
+  int Intern(const StringPiece& str);
+
+  // Returns the string with the given id.
+  const string& Lookup(int id) const;
+
+  // Returns the number of distinct strings interned so far.
+  int size() const { return strings_.size(); }
+
+  // Forgets all interned strings. Ids start again from zero.
+  void Clear();
+
+  // Appends all interned strings to 'output' in id order, transferring
+  // ownership of the underlying strings, and resets this interner.
+  void Release(google::protobuf::RepeatedPtrField<string>* output);
+
+ private:
+  typedef unordered_map<StringPiece, int, StringPieceHash> IdMap;
+
+  // Owned. Keys in ids_ point into these strings.
+  vector<string*> strings_;
+  IdMap ids_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringInterner);
+};
+
+// Rewrites an interned ParsedDocument (i.e. one with interned_strings) into the
+// equivalent non-interned form: sets each relation's string fields from the
+// corresponding *_id fields, clears the *_id fields, and clears
+// interned_strings. Does nothing to ParsedDocuments that aren't interned.
+void ExpandInternedStrings(ParsedDocument* parsed_document);
+
+}  // namespace xpaf
+
+#endif  // XPAF_STRING_INTERNER_H_
@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -19,13 +22,31 @@
 #include <gtest/gtest.h>
 #include <re2/re2.h>
 
+#include "base/atomicops.h"
+#include "base/callback.h"
 #include "base/commandlineflags.h"
 #include "base/file.h"
 #include "base/logging.h"
 #include "base/scoped_ptr.h"
+#include "base/stl_util.h"
+#include "base/stringpiece.h"
 #include "base/strutil.h"
+#include "base/thread_pool.h"
+#include "columnar_batch.h"
+#include "delta_sink.h"
 #include "document.h"
+#include "error_reporter.h"
+#include "metrics.h"
+#include "metrics.pb.h"
+#include "parse_result_cache.h"
+#include "parse_stats.pb.h"
 #include "parsed_document.pb.h"
+#include "parsed_document_encoder.h"
+#include "parser_snapshot.h"
+#include "relation_sink.h"
+#include "reloadable_parser_master.h"
+#include "string_interner.h"
+#include "testing/synthetic_corpus.h"
 #include "util.h"
 #include "xpaf_parser.h"
 #include "xpaf_parser_def.pb.h"
@@ -77,6 +98,17 @@ TEST(ErrorHandlingMode, ValueOrder) {
   EXPECT_GT(EHM_LOG_ERROR, EHM_IGNORE);
 }
 
+// Sorts parser outputs within 'parsed_document', since XpafParserMaster
+// shuffles them.
+void SortParserOutputs(ParsedDocument* parsed_document) {
+  // NOTE(sadovsky): It would be simpler to use pointer_begin() and
+  // pointer_end(), but these aren't available in libprotobuf-dev 2.2.0.
+  sort(parsed_document->mutable_parser_outputs()->mutable_data(),
+       parsed_document->mutable_parser_outputs()->mutable_data()
+       + parsed_document->parser_outputs_size(),
+       &ParserOutputPrecedes);
+}
+
 // Parses each http file with all parsers at once and checks that the output
 // matches the corresponding out file.
 TEST_F(ParseTest, OutputCorrectness) {
@@ -113,24 +145,959 @@ TEST_F(ParseTest, OutputCorrectness) {
     ParsedDocument actual;
     master.ParseDocument(*doc, &actual);
 
-    // Sort parser outputs within actual and expected, since XpafParserMaster
-    // shuffles them.
-    // NOTE(sadovsky): It would be simpler to use pointer_begin() and
-    // pointer_end(), but these aren't available in libprotobuf-dev 2.2.0.
-    sort(expected.mutable_parser_outputs()->mutable_data(),
-         expected.mutable_parser_outputs()->mutable_data()
-         + expected.parser_outputs_size(),
-         &ParserOutputPrecedes);
-    sort(actual.mutable_parser_outputs()->mutable_data(),
-         actual.mutable_parser_outputs()->mutable_data()
-         + actual.parser_outputs_size(),
-         &ParserOutputPrecedes);
-
+    SortParserOutputs(&expected);
+    SortParserOutputs(&actual);
     EXPECT_EQ(actual.DebugString(), expected.DebugString());
   }
 }
 
-// Helper function for BrokenParsersAbort test.
+// Checks that interned output expands to exactly the non-interned output, also
+// when the ParsedDocument is reused across documents.
+TEST_F(ParseTest, InternedOutputMatchesOutput) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.intern_strings = true;
+  const XpafParserMaster interning_master(parser_defs_, opt);
+
+  ParsedDocument interned;
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    interning_master.ParseDocument(*doc, &interned);
+    ExpandInternedStrings(&interned);
+    EXPECT_EQ(interned.SerializeAsString(), expected.SerializeAsString())
+        << http_files_[i];
+  }
+}
+
+// Checks that ParsedDocumentEncoder produces exactly the bytes that
+// SerializeToString() produces, with and without string interning.
+TEST_F(ParseTest, EncoderMatchesSerializeToString) {
+  for (int intern_strings = 0; intern_strings <= 1; ++intern_strings) {
+    ParseOptions opt;
+    opt.error_handling_mode = EHM_IGNORE;
+    opt.intern_strings = intern_strings;
+    const XpafParserMaster master(parser_defs_, opt);
+
+    string encoded;
+    ParsedDocumentEncoder encoder(&encoded, intern_strings);
+    for (int i = 0; i < http_files_.size(); ++i) {
+      string url, content;
+      scoped_ptr<Document> doc(
+          MakeDocFromFile(http_files_[i], &url, &content));
+
+      ParsedDocument parsed_document;
+      master.ParseDocument(*doc, &parsed_document);
+      master.ParseDocument(*doc, &encoder);
+      EXPECT_EQ(parsed_document.SerializeAsString(), encoded)
+          << http_files_[i] << " intern_strings=" << intern_strings;
+    }
+  }
+}
+
+// Builds a single columnar batch from all http files and checks that it reads
+// back as the original ParsedDocuments, including their truncated flags.
+TEST_F(ParseTest, ColumnarBatchRoundTrip) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.max_relations = 1;
+  const XpafParserMaster limited_master(parser_defs_, opt);
+
+  ColumnarBatchBuilder builder;
+  vector<ParsedDocument> expected(http_files_.size());
+  int num_truncated = 0;
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    // Alternate between complete and truncated output, and between the two
+    // ways of adding documents.
+    const XpafParserMaster& doc_master = i % 4 < 2 ? master : limited_master;
+    doc_master.ParseDocument(*doc, &expected[i]);
+    if (expected[i].truncated()) ++num_truncated;
+    if (i % 2 == 0) {
+      doc_master.ParseDocument(*doc, &builder);
+    } else {
+      builder.AddParsedDocument(expected[i]);
+    }
+  }
+  EXPECT_GT(num_truncated, 0);
+  EXPECT_EQ(http_files_.size(), builder.num_documents());
+
+  string block;
+  builder.Finish(&block);
+  EXPECT_EQ(0, builder.num_documents());
+
+  ColumnarBatchReader reader;
+  ASSERT_TRUE(reader.Init(block));
+  ASSERT_EQ(http_files_.size(), reader.num_documents());
+  for (int i = 0; i < reader.num_documents(); ++i) {
+    EXPECT_EQ(expected[i].truncated(), reader.truncated(i));
+    ParsedDocument actual;
+    reader.ToParsedDocument(i, &actual);
+    EXPECT_EQ(expected[i].DebugString(), actual.DebugString());
+  }
+
+  // Corrupt blocks should be rejected.
+  EXPECT_FALSE(reader.Init(StringPiece(block.data(), block.size() - 8)));
+  string bad_block = block;
+  bad_block[0] ^= 1;
+  EXPECT_FALSE(reader.Init(bad_block));
+}
+
+// Counts relations and checks that RelationSink calls are properly nested.
+class CountingSink : public RelationSink {
+ public:
+  CountingSink()
+      : num_documents_(0), num_relations_(0), in_document_(false),
+        in_parser_(false) {}
+
+  virtual void BeginDocument(const StringPiece& url) {
+    EXPECT_FALSE(in_document_);
+    in_document_ = true;
+  }
+  virtual void BeginParser(const StringPiece& parser_name) {
+    EXPECT_TRUE(in_document_);
+    EXPECT_FALSE(in_parser_);
+    in_parser_ = true;
+  }
+  virtual void AddRelation(const RelationView& relation) {
+    EXPECT_TRUE(in_parser_);
+    ++num_relations_;
+  }
+  virtual void EndParser() {
+    EXPECT_TRUE(in_parser_);
+    in_parser_ = false;
+  }
+  virtual void EndDocument() {
+    EXPECT_TRUE(in_document_);
+    EXPECT_FALSE(in_parser_);
+    in_document_ = false;
+    ++num_documents_;
+  }
+
+  int num_documents() const { return num_documents_; }
+  int num_relations() const { return num_relations_; }
+
+ private:
+  int num_documents_;
+  int num_relations_;
+  bool in_document_;
+  bool in_parser_;
+};
+
+// Checks that a custom RelationSink sees the same relations that end up in the
+// ParsedDocument.
+TEST_F(ParseTest, RelationSink) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument parsed_document;
+    master.ParseDocument(*doc, &parsed_document);
+    int expected_num_relations = 0;
+    for (int j = 0; j < parsed_document.parser_outputs_size(); ++j) {
+      expected_num_relations +=
+          parsed_document.parser_outputs(j).relations_size();
+    }
+
+    CountingSink sink;
+    master.ParseDocument(*doc, &sink);
+    EXPECT_EQ(1, sink.num_documents());
+    EXPECT_EQ(expected_num_relations, sink.num_relations()) << http_files_[i];
+  }
+}
+
+// Checks that a master loaded from a parser snapshot produces the same output
+// as one constructed from text parser defs, and that compiling it again yields
+// the same snapshot.
+TEST_F(ParseTest, ParserSnapshotRoundTrip) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+
+  CompiledXpafParserDefs compiled_defs;
+  master.Compile(&compiled_defs);
+  EXPECT_EQ(parser_defs_.parser_defs_size(), compiled_defs.parser_defs_size());
+  string snapshot;
+  SerializeParserSnapshot(compiled_defs, &snapshot);
+
+  CompiledXpafParserDefs loaded_defs;
+  ASSERT_TRUE(ParseParserSnapshot(snapshot, &loaded_defs));
+  const XpafParserMaster loaded_master(&loaded_defs, opt);
+  EXPECT_EQ(0, loaded_defs.parser_defs_size());
+
+  loaded_master.Compile(&loaded_defs);
+  string recompiled_snapshot;
+  SerializeParserSnapshot(loaded_defs, &recompiled_snapshot);
+  EXPECT_EQ(snapshot, recompiled_snapshot);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    ParsedDocument actual;
+    loaded_master.ParseDocument(*doc, &actual);
+    SortParserOutputs(&expected);
+    SortParserOutputs(&actual);
+    EXPECT_EQ(actual.DebugString(), expected.DebugString()) << http_files_[i];
+  }
+
+  // Truncated snapshots and snapshots with other versions are rejected.
+  EXPECT_FALSE(ParseParserSnapshot(
+      StringPiece(snapshot.data(), snapshot.size() - 1), &loaded_defs));
+  string bad_version = snapshot;
+  bad_version[4] ^= 0xff;
+  EXPECT_FALSE(ParseParserSnapshot(bad_version, &loaded_defs));
+}
+
+// Checks that reading and initializing parsers in parallel gives the same
+// result as doing so sequentially.
+TEST_F(ParseTest, ParallelInit) {
+  XpafParserDefs parallel_parser_defs;
+  ReadXpafParserDefsParallel(data_dir_ + "/*.xpd", 4, &parallel_parser_defs);
+  EXPECT_EQ(parser_defs_.SerializeAsString(),
+            parallel_parser_defs.SerializeAsString());
+
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  CompiledXpafParserDefs expected;
+  XpafParserMaster(parser_defs_, opt).Compile(&expected);
+
+  opt.num_init_threads = 4;
+  CompiledXpafParserDefs actual;
+  XpafParserMaster(parser_defs_, opt).Compile(&actual);
+  EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+}
+
+// Checks that lazily initialized parsers produce the same output as eagerly
+// initialized ones, and that they compile to the same snapshot once used.
+TEST_F(ParseTest, LazyInit) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.lazy_init = true;
+  const XpafParserMaster lazy_master(parser_defs_, opt);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    ParsedDocument actual;
+    lazy_master.ParseDocument(*doc, &actual);
+    SortParserOutputs(&expected);
+    SortParserOutputs(&actual);
+    EXPECT_EQ(actual.DebugString(), expected.DebugString()) << http_files_[i];
+  }
+
+  CompiledXpafParserDefs expected_compiled;
+  master.Compile(&expected_compiled);
+  CompiledXpafParserDefs actual_compiled;
+  lazy_master.Compile(&actual_compiled);
+  EXPECT_EQ(expected_compiled.SerializeAsString(),
+            actual_compiled.SerializeAsString());
+}
+
+// Repeatedly parses documents through a ReloadableParserMaster and counts
+// outputs that differ from the expected ones.
+class ReloadingParseWorker {
+ public:
+  ReloadingParseWorker(const ReloadableParserMaster* handle,
+                       const vector<Document*>* docs,
+                       const vector<string>* expected,
+                       volatile int32* num_mismatches)
+      : handle_(handle), docs_(docs), expected_(expected),
+        num_mismatches_(num_mismatches) {}
+
+  void Run() {
+    for (int iter = 0; iter < 20; ++iter) {
+      for (int i = 0; i < docs_->size(); ++i) {
+        ParsedDocument parsed_document;
+        handle_->ParseDocument(*(*docs_)[i], &parsed_document);
+        SortParserOutputs(&parsed_document);
+        if (parsed_document.SerializeAsString() != (*expected_)[i]) {
+          Barrier_AtomicIncrement(num_mismatches_, 1);
+        }
+      }
+    }
+  }
+
+ private:
+  const ReloadableParserMaster* const handle_;
+  const vector<Document*>* const docs_;
+  const vector<string>* const expected_;
+  volatile int32* const num_mismatches_;
+};
+
+// Checks that reloading a ReloadableParserMaster while other threads parse
+// with it neither crashes nor changes their output.
+TEST_F(ParseTest, ReloadWhileParsing) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  ReloadableParserMaster handle(new XpafParserMaster(parser_defs_, opt));
+
+  vector<string> urls(http_files_.size()), contents(http_files_.size());
+  vector<Document*> docs;
+  vector<string> expected;
+  for (int i = 0; i < http_files_.size(); ++i) {
+    docs.push_back(MakeDocFromFile(http_files_[i], &urls[i], &contents[i]));
+    ParsedDocument parsed_document;
+    handle.ParseDocument(*docs[i], &parsed_document);
+    SortParserOutputs(&parsed_document);
+    expected.push_back(parsed_document.SerializeAsString());
+  }
+
+  volatile int32 num_mismatches = 0;
+  const int kNumWorkers = 4;
+  ReloadingParseWorker worker(&handle, &docs, &expected, &num_mismatches);
+  {
+    ThreadPool pool(kNumWorkers);
+    for (int i = 0; i < kNumWorkers; ++i) {
+      pool.Schedule(NewCallback(&worker, &ReloadingParseWorker::Run));
+    }
+    for (int i = 0; i < 10; ++i) {
+      handle.Reload(new XpafParserMaster(parser_defs_, opt));
+    }
+  }
+  EXPECT_EQ(10, handle.generation());
+  EXPECT_EQ(0, num_mismatches);
+  STLDeleteElements(&docs);
+}
+
+// Checks that masters derived by adding, replacing, and removing single
+// parsers are equivalent to masters built from scratch, and remain usable after
+// the master they were derived from is deleted.
+TEST_F(ParseTest, IncrementalUpdates) {
+  ASSERT_GT(parser_defs_.parser_defs_size(), 1);
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  XpafParserDefs partial_parser_defs(parser_defs_);
+  const XpafParserDef last_parser_def(
+      parser_defs_.parser_defs(parser_defs_.parser_defs_size() - 1));
+  partial_parser_defs.mutable_parser_defs()->RemoveLast();
+  const string& last_parser_name = last_parser_def.parser_name();
+
+  CompiledXpafParserDefs full_compiled, partial_compiled;
+  XpafParserMaster(parser_defs_, opt).Compile(&full_compiled);
+  XpafParserMaster(partial_parser_defs, opt).Compile(&partial_compiled);
+
+  scoped_ptr<XpafParserMaster> partial_master(
+      new XpafParserMaster(partial_parser_defs, opt));
+  scoped_ptr<XpafParserMaster> added_master(
+      partial_master->CopyWithAddedParser(last_parser_def, opt));
+  partial_master.reset();
+  scoped_ptr<XpafParserMaster> replaced_master(
+      added_master->CopyWithReplacedParser(last_parser_def, opt));
+  scoped_ptr<XpafParserMaster> removed_master(
+      replaced_master->CopyWithRemovedParser(last_parser_name));
+
+  CompiledXpafParserDefs compiled;
+  added_master->Compile(&compiled);
+  EXPECT_EQ(full_compiled.SerializeAsString(), compiled.SerializeAsString());
+  added_master.reset();
+  replaced_master->Compile(&compiled);
+  EXPECT_EQ(full_compiled.SerializeAsString(), compiled.SerializeAsString());
+  removed_master->Compile(&compiled);
+  EXPECT_EQ(partial_compiled.SerializeAsString(), compiled.SerializeAsString());
+
+  ReloadableParserMaster handle(removed_master.release());
+  handle.AddParser(last_parser_def, opt);
+  handle.ReplaceParser(last_parser_def, opt);
+  handle.RemoveParser(last_parser_name);
+  EXPECT_EQ(3, handle.generation());
+}
+
+// Checks that collecting ParseStats doesn't change the output, and that the
+// stats are consistent with it.
+TEST_F(ParseTest, ParseStats) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    ParsedDocument actual;
+    ParseStats stats;
+    master.ParseDocument(*doc, &actual, &stats);
+    EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+
+    EXPECT_GE(stats.total_nanos(), stats.dispatch_nanos());
+    int64 output_bytes = 0;
+    for (int j = 0; j < stats.parser_stats_size(); ++j) {
+      const ParserStats& parser_stats = stats.parser_stats(j);
+      output_bytes += parser_stats.output_bytes();
+      int num_relations = 0;
+      for (int k = 0; k < actual.parser_outputs_size(); ++k) {
+        if (actual.parser_outputs(k).parser_name() ==
+            parser_stats.parser_name()) {
+          num_relations = actual.parser_outputs(k).relations_size();
+        }
+      }
+      EXPECT_EQ(num_relations, parser_stats.num_relations())
+          << parser_stats.parser_name();
+      for (int k = 0; k < parser_stats.query_stats_size(); ++k) {
+        EXPECT_FALSE(parser_stats.query_stats(k).query().empty());
+      }
+    }
+    EXPECT_EQ(output_bytes, stats.output_bytes());
+  }
+}
+
+// Checks that ParseOptions.result_cache returns the uncached output, ignores
+// HTTP headers, and is keyed by parser set. With or without the cache, output
+// replaces the ParsedDocument's previous contents.
+TEST_F(ParseTest, ResultCache) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster uncached_master(parser_defs_, opt);
+  ParseResultCache cache(64 << 20);
+  opt.result_cache = &cache;
+  const XpafParserMaster master(parser_defs_, opt);
+  EXPECT_EQ(uncached_master.Fingerprint(), master.Fingerprint());
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument stale;
+    stale.set_url("http://stale.com/");
+    stale.add_parser_outputs()->set_parser_name("stale");
+    ParsedDocument expected(stale);
+    uncached_master.ParseDocument(*doc, &expected);
+    EXPECT_EQ(url, expected.url());
+
+    ParseStats stats;
+    ParsedDocument miss(stale), hit(stale);
+    master.ParseDocument(*doc, &miss, &stats);
+    EXPECT_FALSE(stats.result_cache_hit());
+    master.ParseDocument(*doc, &hit, &stats);
+    EXPECT_TRUE(stats.result_cache_hit()) << http_files_[i];
+    EXPECT_EQ(expected.SerializeAsString(), miss.SerializeAsString());
+    EXPECT_EQ(expected.SerializeAsString(), hit.SerializeAsString());
+
+    const string with_headers = "HTTP/1.1 200 OK\r\nDate: today\r\n\r\n" +
+                                content;
+    Document recrawled_doc;
+    recrawled_doc.Init(url, with_headers, CONTENT_TYPE_HTML);
+    EXPECT_EQ(master.ResultCacheKey(*doc),
+              master.ResultCacheKey(recrawled_doc));
+  }
+  EXPECT_EQ(http_files_.size(), cache.hits());
+  EXPECT_EQ(http_files_.size(), cache.misses());
+  EXPECT_EQ(http_files_.size(), cache.size());
+
+  // Changing the body or the parser set changes the key.
+  string url, content;
+  scoped_ptr<Document> doc(MakeDocFromFile(http_files_[0], &url, &content));
+  const string changed_content = content + " ";
+  Document changed_doc;
+  changed_doc.Init(url, changed_content, CONTENT_TYPE_HTML);
+  EXPECT_NE(master.ResultCacheKey(*doc), master.ResultCacheKey(changed_doc));
+  if (parser_defs_.parser_defs_size() > 1) {
+    scoped_ptr<XpafParserMaster> removed_master(master.CopyWithRemovedParser(
+        parser_defs_.parser_defs(0).parser_name()));
+    EXPECT_NE(master.Fingerprint(), removed_master->Fingerprint());
+    EXPECT_NE(master.ResultCacheKey(*doc),
+              removed_master->ResultCacheKey(*doc));
+  }
+
+  // Parsers initialized from a snapshot keep their fingerprints.
+  CompiledXpafParserDefs compiled_defs;
+  master.Compile(&compiled_defs);
+  EXPECT_EQ(master.Fingerprint(),
+            XpafParserMaster(&compiled_defs, opt).Fingerprint());
+}
+
+// Checks that ReparseDocument() matches ParseDocument() after parsers are
+// added, changed, and removed, and that it reuses unchanged parsers' output.
+TEST_F(ParseTest, ReparseDocument) {
+  ASSERT_GT(parser_defs_.parser_defs_size(), 2);
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  opt.output_errors = true;
+
+  // The old parser set lacks the last parser, has an older version of the
+  // first, and has a parser that has since been removed.
+  XpafParserDefs old_parser_defs(parser_defs_);
+  old_parser_defs.mutable_parser_defs()->RemoveLast();
+  XpafParserDef* changed_def = old_parser_defs.mutable_parser_defs(0);
+  if (changed_def->relation_tmpls_size() > 0) {
+    changed_def->mutable_relation_tmpls()->RemoveLast();
+  }
+  changed_def->set_priority(changed_def->priority() + 1);
+  XpafParserDef* removed_def = old_parser_defs.add_parser_defs();
+  removed_def->CopyFrom(parser_defs_.parser_defs(1));
+  removed_def->set_parser_name("removed_parser");
+
+  const XpafParserMaster old_master(old_parser_defs, opt);
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.intern_strings = true;
+  const XpafParserMaster interning_master(parser_defs_, opt);
+  ParserFingerprintMap old_fingerprints, fingerprints;
+  old_master.ParserFingerprints(&old_fingerprints);
+  master.ParserFingerprints(&fingerprints);
+  EXPECT_EQ(parser_defs_.parser_defs_size(), old_fingerprints.size());
+  EXPECT_EQ(1, old_fingerprints.count("removed_parser"));
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument previous, expected;
+    old_master.ParseDocument(*doc, &previous);
+    master.ParseDocument(*doc, &expected);
+    SortParserOutputs(&expected);
+
+    ParsedDocument actual;
+    ParseStats stats;
+    master.ReparseDocument(*doc, previous, old_fingerprints, &actual, &stats);
+    SortParserOutputs(&actual);
+    EXPECT_EQ(expected.DebugString(), actual.DebugString()) << http_files_[i];
+    EXPECT_EQ(stats.parser_stats_size() > 0,
+              master.ShouldReparse(url, old_fingerprints));
+
+    // Interned output can be reparsed into non-interned output and vice versa.
+    ParsedDocument interned;
+    interning_master.ReparseDocument(*doc, previous, old_fingerprints,
+                                     &interned, NULL);
+    ParsedDocument expanded;
+    master.ReparseDocument(*doc, interned, fingerprints, &expanded, NULL);
+    SortParserOutputs(&expanded);
+    EXPECT_EQ(expected.DebugString(), expanded.DebugString());
+
+    // With no changes, the content isn't needed.
+    EXPECT_FALSE(master.ShouldReparse(url, fingerprints));
+    Document no_content_doc;
+    no_content_doc.Init(url, "", CONTENT_TYPE_HTML);
+    ParsedDocument reused;
+    master.ReparseDocument(no_content_doc, expected, fingerprints, &reused,
+                           &stats);
+    EXPECT_EQ(0, stats.parser_stats_size());
+    SortParserOutputs(&reused);
+    EXPECT_EQ(expected.DebugString(), reused.DebugString());
+  }
+}
+
+// Returns the per-parser multisets of relation fingerprints in 'fingerprints'.
+map<string, multiset<uint64> > FingerprintMultisets(
+    const RelationFingerprints& fingerprints) {
+  map<string, multiset<uint64> > multisets;
+  for (int i = 0; i < fingerprints.parsers_size(); ++i) {
+    const RelationFingerprints::Parser& parser = fingerprints.parsers(i);
+    multisets[parser.parser_name()].insert(parser.fingerprints().begin(),
+                                           parser.fingerprints().end());
+  }
+  return multisets;
+}
+
+// Expects that applying 'delta' to 'previous' gives 'current'.
+void ExpectDeltaApplies(const RelationFingerprints& previous,
+                        const ParsedDocument& delta,
+                        const RelationFingerprints& current) {
+  map<string, multiset<uint64> > relations = FingerprintMultisets(previous);
+  RelationFingerprints added;
+  ComputeRelationFingerprints(delta, &added);
+  for (int i = 0; i < added.parsers_size(); ++i) {
+    const RelationFingerprints::Parser& parser = added.parsers(i);
+    relations[parser.parser_name()].insert(parser.fingerprints().begin(),
+                                           parser.fingerprints().end());
+  }
+  for (int i = 0; i < delta.parser_outputs_size(); ++i) {
+    const ParserOutput& output = delta.parser_outputs(i);
+    multiset<uint64>* parser_relations = &relations[output.parser_name()];
+    for (int j = 0; j < output.removed_relation_fingerprints_size(); ++j) {
+      multiset<uint64>::iterator it =
+          parser_relations->find(output.removed_relation_fingerprints(j));
+      ASSERT_TRUE(it != parser_relations->end());
+      parser_relations->erase(it);
+    }
+    if (parser_relations->empty()) relations.erase(output.parser_name());
+  }
+  EXPECT_TRUE(relations == FingerprintMultisets(current)) << delta.url();
+}
+
+// Checks that ParseDocumentDelta() output turns the previous relations into
+// the current ones, with and without interning.
+TEST_F(ParseTest, DeltaOutput) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  XpafParserDefs old_parser_defs(parser_defs_);
+  for (int i = 0; i < old_parser_defs.parser_defs_size(); i += 2) {
+    XpafParserDef* parser_def = old_parser_defs.mutable_parser_defs(i);
+    if (parser_def->relation_tmpls_size() > 0) {
+      parser_def->mutable_relation_tmpls()->RemoveLast();
+    }
+  }
+  const XpafParserMaster old_master(old_parser_defs, opt);
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.intern_strings = true;
+  const XpafParserMaster interning_master(parser_defs_, opt);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument previous, current;
+    old_master.ParseDocument(*doc, &previous);
+    master.ParseDocument(*doc, &current);
+    RelationFingerprints previous_fingerprints, current_fingerprints;
+    ComputeRelationFingerprints(previous, &previous_fingerprints);
+    ComputeRelationFingerprints(current, &current_fingerprints);
+
+    ParsedDocument delta;
+    master.ParseDocumentDelta(*doc, previous, &delta, NULL);
+    EXPECT_TRUE(delta.delta());
+    ParsedDocument interned_delta;
+    interning_master.ParseDocumentDelta(*doc, previous_fingerprints,
+                                        &interned_delta, NULL);
+    ExpandInternedStrings(&interned_delta);
+    EXPECT_EQ(delta.SerializeAsString(), interned_delta.SerializeAsString());
+
+    ExpectDeltaApplies(previous_fingerprints, delta, current_fingerprints);
+    ParsedDocument reverse_delta;
+    old_master.ParseDocumentDelta(*doc, current, &reverse_delta, NULL);
+    ExpectDeltaApplies(current_fingerprints, reverse_delta,
+                       previous_fingerprints);
+
+    // Nothing changes between identical parses.
+    ParsedDocument empty_delta;
+    master.ParseDocumentDelta(*doc, current_fingerprints, &empty_delta, NULL);
+    EXPECT_EQ(0, empty_delta.parser_outputs_size());
+  }
+
+  // Every string, and whether userdata is present, affects the fingerprint.
+  vector<RelationView::Annotation> annotations(1);
+  annotations[0].name = "name";
+  annotations[0].value = "value";
+  RelationView relation;
+  relation.subject = "s";
+  relation.predicate = "p";
+  relation.object = "o";
+  relation.annotations = &annotations;
+  set<uint64> fingerprints;
+  fingerprints.insert(RelationFingerprint(relation));
+  relation.has_userdata = true;
+  fingerprints.insert(RelationFingerprint(relation));
+  relation.userdata = "u";
+  fingerprints.insert(RelationFingerprint(relation));
+  annotations[0].value = "other";
+  fingerprints.insert(RelationFingerprint(relation));
+  relation.subject = "o";
+  relation.object = "s";
+  fingerprints.insert(RelationFingerprint(relation));
+  annotations.clear();
+  fingerprints.insert(RelationFingerprint(relation));
+  EXPECT_EQ(6, fingerprints.size());
+}
+
+// Checks ParseResultCache's size bound and CLOCK eviction.
+TEST(ParseResultCache, Eviction) {
+  ParsedDocument parsed_document;
+  parsed_document.set_url("http://a.com/");
+  parsed_document.add_parser_outputs()->set_parser_name("parser");
+  ParsedDocument copy(parsed_document);
+  const int64 entry_bytes = copy.SpaceUsedLong();
+  ParseResultCache cache(3 * entry_bytes);
+
+  cache.Insert(1, parsed_document);
+  cache.Insert(2, parsed_document);
+  cache.Insert(3, parsed_document);
+  EXPECT_EQ(3, cache.size());
+  ParsedDocument found;
+  EXPECT_FALSE(cache.Lookup(1, "http://b.com/", &found));
+  EXPECT_TRUE(cache.Lookup(1, "http://a.com/", &found));
+  EXPECT_EQ(parsed_document.SerializeAsString(), found.SerializeAsString());
+
+  // Key 1 was referenced, so the hand passes over it and evicts key 2.
+  cache.Insert(4, parsed_document);
+  EXPECT_EQ(3, cache.size());
+  EXPECT_LE(cache.bytes(), 3 * entry_bytes);
+  EXPECT_EQ(1, cache.evictions());
+  EXPECT_TRUE(cache.Lookup(1, "http://a.com/", &found));
+  EXPECT_FALSE(cache.Lookup(2, "http://a.com/", &found));
+  EXPECT_TRUE(cache.Lookup(3, "http://a.com/", &found));
+  EXPECT_TRUE(cache.Lookup(4, "http://a.com/", &found));
+
+  cache.Clear();
+  EXPECT_EQ(0, cache.size());
+  EXPECT_EQ(0, cache.bytes());
+  EXPECT_FALSE(cache.Lookup(1, "http://a.com/", &found));
+}
+
+// Adds the serialized relations of 'output' to 'relations'.
+void SerializedRelations(const ParserOutput& output, set<string>* relations) {
+  for (int i = 0; i < output.relations_size(); ++i) {
+    relations->insert(output.relations(i).SerializeAsString());
+  }
+}
+
+// Checks that running out of budget yields a truncated subset of the full
+// output, and that ParsedDocumentEncoder encodes the truncated flag.
+TEST_F(ParseTest, ParseBudget) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.max_xpath_ops = 1000000000;
+  opt.time_budget_nanos = 1000000000000LL;
+  const XpafParserMaster generous_master(parser_defs_, opt);
+  opt.max_xpath_ops = 50;
+  opt.time_budget_nanos = 0;
+  const XpafParserMaster op_limited_master(parser_defs_, opt);
+  opt.max_xpath_ops = 0;
+  opt.time_budget_nanos = 1;
+  const XpafParserMaster time_limited_master(parser_defs_, opt);
+
+  int num_truncated = 0;
+  string encoded;
+  ParsedDocumentEncoder encoder(&encoded, false);
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    EXPECT_FALSE(expected.truncated());
+    ParsedDocument generous;
+    generous_master.ParseDocument(*doc, &generous);
+    EXPECT_EQ(expected.SerializeAsString(), generous.SerializeAsString())
+        << http_files_[i];
+
+    ParsedDocument time_limited;
+    time_limited_master.ParseDocument(*doc, &time_limited);
+    EXPECT_EQ(0, time_limited.parser_outputs_size()) << http_files_[i];
+    EXPECT_EQ(expected.parser_outputs_size() > 0, time_limited.truncated())
+        << http_files_[i];
+
+    ParsedDocument op_limited;
+    op_limited_master.ParseDocument(*doc, &op_limited);
+    if (op_limited.truncated()) ++num_truncated;
+    for (int j = 0; j < op_limited.parser_outputs_size(); ++j) {
+      const ParserOutput& output = op_limited.parser_outputs(j);
+      set<string> expected_relations;
+      for (int k = 0; k < expected.parser_outputs_size(); ++k) {
+        if (expected.parser_outputs(k).parser_name() == output.parser_name()) {
+          SerializedRelations(expected.parser_outputs(k), &expected_relations);
+        }
+      }
+      set<string> actual_relations;
+      SerializedRelations(output, &actual_relations);
+      EXPECT_TRUE(includes(expected_relations.begin(), expected_relations.end(),
+                           actual_relations.begin(), actual_relations.end()))
+          << http_files_[i] << " " << output.parser_name();
+    }
+    op_limited_master.ParseDocument(*doc, &encoder);
+    EXPECT_EQ(op_limited.SerializeAsString(), encoded) << http_files_[i];
+  }
+  EXPECT_GT(num_truncated, 0);
+}
+
+int NumRelations(const ParsedDocument& parsed_document) {
+  int num_relations = 0;
+  for (int i = 0; i < parsed_document.parser_outputs_size(); ++i) {
+    num_relations += parsed_document.parser_outputs(i).relations_size();
+  }
+  return num_relations;
+}
+
+// Checks that each per-document limit truncates output as documented.
+TEST_F(ParseTest, OutputLimits) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.max_relations = 2;
+  const XpafParserMaster relation_limited_master(parser_defs_, opt);
+  opt.max_relations = 0;
+  opt.max_document_bytes = 10;
+  const XpafParserMaster byte_limited_master(parser_defs_, opt);
+  opt.max_document_bytes = 0;
+  opt.max_dom_nodes = 5;
+  const XpafParserMaster node_limited_master(parser_defs_, opt);
+  opt.max_dom_nodes = 0;
+  opt.max_results_per_query = 1;
+  const XpafParserMaster result_limited_master(parser_defs_, opt);
+
+  int num_results_truncated = 0;
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    const int num_expected = NumRelations(expected);
+
+    ParsedDocument actual;
+    relation_limited_master.ParseDocument(*doc, &actual);
+    EXPECT_EQ(min(num_expected, 2), NumRelations(actual)) << http_files_[i];
+    EXPECT_EQ(num_expected > 2, actual.truncated()) << http_files_[i];
+    if (actual.parser_outputs_size() > 0) {
+      EXPECT_EQ(expected.parser_outputs(0).relations(0).SerializeAsString(),
+                actual.parser_outputs(0).relations(0).SerializeAsString());
+    }
+
+    if (num_expected > 0) {
+      ParsedDocument too_long;
+      byte_limited_master.ParseDocument(*doc, &too_long);
+      EXPECT_EQ(0, too_long.parser_outputs_size()) << http_files_[i];
+      EXPECT_TRUE(too_long.truncated()) << http_files_[i];
+
+      ParsedDocument too_many_nodes;
+      node_limited_master.ParseDocument(*doc, &too_many_nodes);
+      EXPECT_EQ(0, too_many_nodes.parser_outputs_size()) << http_files_[i];
+      EXPECT_TRUE(too_many_nodes.truncated()) << http_files_[i];
+    }
+
+    ParsedDocument results_truncated;
+    result_limited_master.ParseDocument(*doc, &results_truncated);
+    if (results_truncated.truncated()) ++num_results_truncated;
+  }
+  EXPECT_GT(num_results_truncated, 0);
+}
+
+// Checks that output limits drop relations but not errors, both when parsing
+// and when ReparseDocument() copies a parser's previous output.
+TEST_F(ParseTest, OutputLimitsKeepErrors) {
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  opt.output_errors = true;
+  const XpafParserMaster master(parser_defs_, opt);
+  opt.max_relations = 1 << 20;
+  const XpafParserMaster limited_master(parser_defs_, opt);
+  ParserFingerprintMap fingerprints;
+  master.ParserFingerprints(&fingerprints);
+
+  int num_errors = 0;
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument expected;
+    master.ParseDocument(*doc, &expected);
+    num_errors += expected.errors_size();
+
+    ParsedDocument actual;
+    limited_master.ParseDocument(*doc, &actual);
+    EXPECT_FALSE(actual.truncated());
+    EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString())
+        << http_files_[i];
+
+    ParsedDocument reparsed;
+    limited_master.ReparseDocument(*doc, expected, fingerprints, &reparsed,
+                                   NULL);
+    EXPECT_EQ(expected.SerializeAsString(), reparsed.SerializeAsString())
+        << http_files_[i];
+  }
+  EXPECT_GT(num_errors, 0);
+}
+
+// Checks that parser outputs appear in decreasing priority order.
+TEST_F(ParseTest, ParserPriority) {
+  XpafParserDefs parser_defs(parser_defs_);
+  map<string, int> priorities;
+  for (int i = 0; i < parser_defs.parser_defs_size(); ++i) {
+    XpafParserDef* parser_def = parser_defs.mutable_parser_defs(i);
+    parser_def->set_priority(i % 3);
+    priorities[parser_def->parser_name()] = i % 3;
+  }
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs, opt);
+
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument parsed_document;
+    master.ParseDocument(*doc, &parsed_document);
+    for (int j = 1; j < parsed_document.parser_outputs_size(); ++j) {
+      EXPECT_GE(priorities[parsed_document.parser_outputs(j - 1).parser_name()],
+                priorities[parsed_document.parser_outputs(j).parser_name()])
+          << http_files_[i];
+    }
+  }
+}
+
+// Checks that errors listed in ParsedDocument.errors match the ones counted by
+// ErrorReporter::Global(), and that ParsedDocumentEncoder encodes them.
+TEST_F(ParseTest, ErrorReporting) {
+  ErrorReporter* reporter = ErrorReporter::Global();
+  reporter->Clear();
+
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_LOG_ERROR;
+  opt.output_errors = true;
+  const XpafParserMaster master(parser_defs_, opt);
+
+  int64 num_errors = 0;
+  string encoded;
+  ParsedDocumentEncoder encoder(&encoded, false);
+  for (int i = 0; i < http_files_.size(); ++i) {
+    string url, content;
+    scoped_ptr<Document> doc(MakeDocFromFile(http_files_[i], &url, &content));
+    ParsedDocument parsed_document;
+    master.ParseDocument(*doc, &parsed_document);
+    for (int j = 0; j < parsed_document.errors_size(); ++j) {
+      const ParseError& error = parsed_document.errors(j);
+      EXPECT_FALSE(error.parser_name().empty());
+      EXPECT_FALSE(error.location().empty());
+      EXPECT_FALSE(error.message().empty());
+    }
+    num_errors += parsed_document.errors_size();
+    master.ParseDocument(*doc, &encoder);
+    EXPECT_EQ(parsed_document.SerializeAsString(), encoded) << http_files_[i];
+  }
+  EXPECT_GT(num_errors, 0);
+
+  vector<ErrorReporter::ErrorStats> stats;
+  reporter->GetErrorStats(&stats);
+  int64 num_reported = 0;
+  for (int i = 0; i < stats.size(); ++i) {
+    num_reported += stats[i].count;
+    EXPECT_GE(stats[i].exemplars.size(), 1);
+    EXPECT_LE(stats[i].exemplars.size(), ErrorReporter::kMaxExemplars);
+  }
+  // Each document was parsed twice.
+  EXPECT_EQ(2 * num_errors, num_reported);
+  reporter->Clear();
+}
+
+void ReportErrors(ErrorReporter* reporter) {
+  for (int i = 0; i < 1000; ++i) {
+    reporter->Report("parser", ParseError::POST_PROCESSING_FAILED,
+                     i % 2 == 0 ? "even" : "odd", "http://example.com/",
+                     "message");
+  }
+}
+
+// Checks that ErrorReporter counts correctly when used from several threads.
+TEST(ErrorReporter, Concurrency) {
+  ErrorReporter reporter;
+  reporter.set_summary_interval_nanos(kint64max);
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 4; ++i) {
+      pool.Schedule(NewCallback(&ReportErrors, &reporter));
+    }
+  }
+  vector<ErrorReporter::ErrorStats> stats;
+  reporter.GetErrorStats(&stats);
+  ASSERT_EQ(2, stats.size());
+  for (int i = 0; i < stats.size(); ++i) {
+    EXPECT_EQ(2000, stats[i].count);
+    EXPECT_EQ(ErrorReporter::kMaxExemplars, stats[i].exemplars.size());
+  }
+}
+
+// Helper function for the Metrics and BrokenParsersAbort tests.
 void ParseHttpFiles(const XpafParserMaster& master,
                     const vector<string>& http_files) {
   for (int i = 0; i < http_files.size(); ++i) {
@@ -141,6 +1108,98 @@ void ParseHttpFiles(const XpafParserMaster& master,
   }
 }
 
+TEST(Histogram, Buckets) {
+  for (int64 value = 0; value < 100000; value = value * 2 + 1) {
+    const int bucket = Histogram::BucketForValue(value);
+    EXPECT_LE(Histogram::BucketLowerBound(bucket), value);
+    EXPECT_GE(Histogram::BucketUpperBound(bucket), value);
+  }
+  EXPECT_EQ(Histogram::kNumBuckets - 1, Histogram::BucketForValue(kint64max));
+
+  Histogram histogram;
+  EXPECT_EQ(0, histogram.Percentile(0.5));
+  for (int i = 1; i <= 1000; ++i) histogram.Add(i);
+  EXPECT_EQ(1000, histogram.Count());
+  EXPECT_EQ(500500, histogram.Sum());
+  EXPECT_NEAR(500, histogram.Percentile(0.5), 125);
+  EXPECT_NEAR(990, histogram.Percentile(0.99), 250);
+}
+
+// Checks that ParseDocument() updates the global metrics iff record_metrics is
+// set.
+TEST_F(ParseTest, Metrics) {
+  MetricsRegistry* registry = MetricsRegistry::Global();
+  const Counter* docs_parsed = registry->GetCounter("xpaf/docs_parsed");
+  const Counter* docs_skipped = registry->GetCounter("xpaf/docs_skipped");
+  const Histogram* latency =
+      registry->GetHistogram("xpaf/parse_latency_nanos");
+
+  for (int record = 0; record < 2; ++record) {
+    ParseOptions opt;
+    opt.error_handling_mode = EHM_IGNORE;
+    opt.record_metrics = record;
+    const XpafParserMaster master(parser_defs_, opt);
+
+    const int64 parsed_before = docs_parsed->Value();
+    const int64 skipped_before = docs_skipped->Value();
+    const int64 latency_count_before = latency->Count();
+    ParseHttpFiles(master, http_files_);
+    const int64 num_parsed = docs_parsed->Value() - parsed_before;
+    const int64 num_skipped = docs_skipped->Value() - skipped_before;
+
+    if (record) {
+      EXPECT_EQ(static_cast<int64>(http_files_.size()),
+                num_parsed + num_skipped);
+      EXPECT_GT(num_parsed, 0);
+      EXPECT_EQ(num_parsed, latency->Count() - latency_count_before);
+    } else {
+      EXPECT_EQ(0, num_parsed + num_skipped);
+    }
+  }
+
+  MetricsSnapshot snapshot;
+  registry->ExportProto(&snapshot);
+  int64 num_invocations = 0;
+  for (int i = 0; i < snapshot.counters_size(); ++i) {
+    const string& name = snapshot.counters(i).name();
+    if (HasPrefixString(name, "xpaf/parser/") &&
+        HasSuffixString(name, "/invocations")) {
+      num_invocations += snapshot.counters(i).value();
+    }
+  }
+  EXPECT_GT(num_invocations, 0);
+}
+
+// Checks that synthetic pages are deterministic and that the generated
+// parsers extract one relation per record.
+TEST(SyntheticCorpus, ParsersMatchPages) {
+  SyntheticCorpusOptions options;
+  options.num_records = 50;
+  options.nesting_depth = 3;
+  options.attrs_per_element = 2;
+  options.num_parsers = 2;
+  const string content = GenerateSyntheticHtml(options);
+  EXPECT_EQ(content, GenerateSyntheticHtml(options));
+  options.seed = 2;
+  EXPECT_NE(content, GenerateSyntheticHtml(options));
+
+  XpafParserDefs parser_defs;
+  GenerateSyntheticParserDefs(options, &parser_defs);
+  const XpafParserMaster master(parser_defs, ParseOptions());
+  Document doc;
+  doc.Init(kSyntheticUrl, content, CONTENT_TYPE_HTML);
+  ParsedDocument parsed_doc;
+  master.ParseDocument(doc, &parsed_doc);
+  ASSERT_EQ(2, parsed_doc.parser_outputs_size());
+  for (int i = 0; i < parsed_doc.parser_outputs_size(); ++i) {
+    const ParserOutput& output = parsed_doc.parser_outputs(i);
+    ASSERT_EQ(50, output.relations_size());
+    EXPECT_EQ("http://synthetic.example.com/r/49",
+              output.relations(49).subject());
+    EXPECT_EQ("name 49", output.relations(49).object());
+  }
+}
+
 // For each XpafParserDef, creates an XpafParserMaster just for that def, and
 // then checks that the parser aborts iff it claims that it should.
 TEST_F(ParseTest, BrokenParsersAbort) {
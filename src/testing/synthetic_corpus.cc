@@ -0,0 +1,177 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "testing/synthetic_corpus.h"
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/stl_decl.h"
+#include "base/strutil.h"
+#include "xpaf_parser_def.pb.h"
+
+namespace xpaf {
+
+const char kSyntheticUrl[] = "http://synthetic.example.com/page";
+
+namespace {
+
+const char* const kWords[] = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+  "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+
+// Linear congruential generator, so that output doesn't depend on the
+// platform's rand().
+class Lcg {
+ public:
+  explicit Lcg(uint32 seed) : state_(seed) {}
+
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 16;
+  }
+
+ private:
+  uint32 state_;
+};
+
+// Appends ' a0="..." a1="..."' with 'num_attrs' attributes.
+void AppendFillerAttrs(int num_attrs, Lcg* lcg, string* out) {
+  for (int i = 0; i < num_attrs; ++i) {
+    *out += StrCat(" data-a", SimpleItoa(i), "=\"",
+                   kWords[lcg->Next() % arraysize(kWords)], "\"");
+  }
+}
+
+// Appends "<tag attrs...", leaving the tag open for more attributes.
+void AppendOpenTag(const char* tag, const SyntheticCorpusOptions& options,
+                   Lcg* lcg, string* out) {
+  *out += "<";
+  *out += tag;
+  AppendFillerAttrs(options.attrs_per_element, lcg, out);
+}
+
+// Appends about 'num_bytes' bytes of space-separated words.
+void AppendFillerText(int num_bytes, Lcg* lcg, string* out) {
+  const size_t target = out->size() + num_bytes;
+  while (out->size() < target) {
+    *out += kWords[lcg->Next() % arraysize(kWords)];
+    *out += " ";
+  }
+}
+
+}  // namespace
+
+string GenerateSyntheticHtml(const SyntheticCorpusOptions& options) {
+  Lcg lcg(options.seed);
+  string out = "<html><head><title>synthetic</title></head>";
+  AppendOpenTag("body", options, &lcg, &out);
+  out += ">\n";
+  for (int i = 0; i < options.nesting_depth; ++i) {
+    AppendOpenTag("div", options, &lcg, &out);
+    out += " class=\"wrap\">\n";
+  }
+  AppendOpenTag("div", options, &lcg, &out);
+  out += " id=\"records\">\n";
+  for (int i = 0; i < options.num_records; ++i) {
+    const string index = SimpleItoa(i);
+    AppendOpenTag("div", options, &lcg, &out);
+    out += " class=\"record\">";
+    AppendOpenTag("a", options, &lcg, &out);
+    out += StrCat(" href=\"http://synthetic.example.com/r/", index,
+                  "\">link</a>");
+    AppendOpenTag("span", options, &lcg, &out);
+    out += StrCat(" class=\"name\">name ", index, "</span>");
+    AppendOpenTag("p", options, &lcg, &out);
+    out += ">";
+    AppendFillerText(options.filler_bytes_per_record, &lcg, &out);
+    out += "</p></div>\n";
+  }
+  out += "</div>\n";
+  for (int i = 0; i < options.nesting_depth; ++i) {
+    out += "</div>\n";
+  }
+  out += "</body></html>\n";
+  return out;
+}
+
+void GenerateSyntheticParserDefs(const SyntheticCorpusOptions& options,
+                                 XpafParserDefs* parser_defs) {
+  parser_defs->Clear();
+  for (int i = 0; i < options.num_parsers; ++i) {
+    XpafParserDef* def = parser_defs->add_parser_defs();
+    def->set_parser_name(StrCat("synthetic_", SimpleItoa(i)));
+    def->set_url_regexp("^http://synthetic\\.example\\.com/");
+
+    QueryGroupDef* group = def->add_query_group_defs();
+    group->set_name("record");
+    group->set_root_query("//div[@id='records']/div[@class='record']");
+    QueryDef* link = group->add_query_defs();
+    link->set_name("link");
+    link->set_query("/a/@href");
+    QueryDef* name = group->add_query_defs();
+    name->set_name("name");
+    name->set_query("/span[@class='name']");
+
+    RelationTemplate* tmpl = def->add_relation_tmpls();
+    tmpl->set_subject("%record.link%");
+    tmpl->set_predicate("name");
+    tmpl->set_object("%record.name%");
+    tmpl->set_subject_cardinality(RelationTemplate::MANY);
+    tmpl->set_object_cardinality(RelationTemplate::MANY);
+  }
+}
+
+void GenerateDispatchParserDefs(int num_parsers, XpafParserDefs* parser_defs) {
+  parser_defs->Clear();
+  for (int i = 0; i < num_parsers; ++i) {
+    const string index = SimpleItoa(i);
+    XpafParserDef* def = parser_defs->add_parser_defs();
+    def->set_parser_name(StrCat("site_", index));
+    def->set_url_regexp(StrCat("^http://(?:[^/]+\\.)?site", index,
+                               "\\.com/"));
+    RelationTemplate* tmpl = def->add_relation_tmpls();
+    tmpl->set_subject("%url%");
+    tmpl->set_predicate("title");
+    tmpl->set_object("//title");
+    tmpl->set_subject_cardinality(RelationTemplate::ONE);
+    tmpl->set_object_cardinality(RelationTemplate::ONE);
+  }
+}
+
+void GenerateDispatchUrls(int num_parsers, int num_urls,
+                          double match_fraction, uint32 seed,
+                          vector<string>* urls) {
+  Lcg lcg(seed);
+  const uint32 match_threshold = static_cast<uint32>(match_fraction * 65536);
+  urls->clear();
+  for (int i = 0; i < num_urls; ++i) {
+    const bool match = (lcg.Next() & 0xffff) < match_threshold;
+    const string page = StrCat(kWords[lcg.Next() % arraysize(kWords)], "/",
+                               SimpleItoa(lcg.Next() % 1000));
+    if (match && num_parsers > 0) {
+      const int site = lcg.Next() % num_parsers;
+      urls->push_back(StrCat("http://www.site", SimpleItoa(site), ".com/",
+                             page));
+    } else {
+      urls->push_back(StrCat("http://www.", kWords[lcg.Next() %
+                                                   arraysize(kWords)],
+                             SimpleItoa(lcg.Next() % 10000), ".org/", page));
+    }
+  }
+}
+
+}  // namespace xpaf
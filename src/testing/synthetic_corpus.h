@@ -0,0 +1,96 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Deterministic generator of synthetic HTML documents and matching parser
+// defs, for measuring how parsing cost scales with document size, DOM depth,
+// record count, attribute density, and number of parsers.
+//
+// A generated page looks like:
+//
+//   <html><head><title>...</title></head><body>
+//   <div class="wrap"> ... (nesting_depth wrappers)
+//     <div id="records">
+//       <div class="record">
+//         <a href="http://synthetic.example.com/r/0">link</a>
+//         <span class="name">name 0</span>
+//         <p>filler text</p>
+//       </div>
+//       ...
+//     </div>
+//   </div> ...
+//   </body></html>
+//
+// Every generated element also carries attrs_per_element filler attributes.
+// Each generated parser def has a QueryGroupDef over the records and emits
+// one {link, "name", name} relation per record, so parsing a page with all
+// parsers yields num_parsers * num_records relations.
+
+#ifndef XPAF_TESTING_SYNTHETIC_CORPUS_H_
+#define XPAF_TESTING_SYNTHETIC_CORPUS_H_
+
+#include <string>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/stl_decl.h"
+
+namespace xpaf {
+
+class XpafParserDefs;
+
+struct SyntheticCorpusOptions {
+  SyntheticCorpusOptions()
+      : num_records(10),
+        nesting_depth(1),
+        attrs_per_element(0),
+        filler_bytes_per_record(64),
+        num_parsers(1),
+        seed(1) {}
+
+  int num_records;              // records in the list
+  int nesting_depth;            // wrapper divs around the list
+  int attrs_per_element;        // filler attributes on each element
+  int filler_bytes_per_record;  // approximate bytes of filler text per record
+  int num_parsers;              // parser defs, all of which match the page
+  uint32 seed;                  // seeds the filler text
+};
+
+// The url of generated pages; matched by all generated parser defs.
+extern const char kSyntheticUrl[];
+
+// Returns a page as described above. The same options always produce the
+// same page.
+string GenerateSyntheticHtml(const SyntheticCorpusOptions& options);
+
+// Fills 'parser_defs' with options.num_parsers parser defs that extract one
+// relation per record from pages produced by GenerateSyntheticHtml().
+void GenerateSyntheticParserDefs(const SyntheticCorpusOptions& options,
+                                 XpafParserDefs* parser_defs);
+
+// For dispatch benchmarks: fills 'parser_defs' with 'num_parsers' parser defs
+// whose url_regexps each match one site, in the style of
+// "^http://(?:[^/]+\.)?site17\.com/".
+void GenerateDispatchParserDefs(int num_parsers, XpafParserDefs* parser_defs);
+
+// Fills 'urls' with 'num_urls' urls, about 'match_fraction' of which belong to
+// sites matched by GenerateDispatchParserDefs(num_parsers, ...), chosen
+// uniformly; the rest belong to sites no generated parser matches. The same
+// arguments always produce the same urls.
+void GenerateDispatchUrls(int num_parsers, int num_urls,
+                          double match_fraction, uint32 seed,
+                          vector<string>* urls);
+
+}  // namespace xpaf
+
+#endif  // XPAF_TESTING_SYNTHETIC_CORPUS_H_
@@ -15,9 +15,19 @@
 // To run benchmarks:
 // ./xpaf_bm
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <string>
 #include <vector>
 
+#include <libxml/HTMLparser.h>
+#include <libxml/xmlmemory.h>
+#include <libxml/xpath.h>
+#include <re2/re2.h>
+#include <re2/set.h>
+
+#include "base/alloc_counter.h"
 #include "base/benchmark.h"
 #include "base/commandlineflags.h"
 #include "base/file.h"
@@ -25,9 +35,22 @@
 #include "base/scoped_ptr.h"
 #include "base/stl_decl.h"
 #include "base/stl_util.h"
+#include "base/stringpiece.h"
 #include "base/strutil.h"
+#include "base/url.h"
+#include "base/webutil.h"
+#include "delta_sink.h"
 #include "document.h"
+#include "error_reporter.h"
+#include "parse_stats.pb.h"
 #include "parsed_document.pb.h"
+#include "parsed_document_encoder.h"
+#include "parser_snapshot.h"
+#include "post_processing_ops.pb.h"
+#include "query_runner.h"
+#include "relation_emitter.h"
+#include "relation_sink.h"
+#include "testing/synthetic_corpus.h"
 #include "util.h"
 #include "xpaf_parser.h"
 #include "xpaf_parser_def.pb.h"
@@ -45,8 +68,43 @@ DEFINE_string(test_srcdir, "./", "");
 namespace xpaf {
 namespace {
 
+using internal::AbsolutizeUrl;
+using internal::ApplyPostProcessingOp;
+using internal::EmitRelations;
+using internal::ParseErrorHandler;
+using internal::QueryResults;
+using internal::QueryRunner;
+
 const char* kDataDir = "/src/testing/xpaf_bm_data";
 
+// libxml2 allocators that report to AllocCounter, so that
+// --benchmark_alloc_stats covers DOM and XPath allocations too.
+void CountingXmlFree(void* ptr) {
+  AllocCounter::RecordFree(ptr);
+  free(ptr);
+}
+
+void* CountingXmlMalloc(size_t size) {
+  void* const ptr = malloc(size);
+  AllocCounter::RecordAlloc(ptr);
+  return ptr;
+}
+
+char* CountingXmlStrdup(const char* str) {
+  char* const copy = strdup(str);
+  AllocCounter::RecordAlloc(copy);
+  return copy;
+}
+
+// Installs the counting allocators before main(), since libxml2 must not
+// switch allocators once it has allocated memory.
+struct XmlAllocatorInstaller {
+  XmlAllocatorInstaller() {
+    CHECK_EQ(xmlMemSetup(&CountingXmlFree, &CountingXmlMalloc,
+                         &AllocCounter::Realloc, &CountingXmlStrdup), 0);
+  }
+} xml_allocator_installer;
+
 void BM_NewXPathWrapper(int iters) {
   StopBenchmarkTiming();
   File::Init();
@@ -90,7 +148,50 @@ void BM_XpafParserMasterCtor(int iters) {
 }
 BENCHMARK(BM_XpafParserMasterCtor);
 
-void BM_XpafParserMasterParse(int iters) {
+// Like BM_XpafParserMasterCtor, but with ParseOptions.lazy_init.
+void BM_XpafParserMasterCtorLazy(int iters) {
+  StopBenchmarkTiming();
+  File::Init();
+  const string data_dir = FLAGS_test_srcdir + kDataDir;
+
+  XpafParserDefs parser_defs;
+  ReadXpafParserDefs(data_dir + "/*.xpd", &parser_defs);
+  CHECK_GT(parser_defs.parser_defs_size(), 0) << "No parser defs found!";
+  ParseOptions opt;
+  opt.lazy_init = true;
+
+  StartBenchmarkTiming();
+  vector<string> names;
+  for (int i = 0; i < iters; ++i) {
+    const XpafParserMaster master(parser_defs, opt);
+    master.ParserNames(&names);
+  }
+}
+BENCHMARK(BM_XpafParserMasterCtorLazy);
+
+// Like BM_XpafParserMasterCtor, but reads parser defs as well, using
+// 'num_threads' threads for both reading and initialization.
+void BM_XpafParserMasterLoad(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  File::Init();
+  const string data_dir = FLAGS_test_srcdir + kDataDir;
+  ParseOptions opt;
+  opt.num_init_threads = num_threads;
+
+  StartBenchmarkTiming();
+  vector<string> names;
+  for (int i = 0; i < iters; ++i) {
+    XpafParserDefs parser_defs;
+    ReadXpafParserDefsParallel(data_dir + "/*.xpd", num_threads, &parser_defs);
+    const XpafParserMaster master(parser_defs, opt);
+    master.ParserNames(&names);
+  }
+}
+BENCHMARK_RANGE(BM_XpafParserMasterLoad, 1, 4);
+
+// Like BM_XpafParserMasterCtor, but loads the parser defs from an in-memory
+// parser snapshot.
+void BM_XpafParserMasterCtorFromSnapshot(int iters) {
   StopBenchmarkTiming();
   File::Init();
   const string data_dir = FLAGS_test_srcdir + kDataDir;
@@ -98,6 +199,32 @@ void BM_XpafParserMasterParse(int iters) {
   XpafParserDefs parser_defs;
   ReadXpafParserDefs(data_dir + "/*.xpd", &parser_defs);
   CHECK_GT(parser_defs.parser_defs_size(), 0) << "No parser defs found!";
+  CompiledXpafParserDefs compiled_defs;
+  XpafParserMaster(parser_defs, ParseOptions()).Compile(&compiled_defs);
+  string snapshot;
+  SerializeParserSnapshot(compiled_defs, &snapshot);
+
+  StartBenchmarkTiming();
+  vector<string> names;
+  for (int i = 0; i < iters; ++i) {
+    CHECK(ParseParserSnapshot(snapshot, &compiled_defs));
+    const XpafParserMaster master(&compiled_defs, ParseOptions());
+    master.ParserNames(&names);
+  }
+}
+BENCHMARK(BM_XpafParserMasterCtorFromSnapshot);
+
+// Reads our parser defs and documents. Caller takes ownership of the returned
+// strings and Documents.
+void ReadParserDefsAndDocs(XpafParserDefs* parser_defs,
+                           vector<string*>* url_vec,
+                           vector<string*>* content_vec,
+                           vector<Document*>* docs) {
+  File::Init();
+  const string data_dir = FLAGS_test_srcdir + kDataDir;
+
+  ReadXpafParserDefs(data_dir + "/*.xpd", parser_defs);
+  CHECK_GT(parser_defs->parser_defs_size(), 0) << "No parser defs found!";
 
   vector<string> http_files;
   if (!FLAGS_file_name.empty()) {
@@ -107,16 +234,22 @@ void BM_XpafParserMasterParse(int iters) {
   }
   CHECK(!http_files.empty()) << "No http files found!";
 
+  for (int i = 0; i < http_files.size(); ++i) {
+    url_vec->push_back(new string());
+    content_vec->push_back(new string());
+    docs->push_back(MakeDocFromFile(http_files[i],
+                                    url_vec->back(),
+                                    content_vec->back()));
+  }
+}
+
+void BM_XpafParserMasterParse(int iters) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
   vector<string*> url_vec;
   vector<string*> content_vec;
   vector<Document*> docs;
-  for (int i = 0; i < http_files.size(); ++i) {
-    url_vec.push_back(new string());
-    content_vec.push_back(new string());
-    docs.push_back(MakeDocFromFile(http_files[i],
-                                   url_vec.back(),
-                                   content_vec.back()));
-  }
+  ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
 
   const XpafParserMaster master(parser_defs, ParseOptions());
 
@@ -134,5 +267,702 @@ void BM_XpafParserMasterParse(int iters) {
 }
 BENCHMARK(BM_XpafParserMasterParse);
 
+// Parser defs, documents, and master shared by the threads of
+// BM_XpafParserMasterParseThreaded. Never deleted.
+struct SharedParseState {
+  SharedParseState() {
+    ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
+    master.reset(new XpafParserMaster(parser_defs, ParseOptions()));
+  }
+
+  XpafParserDefs parser_defs;
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  scoped_ptr<const XpafParserMaster> master;
+};
+
+// Like BM_XpafParserMasterParse, but with all threads parsing through one
+// shared master, to show how parsing scales with the number of cores.
+void BM_XpafParserMasterParseThreaded(int iters) {
+  StopBenchmarkTiming();
+  static const SharedParseState* const state = new SharedParseState;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < state->docs.size(); ++j) {
+      ParsedDocument parsed_doc;
+      state->master->ParseDocument(*state->docs[j], &parsed_doc);
+    }
+  }
+  SetBenchmarkItemsProcessed(iters * state->docs.size());
+}
+BENCHMARK(BM_XpafParserMasterParseThreaded)->ThreadRange(1, NumCPUs());
+
+// Like BM_XpafParserMasterParse, but also collects ParseStats.
+void BM_XpafParserMasterParseWithStats(int iters) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
+
+  const XpafParserMaster master(parser_defs, ParseOptions());
+
+  StartBenchmarkTiming();
+  ParseStats stats;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      ParsedDocument parsed_doc;
+      master.ParseDocument(*docs[j], &parsed_doc, &stats);
+    }
+  }
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_XpafParserMasterParseWithStats);
+
+// Like BM_XpafParserMasterParse, but computes a delta against the output of an
+// identical earlier parse, so the difference is the cost of fingerprinting
+// and matching every relation.
+void BM_XpafParserMasterParseDelta(int iters) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
+
+  const XpafParserMaster master(parser_defs, ParseOptions());
+  vector<RelationFingerprints> previous(docs.size());
+  for (int j = 0; j < docs.size(); ++j) {
+    ParsedDocument parsed_doc;
+    master.ParseDocument(*docs[j], &parsed_doc);
+    ComputeRelationFingerprints(parsed_doc, &previous[j]);
+  }
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      ParsedDocument delta;
+      master.ParseDocumentDelta(*docs[j], previous[j], &delta, NULL);
+    }
+  }
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_XpafParserMasterParseDelta);
+
+// Produces serialized ParsedDocuments by building the message tree and then
+// calling SerializeToString(). Compare with BM_ParsedDocumentEncode.
+void BM_ParsedDocumentBuildAndSerialize(int iters) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
+
+  const XpafParserMaster master(parser_defs, ParseOptions());
+
+  StartBenchmarkTiming();
+  string bytes;
+  int64 total_bytes = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      ParsedDocument parsed_doc;
+      master.ParseDocument(*docs[j], &parsed_doc);
+      parsed_doc.SerializeToString(&bytes);
+      total_bytes += bytes.size();
+    }
+  }
+  SetBenchmarkBytesProcessed(total_bytes);
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_ParsedDocumentBuildAndSerialize);
+
+// Produces serialized ParsedDocuments with ParsedDocumentEncoder.
+void BM_ParsedDocumentEncode(int iters) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadParserDefsAndDocs(&parser_defs, &url_vec, &content_vec, &docs);
+
+  const XpafParserMaster master(parser_defs, ParseOptions());
+
+  StartBenchmarkTiming();
+  string bytes;
+  ParsedDocumentEncoder encoder(&bytes, false);
+  int64 total_bytes = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      master.ParseDocument(*docs[j], &encoder);
+      total_bytes += bytes.size();
+    }
+  }
+  SetBenchmarkBytesProcessed(total_bytes);
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_ParsedDocumentEncode);
+
+// Per-stage benchmarks. Each one isolates a single step of
+// XpafParserMaster::ParseDocument(), run over the parse_test_data fixtures.
+
+const char* kParseTestDataDir = "/src/testing/parse_test_data";
+
+// A parse_test_data fixture: a document and the parser defs for it.
+struct Fixture {
+  string url;
+  string content;
+  scoped_ptr<Document> doc;
+  XpafParserDefs parser_defs;
+};
+
+// Reads parse_test_data/<name>.{http,xpd} into 'fixture'.
+void ReadFixture(const string& name, Fixture* fixture) {
+  File::Init();
+  const string path = FLAGS_test_srcdir + kParseTestDataDir + "/" + name;
+  fixture->doc.reset(
+      MakeDocFromFile(path + ".http", &fixture->url, &fixture->content));
+  ReadXpafParserDefs(path + ".xpd", &fixture->parser_defs);
+  CHECK_GT(fixture->parser_defs.parser_defs_size(), 0) << path;
+}
+
+// Reads all parse_test_data documents. Caller takes ownership of the returned
+// strings and Documents.
+void ReadFixtureDocs(vector<string*>* url_vec,
+                     vector<string*>* content_vec,
+                     vector<Document*>* docs) {
+  File::Init();
+  vector<string> http_files;
+  File::Match(FLAGS_test_srcdir + kParseTestDataDir + "/*.http", &http_files);
+  CHECK_GT(http_files.size(), 0) << "No documents found!";
+  for (int i = 0; i < http_files.size(); ++i) {
+    url_vec->push_back(new string());
+    content_vec->push_back(new string());
+    docs->push_back(MakeDocFromFile(http_files[i], url_vec->back(),
+                                    content_vec->back()));
+  }
+}
+
+// Returns the QueryDef named 'name' in 'parser_defs'.
+const QueryDef& FindQueryDef(const XpafParserDefs& parser_defs,
+                             const string& name) {
+  for (int i = 0; i < parser_defs.parser_defs_size(); ++i) {
+    const XpafParserDef& def = parser_defs.parser_defs(i);
+    for (int j = 0; j < def.query_defs_size(); ++j) {
+      if (def.query_defs(j).name() == name) return def.query_defs(j);
+    }
+  }
+  LOG(FATAL) << "No QueryDef named " << name;
+  return QueryDef::default_instance();
+}
+
+// Counts relations without storing them, so that BM_EmitRelations measures
+// only the emission itself.
+class CountingSink : public RelationSink {
+ public:
+  CountingSink() : num_relations_(0) {}
+
+  virtual void BeginParser(const StringPiece& parser_name) {}
+  virtual void AddRelation(const RelationView& relation) { ++num_relations_; }
+  virtual void EndParser() {}
+
+  int num_relations() const { return num_relations_; }
+
+ private:
+  int num_relations_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingSink);
+};
+
+void BM_SkipHttpHeaders(int iters) {
+  StopBenchmarkTiming();
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadFixtureDocs(&url_vec, &content_vec, &docs);
+  // Not every fixture has HTTP headers.
+  int num_with_headers = 0;
+  for (int j = 0; j < docs.size(); ++j) {
+    const StringPiece content = docs[j]->content();
+    if (HTTPUtils::SkipHttpHeaders(content.data(), content.size()) != NULL) {
+      ++num_with_headers;
+    }
+  }
+
+  StartBenchmarkTiming();
+  int64 total_bytes = 0;
+  int num_found = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      const StringPiece content = docs[j]->content();
+      if (HTTPUtils::SkipHttpHeaders(content.data(), content.size()) != NULL) {
+        ++num_found;
+      }
+      total_bytes += content.size();
+    }
+  }
+  StopBenchmarkTiming();
+  CHECK_EQ(num_found, iters * num_with_headers);
+  SetBenchmarkBytesProcessed(total_bytes);
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_SkipHttpHeaders);
+
+// Builds and frees the DOM, with the options NewXPathWrapper() uses.
+void BM_HtmlReadMemory(int iters) {
+  StopBenchmarkTiming();
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadFixtureDocs(&url_vec, &content_vec, &docs);
+
+  StartBenchmarkTiming();
+  int64 total_bytes = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < docs.size(); ++j) {
+      const StringPiece content = docs[j]->content();
+      const xmlDocPtr doc = htmlReadMemory(
+          content.data(), content.size(), url_vec[j]->c_str(),
+          NULL /* encoding */,
+          HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
+      xmlFreeDoc(doc);
+      total_bytes += content.size();
+    }
+  }
+  SetBenchmarkBytesProcessed(total_bytes);
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_HtmlReadMemory);
+
+// Evaluates a single standalone query, including result extraction.
+void BM_XPathEvalStandalone(int iters) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture("simple", &fixture);
+  const QueryDef& query_def =
+      FindQueryDef(fixture.parser_defs, "friend_name");
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const StringPiece url(fixture.url);
+  const ParseErrorHandler error_handler("bm", url, EHM_IGNORE, NULL);
+  const QueryRunner query_runner(url, *wrapper, error_handler, 0, NULL);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    QueryResults results;
+    query_runner.RunStandaloneQuery(query_def, &results);
+  }
+}
+BENCHMARK(BM_XPathEvalStandalone);
+
+// Evaluates a QueryGroupDef: the root query plus one query per root node for
+// each of its QueryDefs.
+void BM_XPathEvalGrouped(int iters) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture("query_group_def", &fixture);
+  const QueryGroupDef& group_def =
+      fixture.parser_defs.parser_defs(0).query_group_defs(0);
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const StringPiece url(fixture.url);
+  const ParseErrorHandler error_handler("bm", url, EHM_IGNORE, NULL);
+  const QueryRunner query_runner(url, *wrapper, error_handler, 0, NULL);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    vector<QueryResults> results(group_def.query_defs_size());
+    vector<QueryResults*> results_vec;
+    for (int j = 0; j < results.size(); ++j) {
+      results_vec.push_back(&results[j]);
+    }
+    query_runner.RunGroupedQueries(group_def, &results_vec);
+  }
+}
+BENCHMARK(BM_XPathEvalGrouped);
+
+// Extracts the text of each table cell, as QueryRunner does for element
+// results.
+void BM_XmlNodeGetContent(int iters) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture("query_group_def", &fixture);
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const xmlXPathObjectPtr xpath_obj = wrapper->EvalExpressionOrDie("//td");
+  CHECK_EQ(XPATH_NODESET, xpath_obj->type);
+  const xmlNodeSetPtr nodes = xpath_obj->nodesetval;
+  CHECK(nodes != NULL && nodes->nodeNr > 0);
+
+  StartBenchmarkTiming();
+  int64 total_bytes = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < nodes->nodeNr; ++j) {
+      xmlChar* content = xmlNodeGetContent(nodes->nodeTab[j]);
+      total_bytes += xmlStrlen(content);
+      xmlFree(content);
+    }
+  }
+  StopBenchmarkTiming();
+  SetBenchmarkItemsProcessed(iters * nodes->nodeNr);
+  SetBenchmarkBytesProcessed(total_bytes);
+  xmlXPathFreeObject(xpath_obj);
+}
+BENCHMARK(BM_XmlNodeGetContent);
+
+// Applies the first post-processing op of QueryDef 'query_name' from
+// fixture 'fixture_name' to that query's raw result.
+void RunPostProcessingOp(int iters,
+                         const string& fixture_name,
+                         const string& query_name) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture(fixture_name, &fixture);
+  QueryDef query_def = FindQueryDef(fixture.parser_defs, query_name);
+  CHECK_GT(query_def.post_processing_ops_size(), 0) << query_name;
+  const PostProcessingOp op = query_def.post_processing_ops(0);
+  query_def.clear_post_processing_ops();
+
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const StringPiece url(fixture.url);
+  const ParseErrorHandler error_handler("bm", url, EHM_IGNORE, NULL);
+  const QueryRunner query_runner(url, *wrapper, error_handler, 0, NULL);
+  QueryResults raw_results;
+  query_runner.RunStandaloneQuery(query_def, &raw_results);
+  CHECK_GT(raw_results.size(), 0) << query_name;
+
+  StartBenchmarkTiming();
+  string result;
+  string scratch;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < raw_results.size(); ++j) {
+      result = raw_results[j].first;
+      ApplyPostProcessingOp(op, &result, &scratch);
+    }
+  }
+  StopBenchmarkTiming();
+  SetBenchmarkItemsProcessed(iters * raw_results.size());
+}
+
+void BM_PostProcessingReplaceOp(int iters) {
+  RunPostProcessingOp(iters, "replace_op", "occ_replace_first_e_char");
+}
+BENCHMARK(BM_PostProcessingReplaceOp);
+
+void BM_PostProcessingReplaceOpGlobal(int iters) {
+  RunPostProcessingOp(iters, "replace_op", "occ_replace_all_e_chars");
+}
+BENCHMARK(BM_PostProcessingReplaceOpGlobal);
+
+void BM_PostProcessingExtractOp(int iters) {
+  RunPostProcessingOp(iters, "extract_op", "friend_occupation_first_char");
+}
+BENCHMARK(BM_PostProcessingExtractOp);
+
+// Absolutizes the fixture's raw link hrefs against the document url.
+void BM_AbsolutizeUrl(int iters) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture("query_group_def", &fixture);
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const xmlXPathObjectPtr xpath_obj = wrapper->EvalExpressionOrDie("//@href");
+  CHECK_EQ(XPATH_NODESET, xpath_obj->type);
+  const xmlNodeSetPtr nodes = xpath_obj->nodesetval;
+  CHECK(nodes != NULL && nodes->nodeNr > 0);
+  vector<string> hrefs;
+  for (int i = 0; i < nodes->nodeNr; ++i) {
+    xmlChar* content = xmlNodeGetContent(nodes->nodeTab[i]);
+    hrefs.push_back(reinterpret_cast<const char*>(content));
+    xmlFree(content);
+  }
+  xmlXPathFreeObject(xpath_obj);
+  const URL base_url(fixture.url);
+
+  StartBenchmarkTiming();
+  string absolute_url;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < hrefs.size(); ++j) {
+      AbsolutizeUrl(hrefs[j], base_url, &absolute_url);
+    }
+  }
+  StopBenchmarkTiming();
+  SetBenchmarkItemsProcessed(iters * hrefs.size());
+}
+BENCHMARK(BM_AbsolutizeUrl);
+
+// Computes the number of relations for a MANY-to-MANY template and emits
+// them, given query results computed up front.
+void BM_EmitRelations(int iters) {
+  StopBenchmarkTiming();
+  Fixture fixture;
+  ReadFixture("query_group_def", &fixture);
+  const XpafParserDef& parser_def = fixture.parser_defs.parser_defs(0);
+  const QueryGroupDef& group_def = parser_def.query_group_defs(0);
+  const RelationTemplate& rel_tmpl = parser_def.relation_tmpls(0);
+  scoped_ptr<XPathWrapper> wrapper(XPathWrapper::NewXPathWrapper(
+      fixture.url, fixture.content, CONTENT_TYPE_HTML));
+  const StringPiece url(fixture.url);
+  const ParseErrorHandler error_handler("bm", url, EHM_IGNORE, NULL);
+  const QueryRunner query_runner(url, *wrapper, error_handler, 0, NULL);
+  vector<QueryResults> results(group_def.query_defs_size());
+  vector<QueryResults*> results_vec;
+  for (int i = 0; i < results.size(); ++i) {
+    results_vec.push_back(&results[i]);
+  }
+  query_runner.RunGroupedQueries(group_def, &results_vec);
+  const vector<const QueryResults*> annotation_results_vec;
+
+  StartBenchmarkTiming();
+  CountingSink sink;
+  for (int i = 0; i < iters; ++i) {
+    EmitRelations(error_handler, rel_tmpl, 0, results[0], results[1],
+                  annotation_results_vec, &sink, NULL);
+  }
+  StopBenchmarkTiming();
+  CHECK_GT(sink.num_relations(), 0);
+  SetBenchmarkItemsProcessed(sink.num_relations());
+}
+BENCHMARK(BM_EmitRelations);
+
+// Serializes prebuilt ParsedDocuments for all fixtures. Compare with
+// BM_ParsedDocumentBuildAndSerialize, which includes parsing.
+void BM_ParsedDocumentSerialize(int iters) {
+  StopBenchmarkTiming();
+  vector<string*> url_vec;
+  vector<string*> content_vec;
+  vector<Document*> docs;
+  ReadFixtureDocs(&url_vec, &content_vec, &docs);
+  XpafParserDefs parser_defs;
+  ReadXpafParserDefs(FLAGS_test_srcdir + kParseTestDataDir + "/*.xpd",
+                     &parser_defs);
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  const XpafParserMaster master(parser_defs, opt);
+  vector<ParsedDocument> parsed_docs(docs.size());
+  for (int i = 0; i < docs.size(); ++i) {
+    master.ParseDocument(*docs[i], &parsed_docs[i]);
+  }
+
+  StartBenchmarkTiming();
+  string bytes;
+  int64 total_bytes = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < parsed_docs.size(); ++j) {
+      parsed_docs[j].SerializeToString(&bytes);
+      total_bytes += bytes.size();
+    }
+  }
+  SetBenchmarkBytesProcessed(total_bytes);
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&content_vec);
+  STLDeleteElements(&url_vec);
+}
+BENCHMARK(BM_ParsedDocumentSerialize);
+
+// Parses a synthetic page generated with 'options' using all of the matching
+// generated parsers.
+void RunSyntheticParse(int iters, const SyntheticCorpusOptions& options) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  GenerateSyntheticParserDefs(options, &parser_defs);
+  const string content = GenerateSyntheticHtml(options);
+  Document doc;
+  doc.Init(kSyntheticUrl, content, CONTENT_TYPE_HTML);
+
+  const XpafParserMaster master(parser_defs, ParseOptions());
+
+  StartBenchmarkTiming();
+  int64 num_relations = 0;
+  for (int i = 0; i < iters; ++i) {
+    ParsedDocument parsed_doc;
+    master.ParseDocument(doc, &parsed_doc);
+    for (int j = 0; j < parsed_doc.parser_outputs_size(); ++j) {
+      num_relations += parsed_doc.parser_outputs(j).relations_size();
+    }
+  }
+  StopBenchmarkTiming();
+  CHECK_EQ(num_relations, static_cast<int64>(iters) * options.num_parsers *
+           options.num_records);
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * content.size());
+  SetBenchmarkItemsProcessed(num_relations);
+}
+
+// Scales the number of records extracted by a QueryGroupDef.
+void BM_SyntheticRecords(int iters, int num_records) {
+  SyntheticCorpusOptions options;
+  options.num_records = num_records;
+  RunSyntheticParse(iters, options);
+}
+BENCHMARK_RANGE(BM_SyntheticRecords, 16, 128 << 10);
+
+// Scales the depth of the DOM above the records.
+void BM_SyntheticNesting(int iters, int nesting_depth) {
+  SyntheticCorpusOptions options;
+  options.num_records = 100;
+  options.nesting_depth = nesting_depth;
+  RunSyntheticParse(iters, options);
+}
+BENCHMARK_RANGE(BM_SyntheticNesting, 1, 128);
+
+// Scales the number of attributes on every element.
+void BM_SyntheticAttributes(int iters, int attrs_per_element) {
+  SyntheticCorpusOptions options;
+  options.num_records = 100;
+  options.attrs_per_element = attrs_per_element;
+  RunSyntheticParse(iters, options);
+}
+BENCHMARK_RANGE(BM_SyntheticAttributes, 1, 64);
+
+// Scales the number of parsers that match the page.
+void BM_SyntheticParsers(int iters, int num_parsers) {
+  SyntheticCorpusOptions options;
+  options.num_records = 100;
+  options.num_parsers = num_parsers;
+  RunSyntheticParse(iters, options);
+}
+BENCHMARK_RANGE(BM_SyntheticParsers, 1, 64);
+
+// Dispatch benchmarks: finding the parsers whose url_regexp matches each url
+// in a stream of kNumDispatchUrls urls, for 100 to 12800 parsers.
+// kDispatchMatchFraction of the urls belong to some parser's site.
+
+const int kNumDispatchUrls = 1000;
+const double kDispatchMatchFraction = 0.2;
+
+// Matches each url against every parser's url_regexp in turn, as
+// XpafParserMaster::ParseDocument() does.
+void BM_DispatchLinearScan(int iters, int num_parsers) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  GenerateDispatchParserDefs(num_parsers, &parser_defs);
+  vector<string> urls;
+  GenerateDispatchUrls(num_parsers, kNumDispatchUrls, kDispatchMatchFraction,
+                       1, &urls);
+  ParseOptions opt;
+  opt.lazy_init = true;
+  vector<XpafParser*> parsers;
+  for (int i = 0; i < parser_defs.parser_defs_size(); ++i) {
+    parsers.push_back(new XpafParser());
+    parsers.back()->Init(parser_defs.parser_defs(i), opt);
+  }
+
+  StartBenchmarkTiming();
+  int64 num_matches = 0;
+  vector<const XpafParser*> relevant_parsers;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < urls.size(); ++j) {
+      relevant_parsers.clear();
+      for (int k = 0; k < parsers.size(); ++k) {
+        if (parsers[k]->ShouldParse(urls[j])) {
+          relevant_parsers.push_back(parsers[k]);
+        }
+      }
+      num_matches += relevant_parsers.size();
+    }
+  }
+  StopBenchmarkTiming();
+  CHECK_GT(num_matches, 0);
+  SetBenchmarkItemsProcessed(iters * urls.size());
+
+  STLDeleteElements(&parsers);
+}
+BENCHMARK_RANGE(BM_DispatchLinearScan, 100, 12800);
+
+// Like BM_DispatchLinearScan, but matches all url_regexps at once with an
+// RE2::Set, which XpafParserMaster could use as an index.
+void BM_DispatchRE2Set(int iters, int num_parsers) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  GenerateDispatchParserDefs(num_parsers, &parser_defs);
+  vector<string> urls;
+  GenerateDispatchUrls(num_parsers, kNumDispatchUrls, kDispatchMatchFraction,
+                       1, &urls);
+  RE2::Options options;
+  options.set_max_mem(1 << 30);
+  RE2::Set url_regexps(options, RE2::UNANCHORED);
+  for (int i = 0; i < parser_defs.parser_defs_size(); ++i) {
+    string error;
+    CHECK_EQ(i, url_regexps.Add(parser_defs.parser_defs(i).url_regexp(),
+                                &error)) << error;
+  }
+  CHECK(url_regexps.Compile());
+
+  // Each url on site N should match just parser N's url_regexp.
+  static const RE2 site_re("^http://www\\.site(\\d+)\\.com/");
+  vector<int> matches;
+  for (int j = 0; j < urls.size(); ++j) {
+    url_regexps.Match(urls[j], &matches);
+    int site;
+    if (RE2::PartialMatch(urls[j], site_re, &site)) {
+      CHECK_EQ(1, matches.size()) << urls[j];
+      CHECK_EQ(site, matches[0]) << urls[j];
+    } else {
+      CHECK_EQ(0, matches.size()) << urls[j];
+    }
+  }
+
+  StartBenchmarkTiming();
+  int64 num_matches = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < urls.size(); ++j) {
+      url_regexps.Match(urls[j], &matches);
+      num_matches += matches.size();
+    }
+  }
+  StopBenchmarkTiming();
+  CHECK_GT(num_matches, 0);
+  SetBenchmarkItemsProcessed(iters * urls.size());
+}
+BENCHMARK_RANGE(BM_DispatchRE2Set, 100, 12800);
+
+// XpafParserMaster::ShouldParse(), which stops at the first matching parser.
+void BM_DispatchMasterShouldParse(int iters, int num_parsers) {
+  StopBenchmarkTiming();
+  XpafParserDefs parser_defs;
+  GenerateDispatchParserDefs(num_parsers, &parser_defs);
+  vector<string> urls;
+  GenerateDispatchUrls(num_parsers, kNumDispatchUrls, kDispatchMatchFraction,
+                       1, &urls);
+  ParseOptions opt;
+  opt.lazy_init = true;
+  const XpafParserMaster master(parser_defs, opt);
+
+  StartBenchmarkTiming();
+  int64 num_should_parse = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < urls.size(); ++j) {
+      if (master.ShouldParse(urls[j])) ++num_should_parse;
+    }
+  }
+  StopBenchmarkTiming();
+  CHECK_GT(num_should_parse, 0);
+  SetBenchmarkItemsProcessed(iters * urls.size());
+}
+BENCHMARK_RANGE(BM_DispatchMasterShouldParse, 100, 12800);
+
 }  // namespace
 }  // namespace xpaf
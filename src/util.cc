@@ -19,9 +19,12 @@
 
 #include <google/protobuf/text_format.h>
 
+#include "base/callback.h"
 #include "base/file.h"
 #include "base/logging.h"
 #include "base/stl_decl.h"
+#include "base/stl_util.h"
+#include "base/thread_pool.h"
 #include "document.h"
 #include "xpaf_parser_def.pb.h"
 
@@ -45,16 +48,59 @@ Document* MakeDocFromFile(const string& file_path,
   return doc;
 }
 
+namespace {
+
+void MergeXpafParserDefsFromFile(const string* file_path,
+                                 XpafParserDefs* parser_defs) {
+  string parser_defs_str;
+  File::ReadFileToStringOrDie(*file_path, &parser_defs_str);
+  CHECK(google::protobuf::TextFormat::MergeFromString(parser_defs_str,
+                                                      parser_defs))
+      << *file_path << "\n" << parser_defs_str;
+}
+
+}  // namespace
+
 void ReadXpafParserDefs(const string& file_glob, XpafParserDefs* parser_defs) {
   vector<string> file_paths;
   CHECK(File::Match(file_glob, &file_paths)) << file_glob;
   for (int i = 0; i < file_paths.size(); ++i) {
-    string parser_defs_str;
-    File::ReadFileToStringOrDie(file_paths[i], &parser_defs_str);
-    CHECK(google::protobuf::TextFormat::MergeFromString(parser_defs_str,
-                                                        parser_defs))
-        << file_paths[i] << "\n" << parser_defs_str;
+    MergeXpafParserDefsFromFile(&file_paths[i], parser_defs);
+  }
+}
+
+void ReadXpafParserDefsParallel(const string& file_glob,
+                                int num_threads,
+                                XpafParserDefs* parser_defs) {
+  vector<string> file_paths;
+  CHECK(File::Match(file_glob, &file_paths)) << file_glob;
+  num_threads = min(num_threads, static_cast<int>(file_paths.size()));
+  if (num_threads <= 1) {
+    for (int i = 0; i < file_paths.size(); ++i) {
+      MergeXpafParserDefsFromFile(&file_paths[i], parser_defs);
+    }
+    return;
+  }
+
+  // Parse each file into its own proto, then merge them in file order.
+  vector<XpafParserDefs*> file_parser_defs(file_paths.size());
+  {
+    ThreadPool pool(num_threads);
+    for (int i = 0; i < file_paths.size(); ++i) {
+      file_parser_defs[i] = new XpafParserDefs();
+      // Qualified to avoid ADL picking up google::protobuf::NewCallback.
+      pool.Schedule(xpaf::NewCallback(
+          &MergeXpafParserDefsFromFile,
+          static_cast<const string*>(&file_paths[i]), file_parser_defs[i]));
+    }
+  }
+  for (int i = 0; i < file_parser_defs.size(); ++i) {
+    XpafParserDefs* defs = file_parser_defs[i];
+    for (int j = 0; j < defs->parser_defs_size(); ++j) {
+      parser_defs->add_parser_defs()->Swap(defs->mutable_parser_defs(j));
+    }
   }
+  STLDeleteElements(&file_parser_defs);
 }
 
 }  // namespace xpaf
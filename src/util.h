@@ -38,6 +38,13 @@ Document* MakeDocFromFile(const string& file_path,
 // cleared prior to merging.
 void ReadXpafParserDefs(const string& file_glob, XpafParserDefs* parser_defs);
 
+// Like ReadXpafParserDefs(), but reads and parses files using up to
+// 'num_threads' threads. Parser defs are merged in the same order as with
+// ReadXpafParserDefs().
+void ReadXpafParserDefsParallel(const string& file_glob,
+                                int num_threads,
+                                XpafParserDefs* parser_defs);
+
 }  // namespace xpaf
 
 #endif  // XPAF_UTIL_H_
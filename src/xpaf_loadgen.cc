@@ -0,0 +1,305 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a corpus of documents through one shared XpafParserMaster on
+// multiple threads, and reports throughput and latency.
+//
+// In closed-loop mode (the default), each thread parses the next document as
+// soon as it finishes the previous one, so the tool measures peak throughput.
+// In open-loop mode, documents arrive on a fixed schedule at --rate docs/s,
+// and each document's latency runs from its scheduled arrival, so queueing
+// delay is included once the threads can't keep up.
+//
+// Example:
+// ./xpaf_loadgen
+//      --input_glob='./testing/testdata/*.http'
+//      --parser_defs_glob='./testing/parser_defs/*.xpd'
+//      --num_threads=8 --duration_secs=30
+
+#include <stdio.h>
+#include <time.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/commandlineflags.h"
+#include "base/file.h"
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/scoped_ptr.h"
+#include "base/stl_decl.h"
+#include "base/stl_util.h"
+#include "base/thread_pool.h"
+#include "base/timer.h"
+#include "document.h"
+#include "error_reporter.h"
+#include "metrics.h"
+#include "parse_result_cache.h"
+#include "parsed_document.pb.h"
+#include "parser_snapshot.h"
+#include "util.h"
+#include "xpaf_parser.h"
+#include "xpaf_parser_def.pb.h"
+#include "xpaf_parser_master.h"
+
+DEFINE_string(input_glob, "",
+              "File pattern for input .http files. E.g., '/path/to/*.http'.");
+DEFINE_string(input_list, "",
+              "File listing input .http file paths, one per line, or '-' to "
+              "read the list from stdin. Used instead of --input_glob.");
+DEFINE_string(parser_defs_glob, "",
+              "File pattern for parser def files. E.g., '/path/to/*.xpd'.");
+DEFINE_string(parser_snapshot, "",
+              "Parser snapshot file written by compile_xpd. Used instead of "
+              "--parser_defs_glob.");
+DEFINE_int32(num_threads, 1, "Number of threads parsing documents.");
+DEFINE_double(rate, 0,
+              "If positive, run open-loop with documents arriving at this "
+              "many docs/s across all threads. Otherwise run closed-loop.");
+DEFINE_double(duration_secs, 10, "How long to generate load for.");
+DEFINE_int64(max_docs, 0,
+             "If positive, stop after parsing this many documents.");
+DEFINE_int32(num_init_threads, 1,
+             "Number of threads to use for reading and initializing parsers.");
+DEFINE_int64(time_budget_nanos, 0,
+             "Per-document parse time budget. Zero means no limit.");
+DEFINE_int64(max_xpath_ops, 0,
+             "Per-document XPath operation budget. Zero means no limit.");
+DEFINE_int64(result_cache_bytes, 0,
+             "If positive, parse through a ParseResultCache of this size.");
+DEFINE_bool(intern_strings, false,
+            "If true, we output relations with interned strings.");
+DEFINE_bool(print_histogram, true,
+            "If true, we also print the full latency histogram.");
+
+namespace xpaf {
+
+namespace {
+
+// Reads the paths of the input documents from --input_glob or --input_list.
+void GetInputFiles(vector<string>* files) {
+  CHECK_NE(FLAGS_input_glob.empty(), FLAGS_input_list.empty())
+      << "Exactly one of --input_glob, --input_list must be set";
+  if (!FLAGS_input_glob.empty()) {
+    CHECK(File::Match(FLAGS_input_glob, files))
+        << "No files match " << FLAGS_input_glob;
+    return;
+  }
+  string list;
+  if (FLAGS_input_list == "-") {
+    string line;
+    while (getline(std::cin, line)) {
+      if (!line.empty()) files->push_back(line);
+    }
+    return;
+  }
+  File::ReadFileToStringOrDie(FLAGS_input_list, &list);
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find('\n', start);
+    if (end == string::npos) end = list.size();
+    if (end > start) files->push_back(list.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+// Sleeps until MonotonicNanos() reaches 'nanos'.
+void SleepUntil(int64 nanos) {
+  struct timespec ts;
+  ts.tv_sec = nanos / 1000000000;
+  ts.tv_nsec = nanos % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+// Runs the load on a ThreadPool and accumulates the results.
+class LoadGenerator {
+ public:
+  // 'master' and 'docs' must outlive this object.
+  LoadGenerator(const XpafParserMaster& master, const vector<Document*>& docs)
+      : master_(master),
+        docs_(docs),
+        start_nanos_(0),
+        end_nanos_(0),
+        next_doc_(0),
+        num_docs_(0),
+        num_bytes_(0) {}
+
+  void Run() {
+    start_nanos_ = MonotonicNanos();
+    end_nanos_ = start_nanos_ +
+        static_cast<int64>(FLAGS_duration_secs * 1e9);
+    ThreadPool pool(FLAGS_num_threads);
+    for (int i = 0; i < FLAGS_num_threads; ++i) {
+      pool.Schedule(NewCallback(this, &LoadGenerator::WorkerLoop));
+    }
+    pool.Wait();
+    elapsed_nanos_ = MonotonicNanos() - start_nanos_;
+  }
+
+  void PrintReport() const;
+
+ private:
+  void WorkerLoop();
+
+  const XpafParserMaster& master_;
+  const vector<Document*>& docs_;
+  int64 start_nanos_;
+  int64 end_nanos_;
+  int64 elapsed_nanos_;
+
+  volatile int64 next_doc_;   // index of the next document to parse
+  volatile int64 num_docs_;   // documents parsed
+  volatile int64 num_bytes_;  // bytes of documents parsed
+  Histogram latency_nanos_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadGenerator);
+};
+
+void LoadGenerator::WorkerLoop() {
+  const bool open_loop = FLAGS_rate > 0;
+  while (true) {
+    const int64 index = Barrier_AtomicIncrement(&next_doc_, 1) - 1;
+    if (FLAGS_max_docs > 0 && index >= FLAGS_max_docs) break;
+    int64 arrival_nanos;
+    if (open_loop) {
+      arrival_nanos = start_nanos_ + static_cast<int64>(index * 1e9 /
+                                                        FLAGS_rate);
+      if (arrival_nanos >= end_nanos_) break;
+      SleepUntil(arrival_nanos);
+    } else {
+      arrival_nanos = MonotonicNanos();
+      if (arrival_nanos >= end_nanos_) break;
+    }
+
+    const Document& doc = *docs_[index % docs_.size()];
+    ParsedDocument parsed_doc;
+    master_.ParseDocument(doc, &parsed_doc);
+    latency_nanos_.Add(MonotonicNanos() - arrival_nanos);
+    NoBarrier_AtomicIncrement(&num_docs_, 1);
+    NoBarrier_AtomicIncrement(&num_bytes_,
+                              static_cast<int64>(doc.content().size()));
+  }
+}
+
+void LoadGenerator::PrintReport() const {
+  const double secs = elapsed_nanos_ / 1e9;
+  const int64 num_docs = NoBarrier_Load(&num_docs_);
+  const int64 num_bytes = NoBarrier_Load(&num_bytes_);
+  printf("mode: %s", FLAGS_rate > 0 ? "open-loop" : "closed-loop");
+  if (FLAGS_rate > 0) printf(" (target %.1f docs/s)", FLAGS_rate);
+  printf("\nthreads: %d\n", FLAGS_num_threads);
+  printf("docs: %lld in %.3f s\n",
+         static_cast<long long>(num_docs), secs);  // NOLINT
+  printf("throughput: %.1f docs/s, %.2f MB/s\n",
+         num_docs / secs, num_bytes / secs / 1e6);
+  if (num_docs == 0) return;
+  printf("latency (us): mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, "
+         "p999 %.1f\n",
+         latency_nanos_.Sum() / 1e3 / latency_nanos_.Count(),
+         latency_nanos_.Percentile(0.5) / 1e3,
+         latency_nanos_.Percentile(0.9) / 1e3,
+         latency_nanos_.Percentile(0.99) / 1e3,
+         latency_nanos_.Percentile(0.999) / 1e3);
+
+  if (!FLAGS_print_histogram) return;
+  vector<int64> counts;
+  latency_nanos_.BucketCounts(&counts);
+  int64 total = 0;
+  for (int i = 0; i < counts.size(); ++i) total += counts[i];
+  printf("latency histogram (us):\n");
+  int64 seen = 0;
+  for (int i = 0; i < counts.size(); ++i) {
+    if (counts[i] == 0) continue;
+    seen += counts[i];
+    printf("  [%12.1f, %12.1f) %10lld %6.2f%% %7.3f%%\n",
+           Histogram::BucketLowerBound(i) / 1e3,
+           Histogram::BucketUpperBound(i) / 1e3,
+           static_cast<long long>(counts[i]),  // NOLINT
+           100.0 * counts[i] / total, 100.0 * seen / total);
+  }
+}
+
+}  // namespace
+
+void Run() {
+  File::Init();
+
+  CHECK_GT(FLAGS_num_threads, 0);
+  CHECK_NE(FLAGS_parser_defs_glob.empty(), FLAGS_parser_snapshot.empty())
+      << "Exactly one of --parser_defs_glob, --parser_snapshot must be set";
+
+  ParseOptions opt;
+  opt.error_handling_mode = EHM_IGNORE;
+  opt.intern_strings = FLAGS_intern_strings;
+  opt.num_init_threads = FLAGS_num_init_threads;
+  opt.time_budget_nanos = FLAGS_time_budget_nanos;
+  opt.max_xpath_ops = FLAGS_max_xpath_ops;
+  scoped_ptr<ParseResultCache> result_cache;
+  if (FLAGS_result_cache_bytes > 0) {
+    result_cache.reset(new ParseResultCache(FLAGS_result_cache_bytes));
+    opt.result_cache = result_cache.get();
+  }
+
+  scoped_ptr<XpafParserMaster> master;
+  if (!FLAGS_parser_snapshot.empty()) {
+    CompiledXpafParserDefs compiled_defs;
+    ReadParserSnapshot(FLAGS_parser_snapshot, &compiled_defs);
+    master.reset(new XpafParserMaster(&compiled_defs, opt));
+  } else {
+    XpafParserDefs parser_defs;
+    ReadXpafParserDefsParallel(FLAGS_parser_defs_glob, FLAGS_num_init_threads,
+                               &parser_defs);
+    master.reset(new XpafParserMaster(parser_defs, opt));
+  }
+
+  vector<string> files;
+  GetInputFiles(&files);
+  CHECK(!files.empty()) << "No input files";
+  vector<string*> urls;
+  vector<string*> contents;
+  vector<Document*> docs;
+  for (int i = 0; i < files.size(); ++i) {
+    urls.push_back(new string());
+    contents.push_back(new string());
+    docs.push_back(MakeDocFromFile(files[i], urls.back(), contents.back()));
+  }
+  printf("corpus: %d docs\n", static_cast<int>(docs.size()));
+
+  LoadGenerator load_generator(*master, docs);
+  load_generator.Run();
+  load_generator.PrintReport();
+  if (result_cache != NULL) {
+    printf("result cache: %lld hits, %lld misses, %lld evictions\n",
+           static_cast<long long>(result_cache->hits()),         // NOLINT
+           static_cast<long long>(result_cache->misses()),       // NOLINT
+           static_cast<long long>(result_cache->evictions()));   // NOLINT
+  }
+  ErrorReporter::Global()->LogSummary();
+
+  STLDeleteElements(&docs);
+  STLDeleteElements(&contents);
+  STLDeleteElements(&urls);
+}
+
+}  // namespace xpaf
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  xpaf::Run();
+  return 0;
+}
@@ -12,8 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// Note: For now, we don't precompile regexps. Doing so might improve
-// performance, but we should profile first.
+// Note: Only the parser's url_regexp is precompiled (see url_regexp_).
+// Relation template url_regexps and post-processing op regexps are still
+// compiled on each use. Precompiling them might improve performance, but we
+// should profile first.
 
 // NOTE(sadovsky): Since RE2 defines its own StringPiece class, we must convert
 // our StringPieces to RE2::StringPieces. Annoying.
@@ -27,21 +29,32 @@
 #include <re2/re2.h>
 #include <re2/stringpiece.h>
 
+#include "base/atomicops.h"
+#include "base/hash.h"
 #include "base/logging.h"
+#include "base/mutex.h"
 #include "base/scoped_ptr.h"
 #include "base/stl_decl.h"
 #include "base/stl_util.h"
 #include "base/stringpiece.h"
 #include "base/strutil.h"
+#include "base/timer.h"
 #include "base/url.h"
+#include "error_reporter.h"
+#include "metrics.h"
+#include "parse_stats.pb.h"
 #include "parsed_document.pb.h"
 #include "post_processing_ops.pb.h"
 #include "query_runner.h"
+#include "relation_emitter.h"
+#include "relation_sink.h"
 #include "xpaf_parser_def.pb.h"
 #include "xpath_wrapper.h"
 
 namespace xpaf {
 
+using internal::EmitRelations;
+using internal::ParseErrorHandler;
 using internal::QueryRunner;
 
 namespace {
@@ -99,7 +112,11 @@ class QueryResultsCache {
   unordered_map<string, const QueryResults*> cache_;
 };
 
-XpafParser::XpafParser() : initialized_(false) {
+XpafParser::XpafParser()
+    : initialized_(false), queries_initialized_(false),
+      init_mu_(new Mutex), fingerprint_(0),
+      invocations_counter_(NULL), empty_invocations_counter_(NULL),
+      relations_counter_(NULL) {
 }
 
 XpafParser::~XpafParser() {
@@ -206,13 +223,9 @@ void XpafParser::ProcessReference(
   }
 }
 
-void XpafParser::Init(const XpafParserDef& parser_def,
-                      const ParseOptions& parse_options) {
-  CHECK(!initialized_) << kDoubleInitError;
-  VLOG(1) << "XpafParser[" << parser_def.parser_name() << "]::Init()";
-  parser_def_.CopyFrom(parser_def);
-  parse_options_ = parse_options;
-
+// Adds predefined queries and all QueryDefs (including grouped ones) from
+// parser_def_ to query_info_map_, checking their names along the way.
+void XpafParser::AddQueryDefsToQueryInfoMap() {
   // Add predefined queries to query_info_map_.
   CHECK(query_info_map_.empty());
   CHECK(query_info_map_.insert(make_pair(RefFromQueryName("url"),
@@ -246,6 +259,48 @@ void XpafParser::Init(const XpafParserDef& parser_def,
           << parser_def_.DebugString();
     }
   }
+}
+
+void XpafParser::Init(const XpafParserDef& parser_def,
+                      const ParseOptions& parse_options) {
+  CHECK(!initialized_) << kDoubleInitError;
+  VLOG(1) << "XpafParser[" << parser_def.parser_name() << "]::Init()";
+  parser_def_.CopyFrom(parser_def);
+  fingerprint_ = Hash64(parser_def_.SerializeAsString());
+  parse_options_ = parse_options;
+  InitUrlRegexp();
+  InitMetrics();
+  if (!parse_options_.lazy_init) {
+    InitQueries();
+  }
+  initialized_ = true;
+}
+
+// Compiles parser_def_.url_regexp, if any, so that ShouldParse() doesn't have
+// to.
+void XpafParser::InitUrlRegexp() {
+  if (parser_def_.has_url_regexp()) {
+    url_regexp_.reset(new RE2(parser_def_.url_regexp()));
+    CHECK(url_regexp_->ok()) << "Invalid url_regexp: "
+                             << parser_def_.url_regexp();
+  }
+}
+
+void XpafParser::InitMetrics() {
+  if (!parse_options_.record_metrics) return;
+  MetricsRegistry* registry = MetricsRegistry::Global();
+  const string prefix = StrCat("xpaf/parser/", parser_def_.parser_name(), "/");
+  invocations_counter_ = registry->GetCounter(prefix + "invocations");
+  empty_invocations_counter_ =
+      registry->GetCounter(prefix + "empty_invocations");
+  relations_counter_ = registry->GetCounter("xpaf/relations");
+}
+
+// Populates query_info_map_ and inlined_query_defs_ from parser_def_. Called
+// either by Init() or, with ParseOptions.lazy_init, by
+// EnsureQueriesInitialized() with init_mu_ held.
+void XpafParser::InitQueries() {
+  AddQueryDefsToQueryInfoMap();
 
   // Iterate through relevant fields in RelationTemplates and:
   //  * Make sure all references exist in query_info_map_.
@@ -272,9 +327,81 @@ void XpafParser::Init(const XpafParserDef& parser_def,
     }
   }
 
+  Release_Store(&queries_initialized_, true);
+}
+
+void XpafParser::EnsureQueriesInitialized() const {
+  if (Acquire_Load(&queries_initialized_)) return;
+  MutexLock l(init_mu_.get());
+  if (!queries_initialized_) {
+    VLOG(1) << "XpafParser[" << ParserName() << "]::InitQueries()";
+    // Safe: only reached once, under init_mu_, and no other method reads the
+    // query state until queries_initialized_ is set.
+    const_cast<XpafParser*>(this)->InitQueries();
+  }
+}
+
+void XpafParser::InitFromCompiled(CompiledXpafParserDef* compiled_def,
+                                  const ParseOptions& parse_options) {
+  CHECK(!initialized_) << kDoubleInitError;
+  VLOG(1) << "XpafParser[" << compiled_def->parser_def().parser_name()
+          << "]::InitFromCompiled()";
+  CHECK(compiled_def->has_fingerprint())
+      << "Compiled parser def has no fingerprint: "
+      << compiled_def->parser_def().parser_name();
+  parser_def_.Swap(compiled_def->mutable_parser_def());
+  fingerprint_ = compiled_def->fingerprint();
+  parse_options_ = parse_options;
+  InitUrlRegexp();
+  InitMetrics();
+
+  AddQueryDefsToQueryInfoMap();
+
+  for (int i = 0; i < compiled_def->inlined_query_defs_size(); ++i) {
+    QueryDef* query_def = new QueryDef();
+    query_def->Swap(compiled_def->mutable_inlined_query_defs(i));
+    inlined_query_defs_.push_back(query_def);
+    CHECK(query_info_map_.insert(
+        make_pair(RefFromQueryName(query_def->name()),
+                  new QueryInfo(query_def, NULL))).second)
+        << "Duplicate inlined query name: " << query_def->name();
+  }
+  compiled_def->Clear();
+
+  // Inlined queries have already been replaced by references, so this just
+  // validates references and adds literals to query_info_map_.
+  unordered_map<string, string> inlined_query_refs;
+  int num_inlined_queries = inlined_query_defs_.size();
+  for (int i = 0; i < parser_def_.relation_tmpls_size(); ++i) {
+    RelationTemplate* rel_tmpl = parser_def_.mutable_relation_tmpls(i);
+    ProcessReference(rel_tmpl->mutable_subject(),
+                     &num_inlined_queries, &inlined_query_refs);
+    ProcessReference(rel_tmpl->mutable_object(),
+                     &num_inlined_queries, &inlined_query_refs);
+    for (int j = 0; j < rel_tmpl->annotation_tmpls_size(); ++j) {
+      ProcessReference(rel_tmpl->mutable_annotation_tmpls(j)->mutable_value(),
+                       &num_inlined_queries, &inlined_query_refs);
+    }
+  }
+  CHECK_EQ(num_inlined_queries, inlined_query_defs_.size())
+      << "Compiled parser def has unprocessed inlined queries: "
+      << parser_def_.parser_name();
+
+  queries_initialized_ = true;
   initialized_ = true;
 }
 
+void XpafParser::Compile(CompiledXpafParserDef* compiled_def) const {
+  CHECK(initialized_) << kForgotInitError;
+  EnsureQueriesInitialized();
+  compiled_def->Clear();
+  compiled_def->mutable_parser_def()->CopyFrom(parser_def_);
+  for (int i = 0; i < inlined_query_defs_.size(); ++i) {
+    compiled_def->add_inlined_query_defs()->CopyFrom(*inlined_query_defs_[i]);
+  }
+  compiled_def->set_fingerprint(fingerprint_);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // ParserName() and ShouldParse()
@@ -284,12 +411,22 @@ string XpafParser::ParserName() const {
   return parser_def_.parser_name();
 }
 
+int XpafParser::Priority() const {
+  CHECK(initialized_) << kForgotInitError;
+  return parser_def_.priority();
+}
+
+uint64 XpafParser::Fingerprint() const {
+  CHECK(initialized_) << kForgotInitError;
+  return fingerprint_;
+}
+
 bool XpafParser::ShouldParse(const StringPiece& url) const {
   CHECK(initialized_) << kForgotInitError;
   VLOG(1) << "XpafParser[" << ParserName() << "]::ShouldParse(" << url << ")";
-  if (parser_def_.has_url_regexp() &&
+  if (url_regexp_ != NULL &&
       !RE2::PartialMatch(re2::StringPiece(url.data(), url.size()),
-                         parser_def_.url_regexp())) {
+                         *url_regexp_)) {
     VLOG(1) << "  => false";
     return false;
   }
@@ -303,124 +440,25 @@ bool XpafParser::ShouldParse(const StringPiece& url) const {
 
 namespace {
 
-void MaybeLogCardinalityOneError(const StringPiece& url,
-                                 const RelationTemplate& rel_tmpl,
-                                 const string& name,
-                                 int results_size,
-                                 ErrorHandlingMode error_handling_mode) {
-  if (results_size > 1) {
-    if (error_handling_mode >= EHM_LOG_ERROR) {
-      LOG(ERROR) << "Too many results for " << name
-                 << " (" << results_size << ")"
-                 << "\nurl: " << url
-                 << "\nrel_tmpl:\n" << rel_tmpl.DebugString();
-    }
-    if (error_handling_mode == EHM_ABORT_PROCESS) LOG(FATAL);
-  }
-}
+// Appends relations to a single ParserOutput. Used to implement the
+// ParserOutput flavor of XpafParser::Parse().
+class ParserOutputSink : public RelationSink {
+ public:
+  explicit ParserOutputSink(ParserOutput* output) : output_(output) {}
 
-void LogCardinalityManyError(const StringPiece& url,
-                             const RelationTemplate& rel_tmpl,
-                             const string& name,
-                             int results_size,
-                             int num_relations,
-                             ErrorHandlingMode error_handling_mode) {
-  if (error_handling_mode >= EHM_LOG_ERROR) {
-    LOG(ERROR) << name << " has cardinality MANY and " << results_size
-               << " results, but something else has cardinality MANY and "
-               << num_relations << " results"
-               << "\nurl: " << url
-               << "\nrel_tmpl:\n" << rel_tmpl.DebugString();
-  }
-  if (error_handling_mode == EHM_ABORT_PROCESS) LOG(FATAL);
-}
+  virtual void BeginParser(const StringPiece& parser_name) {}
 
-// Determines the number of relations to emit for the given RelationTemplate
-// given the result counts and cardinalities of subject, object, and annotation
-// values.
-//
-// The number of relations to emit is equal to the number of results in the
-// first cardinality-MANY query in {subject, object, annot_1, annot_2, ...},
-// with the following exceptions:
-//  * If either subject or object has cardinality ONE and num results != 1, no
-//    relations are emitted.
-//  * If subject and object both have cardinality MANY but have different
-//    numbers of results, no relations are emitted.
-//
-// Also, any annotation with cardinality ONE and num results != 1, or with
-// cardinality MANY and num results != num_relations (as determined above), will
-// be skipped (i.e. will not be emitted).
-//
-int ComputeNumRelations(
-    const StringPiece& url,
-    const RelationTemplate& rel_tmpl,
-    const QueryResults& subject_results,
-    const QueryResults& object_results,
-    const vector<const QueryResults*>& annotation_results_vec,
-    ErrorHandlingMode error_handling_mode,
-    vector<bool>* skip_annotation_vec) {
-  int num_relations = -1;
-  bool skip_relation = false;
-
-  if (rel_tmpl.subject_cardinality() == RelationTemplate::ONE) {
-    if (subject_results.size() != 1) {
-      MaybeLogCardinalityOneError(url, rel_tmpl, "subject",
-                                  subject_results.size(), error_handling_mode);
-      skip_relation = true;
-    }
-  } else {
-    num_relations = subject_results.size();
+  virtual void AddRelation(const RelationView& relation) {
+    RelationViewToProto(relation, output_->add_relations());
   }
 
-  if (rel_tmpl.object_cardinality() == RelationTemplate::ONE) {
-    if (object_results.size() != 1) {
-      MaybeLogCardinalityOneError(url, rel_tmpl, "object",
-                                  object_results.size(), error_handling_mode);
-      skip_relation = true;
-    }
-  } else {
-    if (num_relations == -1) {
-      num_relations = object_results.size();
-    } else if (num_relations != object_results.size()) {
-      LogCardinalityManyError(url, rel_tmpl, "object", object_results.size(),
-                              num_relations, error_handling_mode);
-      skip_relation = true;
-    }
-  }
+  virtual void EndParser() {}
 
-  for (int i = 0; i < annotation_results_vec.size(); ++i) {
-    const RelationTemplate::AnnotationTemplate& annotation_tmpl =
-        rel_tmpl.annotation_tmpls(i);
-    const int results_size = annotation_results_vec[i]->size();
-    const string pseudonym =
-        StrCat("annotation \"", annotation_tmpl.name(), "\"");
-    bool skip_annotation = false;
-
-    if (annotation_tmpl.value_cardinality() == RelationTemplate::ONE) {
-      if (results_size != 1) {
-        MaybeLogCardinalityOneError(url, rel_tmpl, pseudonym, results_size,
-                                    error_handling_mode);
-        skip_annotation = true;
-      }
-    } else {
-      if (num_relations == -1) {
-        num_relations = results_size;
-      } else if (num_relations != results_size) {
-        LogCardinalityManyError(url, rel_tmpl, pseudonym, results_size,
-                                num_relations, error_handling_mode);
-        skip_annotation = true;
-      }
-    }
-    skip_annotation_vec->push_back(skip_annotation);
-  }
+ private:
+  ParserOutput* const output_;
 
-  if (skip_relation) {
-    return 0;
-  } else if (num_relations == -1) {
-    num_relations = 1;
-  }
-  return num_relations;
-}
+  DISALLOW_COPY_AND_ASSIGN(ParserOutputSink);
+};
 
 }  // namespace
 
@@ -430,14 +468,16 @@ int ComputeNumRelations(
 // RelationTemplate.
 const QueryResults* XpafParser::GetQueryResults(
     const StringPiece& url, const QueryRunner& query_runner, const string& key,
-    QueryResultsCache* cache) const {
+    QueryResultsCache* cache, ParserStats* stats) const {
   DCHECK(!HasPrefixString(key, "/"))
       << "Inlined query should have been converted to a reference: " << key;
 
   const QueryResults* cached_results = cache->Get(key);
   if (cached_results != NULL) {
+    if (stats != NULL) stats->set_cache_hits(stats->cache_hits() + 1);
     return cached_results;
   }
+  if (stats != NULL) stats->set_cache_misses(stats->cache_misses() + 1);
 
   QueryResults* results = new QueryResults();
 
@@ -479,14 +519,40 @@ const QueryResults* XpafParser::GetQueryResults(
 void XpafParser::Parse(const StringPiece& url,
                        const XPathWrapper& xpath_wrapper,
                        ParserOutput* output) const {
+  ParserOutputSink sink(output);
+  Parse(url, xpath_wrapper, &sink);
+}
+
+void XpafParser::Parse(const StringPiece& url,
+                       const XPathWrapper& xpath_wrapper,
+                       RelationSink* sink) const {
+  Parse(url, xpath_wrapper, sink, NULL);
+}
+
+void XpafParser::Parse(const StringPiece& url,
+                       const XPathWrapper& xpath_wrapper,
+                       RelationSink* sink,
+                       ParserStats* stats) const {
   CHECK(initialized_) << kForgotInitError;
+  const int64 start_nanos = stats != NULL ? MonotonicNanos() : 0;
+  EnsureQueriesInitialized();
   VLOG(1) << "XpafParser[" << ParserName() << "]::Parse(" << url << ")";
   DCHECK(ShouldParse(url)) << url;
+  if (stats != NULL) {
+    stats->set_parser_name(parser_def_.parser_name());
+  }
 
   // First, create a QueryResultsCache and initialize QueryRunner.
   QueryResultsCache cache;
-  const QueryRunner query_runner(url, xpath_wrapper,
-                                 parse_options_.error_handling_mode);
+  const ParseErrorHandler error_handler(
+      parser_def_.parser_name(), url, parse_options_.error_handling_mode,
+      parse_options_.output_errors ? sink : NULL);
+  const QueryRunner query_runner(url, xpath_wrapper, error_handler,
+                                 parse_options_.max_results_per_query, stats);
+
+  sink->BeginParser(parser_def_.parser_name());
+
+  int num_output_relations = 0;
 
   for (int i = 0; i < parser_def_.relation_tmpls_size(); ++i) {
     const RelationTemplate& rel_tmpl = parser_def_.relation_tmpls(i);
@@ -495,69 +561,63 @@ void XpafParser::Parse(const StringPiece& url,
                            rel_tmpl.url_regexp())) {
       continue;
     }
+    if (xpath_wrapper.BudgetExhausted()) break;
 
     VLOG(1) << "Processing template:\n" << rel_tmpl.DebugString();
+    RelationTemplateStats* rel_tmpl_stats = NULL;
+    int64 rel_tmpl_start_nanos = 0;
+    if (stats != NULL) {
+      rel_tmpl_stats = stats->add_relation_tmpl_stats();
+      rel_tmpl_stats->set_index(i);
+      rel_tmpl_start_nanos = MonotonicNanos();
+    }
+
     const QueryResults& subject_results =
-        *GetQueryResults(url, query_runner, rel_tmpl.subject(), &cache);
+        *GetQueryResults(url, query_runner, rel_tmpl.subject(), &cache, stats);
     const QueryResults& object_results =
-        *GetQueryResults(url, query_runner, rel_tmpl.object(), &cache);
+        *GetQueryResults(url, query_runner, rel_tmpl.object(), &cache, stats);
 
     vector<const QueryResults*> annotation_results_vec;
     for (int j = 0; j < rel_tmpl.annotation_tmpls_size(); ++j) {
       annotation_results_vec.push_back(
           GetQueryResults(url, query_runner,
-                          rel_tmpl.annotation_tmpls(j).value(), &cache));
+                          rel_tmpl.annotation_tmpls(j).value(), &cache, stats));
     }
 
-    vector<bool> skip_annotation_vec;
-    const int num_relations =
-        ComputeNumRelations(url, rel_tmpl, subject_results, object_results,
-                            annotation_results_vec,
-                            parse_options_.error_handling_mode,
-                            &skip_annotation_vec);
-
-    for (int j = 0; j < num_relations; ++j) {
-      const int subject_idx =
-          rel_tmpl.subject_cardinality() == RelationTemplate::MANY ? j : 0;
-      const int object_idx =
-          rel_tmpl.object_cardinality() == RelationTemplate::MANY ? j : 0;
-      if (!subject_results[subject_idx].second ||
-          !object_results[object_idx].second) {
-        continue;
-      }
-
-      Relation* rel = output->add_relations();
-      // TODO(sadovsky): Consider not setting these fields if string is empty.
-      rel->set_subject(subject_results[subject_idx].first);
-      rel->set_predicate(rel_tmpl.predicate());
-      rel->set_object(object_results[object_idx].first);
-      if (rel_tmpl.has_userdata()) {
-        rel->set_userdata(rel_tmpl.userdata());
+    if (xpath_wrapper.BudgetExhausted()) {
+      // Some of the queries above may have been skipped, so their results
+      // can't be trusted. Drop this template rather than output a partial or
+      // inconsistent set of relations for it.
+      if (rel_tmpl_stats != NULL) {
+        rel_tmpl_stats->set_nanos(MonotonicNanos() - rel_tmpl_start_nanos);
       }
+      break;
+    }
 
-      VLOG(1) << "Relation[" << ParserName() << "]: '" << rel->subject()
-              << "', '" << rel->predicate() << "', '" << rel->object() << "'";
-
-      for (int k = 0; k < annotation_results_vec.size(); ++k) {
-        if (skip_annotation_vec[k]) {
-          // This annotation has the wrong number of results, so we skip it.
-          // See ComputeNumRelations() implementation for more information.
-          continue;
-        }
-        const int annotation_idx =
-            rel_tmpl.annotation_tmpls(k).value_cardinality() ==
-            RelationTemplate::MANY ? j : 0;
-        const QueryResults& annotation_results = *annotation_results_vec[k];
-        if (!annotation_results[annotation_idx].second) {
-          continue;
-        }
-
-        Relation::Annotation* annotation = rel->add_annotations();
-        annotation->set_name(rel_tmpl.annotation_tmpls(k).name());
-        annotation->set_value(annotation_results[annotation_idx].first);
-      }
+    int64 output_bytes = 0;
+    const int num_relations =
+        EmitRelations(error_handler, rel_tmpl, i, subject_results,
+                      object_results, annotation_results_vec, sink,
+                      stats != NULL ? &output_bytes : NULL);
+    num_output_relations += num_relations;
+
+    if (rel_tmpl_stats != NULL) {
+      rel_tmpl_stats->set_num_relations(num_relations);
+      rel_tmpl_stats->set_nanos(MonotonicNanos() - rel_tmpl_start_nanos);
+      stats->set_num_relations(stats->num_relations() + num_relations);
+      stats->set_output_bytes(stats->output_bytes() + output_bytes);
     }
   }
+
+  sink->EndParser();
+  if (stats != NULL) {
+    stats->set_nanos(MonotonicNanos() - start_nanos);
+  }
+  if (invocations_counter_ != NULL) {
+    invocations_counter_->Increment();
+    if (num_output_relations == 0) empty_invocations_counter_->Increment();
+    relations_counter_->IncrementBy(num_output_relations);
+  }
 }
 
 }  // namespace xpaf
@@ -18,15 +18,24 @@
 #include <string>
 #include <vector>
 
+#include "base/integral_types.h"
 #include "base/macros.h"
+#include "base/scoped_ptr.h"
 #include "base/stl_decl.h"
 #include "xpaf_parser_def.pb.h"
 
+namespace re2 { class RE2; }
+
 namespace xpaf {
 
+class Counter;
+class Mutex;
+class ParseResultCache;
 class ParserOutput;
+class ParserStats;
 class QueryInfo;
 class QueryResultsCache;
+class RelationSink;
 class StringPiece;
 class XPathWrapper;
 
@@ -37,18 +46,99 @@ typedef vector<pair<string, bool> > QueryResults;
 
 enum ErrorHandlingMode {
   EHM_IGNORE = 0,     // silently skip record
-  EHM_LOG_ERROR,      // log error and skip record
+  EHM_LOG_ERROR,      // report error to ErrorReporter::Global() and skip record
   EHM_ABORT_PROCESS,  // log error and abort process
 };
 
 struct ParseOptions {
   ErrorHandlingMode error_handling_mode;
 
+  // If true, XpafParserMaster::ParseDocument() stores each distinct relation
+  // string once in ParsedDocument.interned_strings, and relations refer to
+  // these strings via their *_id fields rather than holding copies. Has no
+  // effect on ParseDocument() calls that take a RelationSink.
+  bool intern_strings;
+
+  // Number of threads XpafParserMaster's constructors use to initialize
+  // parsers. Values <= 1 mean initialize sequentially on the calling thread.
+  int num_init_threads;
+
+  // If true, XpafParser::Init() only does the setup needed by ParserName() and
+  // ShouldParse(); query processing is deferred until the parser is first
+  // used. Saves startup time and memory when most parsers never match, at the
+  // cost of reporting invalid parser defs at first use rather than at Init().
+  // Has no effect on XpafParser::InitFromCompiled().
+  bool lazy_init;
+
+  // If true, XpafParserMaster and XpafParser update the process-wide metrics
+  // listed in metrics.h.
+  bool record_metrics;
+
+  // Per-document limits for XpafParserMaster::ParseDocument(). Zero means no
+  // limit. The time budget is checked before each parser, relation template,
+  // and XPath evaluation; since a single evaluation can't be interrupted on a
+  // timer, max_xpath_ops bounds the total XPath operations per document (see
+  // XPathWrapper::SetBudget()). Once either limit is hit, no further relations
+  // are produced and the output is marked truncated. Relations are only output
+  // for templates whose queries all completed, so truncated output is a
+  // subset of the full output. The DOM build is not covered by these limits.
+  int64 time_budget_nanos;
+  int64 max_xpath_ops;
+
+  // Per-document resource limits for XpafParserMaster::ParseDocument(). Zero
+  // means no limit. Documents whose content is longer than max_document_bytes
+  // or whose DOM has more than max_dom_nodes nodes are not parsed at all.
+  // libxml2 builds the DOM in a single call, so the node limit is checked once
+  // the DOM is built, and protects query evaluation rather than DOM
+  // construction. Once max_relations relations or max_output_bytes bytes of
+  // relation strings (see RelationViewBytes()) have been output, later
+  // relations are dropped and parsing stops as if the time budget had run
+  // out. In all of these cases the output is marked truncated.
+  int64 max_document_bytes;
+  int64 max_dom_nodes;
+  int64 max_relations;
+  int64 max_output_bytes;
+
+  // Maximum number of results kept from each XPath evaluation; later results,
+  // in document order, are dropped and the output is marked truncated. Zero
+  // means no limit. Bounds the number of relations a MANY template can
+  // produce, and the memory its query results take.
+  int max_results_per_query;
+
+  // If true, XpafParser::Parse() passes each error it finds to
+  // RelationSink::AddError(), so that ParseDocument() lists them in
+  // ParsedDocument.errors. Independent of error_handling_mode, which controls
+  // logging via ErrorReporter (see error_reporter.h).
+  bool output_errors;
+
+  // If non-NULL, XpafParserMaster::ParseDocument() calls that produce a
+  // ParsedDocument look documents up here first, and on a hit copy out the
+  // stored result without building the DOM or running any parser. Results are
+  // keyed by url, HTTP body (headers are ignored), content type, and
+  // XpafParserMaster::Fingerprint(), so masters with different parsers may
+  // share a cache. Truncated results are not stored, since they can depend on
+  // timing. Not owned; must outlive all masters using it.
+  ParseResultCache* result_cache;
+
   ParseOptions()
-      : error_handling_mode(EHM_LOG_ERROR) {}
+      : error_handling_mode(EHM_LOG_ERROR),
+        intern_strings(false),
+        num_init_threads(1),
+        lazy_init(false),
+        record_metrics(false),
+        time_budget_nanos(0),
+        max_xpath_ops(0),
+        max_document_bytes(0),
+        max_dom_nodes(0),
+        max_relations(0),
+        max_output_bytes(0),
+        max_results_per_query(0),
+        output_errors(false),
+        result_cache(NULL) {}
 };
 
-// Thread-safe after Init() has returned and before destructor has been called.
+// Thread-safe after Init() has returned and before destructor has been called,
+// including with ParseOptions.lazy_init.
 class XpafParser {
  public:
   XpafParser();
@@ -59,9 +149,27 @@ class XpafParser {
   void Init(const XpafParserDef& parser_def,
             const ParseOptions& parse_options);
 
+  // Like Init(), but initializes this parser from a definition that has already
+  // been processed by Init() (see Compile()), skipping inlined query
+  // processing. Takes the contents of 'compiled_def', leaving it empty.
+  void InitFromCompiled(CompiledXpafParserDef* compiled_def,
+                        const ParseOptions& parse_options);
+
+  // Populates 'compiled_def' with this parser's processed definition, suitable
+  // for passing to InitFromCompiled().
+  void Compile(CompiledXpafParserDef* compiled_def) const;
+
   // Returns the name of this parser.
   string ParserName() const;
 
+  // Returns our XpafParserDef's priority.
+  int Priority() const;
+
+  // Returns a fingerprint of the XpafParserDef given to Init(). Parsers with
+  // equal definitions have equal fingerprints, which are stable across
+  // processes and preserved by Compile() and InitFromCompiled().
+  uint64 Fingerprint() const;
+
   // Returns true if Parse() should be called for the given document, based on
   // our XpafParserDef's url_regexp.
   // This function is kept separate from Parse() so that users can avoid
@@ -69,13 +177,33 @@ class XpafParser {
   bool ShouldParse(const StringPiece& url) const;
 
   // Parses the given document, populating 'output'.
-  // Does not check ShouldParse().
+  // Does not check ShouldParse(). Stops early if 'xpath_wrapper''s budget is
+  // exhausted; see ParseOptions.time_budget_nanos.
   void Parse(const StringPiece& url,
              const XPathWrapper& xpath_wrapper,
              ParserOutput* output) const;
 
+  // Like Parse() above, but streams relations to 'sink' rather than building
+  // a ParserOutput. Calls sink->BeginParser() and sink->EndParser() around
+  // this parser's relations.
+  void Parse(const StringPiece& url,
+             const XPathWrapper& xpath_wrapper,
+             RelationSink* sink) const;
+
+  // Like Parse() above, but if 'stats' is non-NULL, also records timings and
+  // counts for this parser in it.
+  void Parse(const StringPiece& url,
+             const XPathWrapper& xpath_wrapper,
+             RelationSink* sink,
+             ParserStats* stats) const;
+
  private:
-  // Init() helper.
+  // Init() helpers.
+  void InitUrlRegexp();
+  void InitMetrics();
+  void InitQueries();
+  void EnsureQueriesInitialized() const;
+  void AddQueryDefsToQueryInfoMap();
   void ProcessReference(string* ref,
                         int* num_inlined_queries,
                         unordered_map<string, string>* inlined_query_refs);
@@ -84,16 +212,37 @@ class XpafParser {
   const QueryResults* GetQueryResults(const StringPiece& url,
                                       const internal::QueryRunner& query_runner,
                                       const string& key,
-                                      QueryResultsCache* cache) const;
+                                      QueryResultsCache* cache,
+                                      ParserStats* stats) const;
 
   // True if Init() has been called. Not lock-protected because it's only
   // modified by Init(), and we only guarantee thread-safety after Init() has
   // returned.
   bool initialized_;
 
+  // True once query_info_map_ and inlined_query_defs_ have been populated.
+  // With ParseOptions.lazy_init, this happens on first use, under init_mu_.
+  // Read via Acquire_Load().
+  mutable volatile bool queries_initialized_;
+  // Held in a scoped_ptr so that this header needn't include base/mutex.h,
+  // which isn't installed.
+  scoped_ptr<Mutex> init_mu_;
+
   // Definition proto for this parser, set by Init().
   XpafParserDef parser_def_;
 
+  // See Fingerprint(). Set by Init().
+  uint64 fingerprint_;
+
+  // Compiled parser_def_.url_regexp, or NULL if there isn't one.
+  scoped_ptr<re2::RE2> url_regexp_;
+
+  // Owned by MetricsRegistry::Global(). NULL unless
+  // ParseOptions.record_metrics is true.
+  Counter* invocations_counter_;
+  Counter* empty_invocations_counter_;
+  Counter* relations_counter_;
+
   // Parsing options, set by Init().
   ParseOptions parse_options_;
 
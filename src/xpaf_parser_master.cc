@@ -14,36 +14,273 @@
 
 #include "xpaf_parser_master.h"
 
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "base/callback.h"
+#include "base/hash.h"
 #include "base/logging.h"
 #include "base/scoped_ptr.h"
 #include "base/stl_decl.h"
-#include "base/stl_util.h"
 #include "base/stringpiece.h"
+#include "base/thread_pool.h"
+#include "base/timer.h"
+#include "base/webutil.h"
+#include "delta_sink.h"
 #include "document.h"
+#include "metrics.h"
+#include "parse_result_cache.h"
+#include "parse_stats.pb.h"
 #include "parsed_document.pb.h"
+#include "relation_sink.h"
 #include "xpaf_parser.h"
 #include "xpaf_parser_def.pb.h"
 #include "xpath_wrapper.h"
 
 namespace xpaf {
 
+namespace {
+
+// Initializes one XpafParser from either a text or a compiled parser def.
+struct InitTask {
+  XpafParser* parser;
+  const XpafParserDef* parser_def;
+  CompiledXpafParserDef* compiled_def;
+  const ParseOptions* parse_options;
+
+  void Run() {
+    if (parser_def != NULL) {
+      parser->Init(*parser_def, *parse_options);
+    } else {
+      parser->InitFromCompiled(compiled_def, *parse_options);
+    }
+  }
+};
+
+// Runs all of 'tasks', using up to parse_options.num_init_threads threads.
+// Parsers are independent of one another, so no synchronization is needed.
+void RunInitTasks(vector<InitTask>* tasks, const ParseOptions& parse_options) {
+  const int num_threads = min(parse_options.num_init_threads,
+                              static_cast<int>(tasks->size()));
+  if (num_threads <= 1) {
+    for (int i = 0; i < tasks->size(); ++i) {
+      (*tasks)[i].Run();
+    }
+    return;
+  }
+  ThreadPool pool(num_threads);
+  for (int i = 0; i < tasks->size(); ++i) {
+    pool.Schedule(NewCallback(&(*tasks)[i], &InitTask::Run));
+  }
+  // The ThreadPool destructor waits for all tasks to finish.
+}
+
+// Process-wide metrics updated by ParseDocument(). See metrics.h.
+struct MasterMetrics {
+  Counter* docs_parsed;
+  Counter* docs_skipped;
+  Counter* docs_truncated;
+  Counter* docs_reused;
+  Counter* result_cache_hits;
+  Counter* result_cache_misses;
+  Histogram* parse_latency_nanos;
+  Histogram* doc_bytes;
+
+  MasterMetrics() {
+    MetricsRegistry* registry = MetricsRegistry::Global();
+    docs_parsed = registry->GetCounter("xpaf/docs_parsed");
+    docs_skipped = registry->GetCounter("xpaf/docs_skipped");
+    docs_truncated = registry->GetCounter("xpaf/docs_truncated");
+    docs_reused = registry->GetCounter("xpaf/docs_reused");
+    result_cache_hits = registry->GetCounter("xpaf/result_cache_hits");
+    result_cache_misses = registry->GetCounter("xpaf/result_cache_misses");
+    parse_latency_nanos = registry->GetHistogram("xpaf/parse_latency_nanos");
+    doc_bytes = registry->GetHistogram("xpaf/doc_bytes");
+  }
+};
+
+// Forwards to another sink until 'max_relations' relations or
+// 'max_output_bytes' bytes of relation strings have been forwarded (zero means
+// no limit), then drops all further relations and exhausts the document's
+// parse budget, if there is a DOM, so that parsing stops.
+class OutputLimitingSink : public RelationSink {
+ public:
+  // 'xpath_wrapper' may be NULL.
+  OutputLimitingSink(RelationSink* sink, int64 max_relations,
+                     int64 max_output_bytes, const XPathWrapper* xpath_wrapper)
+      : sink_(sink),
+        max_relations_(max_relations),
+        max_output_bytes_(max_output_bytes),
+        xpath_wrapper_(xpath_wrapper),
+        num_relations_(0),
+        output_bytes_(0),
+        full_(false) {}
+
+  virtual void BeginParser(const StringPiece& parser_name) {
+    sink_->BeginParser(parser_name);
+  }
+
+  virtual void AddRelation(const RelationView& relation) {
+    if (full_) return;
+    const int64 bytes = RelationViewBytes(relation);
+    if ((max_relations_ > 0 && num_relations_ >= max_relations_) ||
+        (max_output_bytes_ > 0 && output_bytes_ + bytes > max_output_bytes_)) {
+      VLOG(1) << "Output limit reached after " << num_relations_
+              << " relations, " << output_bytes_ << " bytes";
+      full_ = true;
+      if (xpath_wrapper_ != NULL) xpath_wrapper_->ExhaustBudget();
+      return;
+    }
+    ++num_relations_;
+    output_bytes_ += bytes;
+    sink_->AddRelation(relation);
+  }
+
+  virtual void EndParser() {
+    sink_->EndParser();
+  }
+
+  virtual void AddError(const ParseError& error) {
+    sink_->AddError(error);
+  }
+
+  virtual void SetTruncated() {
+    sink_->SetTruncated();
+  }
+
+  // True once a limit has been reached.
+  bool full() const { return full_; }
+
+ private:
+  RelationSink* const sink_;
+  const int64 max_relations_;
+  const int64 max_output_bytes_;
+  const XPathWrapper* const xpath_wrapper_;
+  int64 num_relations_;
+  int64 output_bytes_;
+  bool full_;
+
+  DISALLOW_COPY_AND_ASSIGN(OutputLimitingSink);
+};
+
+// Copies parsers' output from a previous ParsedDocument. See
+// XpafParserMaster::ReparseDocument().
+class PreviousOutputReplayer {
+ public:
+  explicit PreviousOutputReplayer(const ParsedDocument& previous)
+      : previous_(previous) {
+    for (int i = 0; i < previous_.parser_outputs_size(); ++i) {
+      const ParserOutput& output = previous_.parser_outputs(i);
+      outputs_[output.parser_name()] = &output;
+    }
+  }
+
+  // Makes the calls XpafParser::Parse() would make to 'sink' for
+  // 'parser_name', with the relations and errors recorded in 'previous'.
+  void Replay(const string& parser_name, RelationSink* sink) const {
+    sink->BeginParser(parser_name);
+    unordered_map<string, const ParserOutput*>::const_iterator it =
+        outputs_.find(parser_name);
+    if (it != outputs_.end()) {
+      AddParserOutputRelations(previous_, *it->second, sink);
+    }
+    for (int i = 0; i < previous_.errors_size(); ++i) {
+      if (previous_.errors(i).parser_name() == parser_name) {
+        sink->AddError(previous_.errors(i));
+      }
+    }
+    sink->EndParser();
+  }
+
+ private:
+  const ParsedDocument& previous_;
+  unordered_map<string, const ParserOutput*> outputs_;
+
+  DISALLOW_COPY_AND_ASSIGN(PreviousOutputReplayer);
+};
+
+// For sorting parsers by decreasing priority.
+bool HigherPriority(const XpafParser* a, const XpafParser* b) {
+  return a->Priority() > b->Priority();
+}
+
+const MasterMetrics& GetMasterMetrics() {
+  static const MasterMetrics* const metrics = new MasterMetrics();
+  return *metrics;
+}
+
+}  // namespace
+
 XpafParserMaster::XpafParserMaster(const XpafParserDefs& parser_defs,
-                                   const ParseOptions& parse_options) {
+                                   const ParseOptions& parse_options)
+    : parse_options_(parse_options), fingerprint_(0) {
   CHECK_GT(parser_defs.parser_defs_size(), 0);
-  for (int i = 0; i < parser_defs.parser_defs_size(); ++i) {
-    XpafParser* parser = new XpafParser();
-    parser->Init(parser_defs.parser_defs(i), parse_options);
-    CHECK(parser_map_.insert(make_pair(parser->ParserName(), parser)).second)
-        << "Duplicate parser name " << parser->ParserName();
+  vector<InitTask> tasks(parser_defs.parser_defs_size());
+  for (int i = 0; i < tasks.size(); ++i) {
+    tasks[i].parser = new XpafParser();
+    tasks[i].parser_def = &parser_defs.parser_defs(i);
+    tasks[i].compiled_def = NULL;
+    tasks[i].parse_options = &parse_options;
   }
+  RunInitTasks(&tasks, parse_options);
+  for (int i = 0; i < tasks.size(); ++i) {
+    AddParser(tasks[i].parser);
+  }
+  ComputeFingerprint();
+}
+
+XpafParserMaster::XpafParserMaster(CompiledXpafParserDefs* compiled_defs,
+                                   const ParseOptions& parse_options)
+    : parse_options_(parse_options), fingerprint_(0) {
+  CHECK_GT(compiled_defs->parser_defs_size(), 0);
+  vector<InitTask> tasks(compiled_defs->parser_defs_size());
+  for (int i = 0; i < tasks.size(); ++i) {
+    tasks[i].parser = new XpafParser();
+    tasks[i].parser_def = NULL;
+    tasks[i].compiled_def = compiled_defs->mutable_parser_defs(i);
+    tasks[i].parse_options = &parse_options;
+  }
+  RunInitTasks(&tasks, parse_options);
+  for (int i = 0; i < tasks.size(); ++i) {
+    AddParser(tasks[i].parser);
+  }
+  compiled_defs->Clear();
+  ComputeFingerprint();
+}
+
+XpafParserMaster::XpafParserMaster(const XpafParserMaster* source)
+    : parse_options_(source->parse_options_),
+      parser_map_(source->parser_map_),
+      fingerprint_(0) {
+  CHECK(!parser_map_.empty());
+}
+
+void XpafParserMaster::AddParser(const XpafParser* parser) {
+  CHECK(parser_map_.insert(make_pair(parser->ParserName(),
+                                     shared_ptr<const XpafParser>(parser)))
+        .second)
+      << "Duplicate parser name " << parser->ParserName();
+}
+
+void XpafParserMaster::ComputeFingerprint() {
+  vector<uint64> fingerprints;
+  fingerprints.reserve(parser_map_.size());
+  for (ParserMap::const_iterator it = parser_map_.begin();
+       it != parser_map_.end(); ++it) {
+    fingerprints.push_back(it->second->Fingerprint());
+  }
+  sort(fingerprints.begin(), fingerprints.end());
+  // Of the per-document settings, only these change untruncated output.
+  const uint64 settings = (parse_options_.intern_strings ? 1 : 0) |
+                          (parse_options_.output_errors ? 2 : 0);
+  fingerprint_ = Hash64WithSeed(
+      reinterpret_cast<const char*>(&fingerprints[0]),
+      fingerprints.size() * sizeof(fingerprints[0]), settings);
 }
 
 XpafParserMaster::~XpafParserMaster() {
-  STLDeleteValues(&parser_map_);
 }
 
 bool XpafParserMaster::ShouldParse(const StringPiece& url) const {
@@ -58,43 +295,302 @@ bool XpafParserMaster::ShouldParse(const StringPiece& url) const {
 
 void XpafParserMaster::ParseDocument(const Document& doc,
                                      ParsedDocument* parsed_document) const {
-  parsed_document->set_url(doc.url().as_string());
+  ParseDocument(doc, parsed_document, NULL);
+}
 
-  if (doc.content_type() != CONTENT_TYPE_HTML &&
-      doc.content_type() != CONTENT_TYPE_XML) {
-    return;
+void XpafParserMaster::ParseDocument(const Document& doc,
+                                     RelationSink* sink) const {
+  ParseDocument(doc, sink, NULL);
+}
+
+uint64 XpafParserMaster::Fingerprint() const {
+  return fingerprint_;
+}
+
+uint64 XpafParserMaster::ResultCacheKey(const Document& doc) const {
+  return ResultCacheKey(doc, HTTPUtils::HttpBody(doc.content()));
+}
+
+uint64 XpafParserMaster::ResultCacheKey(const Document& doc,
+                                        const StringPiece& body) const {
+  const StringPiece url = doc.url();
+  const uint64 url_hash = Hash64WithSeed(url.data(), url.size(),
+                                         fingerprint_ + doc.content_type());
+  return Hash64WithSeed(body.data(), body.size(), url_hash);
+}
+
+void XpafParserMaster::ParseDocument(const Document& doc,
+                                     ParsedDocument* parsed_document,
+                                     ParseStats* stats) const {
+  ParseResultCache* const cache = parse_options_.result_cache;
+  const bool use_cache = cache != NULL &&
+      (doc.content_type() == CONTENT_TYPE_HTML ||
+       doc.content_type() == CONTENT_TYPE_XML);
+  uint64 cache_key = 0;
+  StringPiece body;
+  if (use_cache) {
+    const int64 start_nanos = stats != NULL ? MonotonicNanos() : 0;
+    body = HTTPUtils::HttpBody(doc.content());
+    cache_key = ResultCacheKey(doc, body);
+    if (cache->Lookup(cache_key, doc.url(), parsed_document)) {
+      if (stats != NULL) {
+        stats->Clear();
+        stats->set_result_cache_hit(true);
+        stats->set_total_nanos(MonotonicNanos() - start_nanos);
+      }
+      if (parse_options_.record_metrics) {
+        GetMasterMetrics().result_cache_hits->Increment();
+      }
+      return;
+    }
+    if (parse_options_.record_metrics) {
+      GetMasterMetrics().result_cache_misses->Increment();
+    }
   }
 
-  // Find all parsers that should parse this document.
-  vector<const XpafParser*> relevant_parsers;
+  ParsedDocumentSink sink(parsed_document, parse_options_.intern_strings);
+  ParseDocumentInternal(doc, NULL, NULL, use_cache ? &body : NULL, &sink,
+                        stats);
+  if (use_cache && !parsed_document->truncated()) {
+    cache->Insert(cache_key, *parsed_document);
+  }
+}
+
+void XpafParserMaster::ParseDocument(const Document& doc,
+                                     RelationSink* sink,
+                                     ParseStats* stats) const {
+  ParseDocumentInternal(doc, NULL, NULL, NULL, sink, stats);
+}
+
+void XpafParserMaster::ParseDocumentDelta(const Document& doc,
+                                          const RelationFingerprints& previous,
+                                          ParsedDocument* delta,
+                                          ParseStats* stats) const {
+  ParsedDocumentSink sink(delta, parse_options_.intern_strings);
+  DeltaSink delta_sink(previous, &sink);
+  ParseDocument(doc, &delta_sink, stats);
+  delta->set_delta(true);
+
+  RelationFingerprints removed;
+  delta_sink.RemovedRelations(&removed);
+  if (removed.parsers_size() == 0) return;
+  unordered_map<string, ParserOutput*> outputs;
+  for (int i = 0; i < delta->parser_outputs_size(); ++i) {
+    ParserOutput* output = delta->mutable_parser_outputs(i);
+    outputs[output->parser_name()] = output;
+  }
+  for (int i = 0; i < removed.parsers_size(); ++i) {
+    const RelationFingerprints::Parser& parser = removed.parsers(i);
+    ParserOutput*& output = outputs[parser.parser_name()];
+    if (output == NULL) {
+      output = delta->add_parser_outputs();
+      output->set_parser_name(parser.parser_name());
+    }
+    output->mutable_removed_relation_fingerprints()->CopyFrom(
+        parser.fingerprints());
+  }
+}
+
+void XpafParserMaster::ParseDocumentDelta(const Document& doc,
+                                          const ParsedDocument& previous,
+                                          ParsedDocument* delta,
+                                          ParseStats* stats) const {
+  RelationFingerprints fingerprints;
+  ComputeRelationFingerprints(previous, &fingerprints);
+  ParseDocumentDelta(doc, fingerprints, delta, stats);
+}
+
+void XpafParserMaster::ParserFingerprints(
+    ParserFingerprintMap* fingerprints) const {
+  fingerprints->clear();
+  for (ParserMap::const_iterator it = parser_map_.begin();
+       it != parser_map_.end(); ++it) {
+    (*fingerprints)[it->first] = it->second->Fingerprint();
+  }
+}
+
+bool XpafParserMaster::ShouldReparse(
+    const StringPiece& url,
+    const ParserFingerprintMap& previous_fingerprints) const {
   for (ParserMap::const_iterator it = parser_map_.begin();
        it != parser_map_.end(); ++it) {
-    if (it->second->ShouldParse(doc.url())) {
-      VLOG(2) << "Relevant parser: " << it->first;
-      relevant_parsers.push_back(it->second);
+    if (!it->second->ShouldParse(url)) continue;
+    ParserFingerprintMap::const_iterator previous_it =
+        previous_fingerprints.find(it->first);
+    if (previous_it == previous_fingerprints.end() ||
+        previous_it->second != it->second->Fingerprint()) {
+      return true;
     }
   }
+  return false;
+}
 
-  if (relevant_parsers.empty()) {
-    return;
+void XpafParserMaster::ReparseDocument(
+    const Document& doc,
+    const ParsedDocument& previous,
+    const ParserFingerprintMap& previous_fingerprints,
+    ParsedDocument* parsed_document,
+    ParseStats* stats) const {
+  DCHECK(parsed_document != &previous);
+  ParsedDocumentSink sink(parsed_document, parse_options_.intern_strings);
+  ReparseDocument(doc, previous, previous_fingerprints, &sink, stats);
+}
+
+void XpafParserMaster::ReparseDocument(
+    const Document& doc,
+    const ParsedDocument& previous,
+    const ParserFingerprintMap& previous_fingerprints,
+    RelationSink* sink,
+    ParseStats* stats) const {
+  // Truncated output may be missing relations of parsers we'd reuse.
+  if (previous.truncated()) {
+    VLOG(1) << "Previous output truncated, parsing from scratch: "
+            << doc.url();
+    ParseDocumentInternal(doc, NULL, NULL, NULL, sink, stats);
+  } else {
+    ParseDocumentInternal(doc, &previous, &previous_fingerprints, NULL, sink,
+                          stats);
+  }
+}
+
+void XpafParserMaster::ParseDocumentInternal(
+    const Document& doc,
+    const ParsedDocument* previous,
+    const ParserFingerprintMap* previous_fingerprints,
+    const StringPiece* body,
+    RelationSink* sink,
+    ParseStats* stats) const {
+  const bool record_metrics = parse_options_.record_metrics;
+  int64 start_nanos = 0;
+  if (stats != NULL) stats->Clear();
+  if (stats != NULL || record_metrics ||
+      parse_options_.time_budget_nanos > 0) {
+    start_nanos = MonotonicNanos();
   }
+  sink->BeginDocument(doc.url());
 
-  scoped_ptr<XPathWrapper> xpath_wrapper(XPathWrapper::NewXPathWrapper(
-      doc.url(), doc.content(), doc.content_type()));
+  // Find all parsers that should parse this document.
+  vector<const XpafParser*> relevant_parsers;
+  if (doc.content_type() == CONTENT_TYPE_HTML ||
+      doc.content_type() == CONTENT_TYPE_XML) {
+    for (ParserMap::const_iterator it = parser_map_.begin();
+         it != parser_map_.end(); ++it) {
+      if (it->second->ShouldParse(doc.url())) {
+        VLOG(2) << "Relevant parser: " << it->first;
+        relevant_parsers.push_back(it->second.get());
+      }
+    }
+    stable_sort(relevant_parsers.begin(), relevant_parsers.end(),
+                HigherPriority);
+    if (stats != NULL) {
+      stats->set_dispatch_nanos(MonotonicNanos() - start_nanos);
+    }
+  }
 
-  for (vector<const XpafParser*>::const_iterator it = relevant_parsers.begin();
-       it != relevant_parsers.end(); ++it) {
-    const XpafParser* parser = *it;
-    ParserOutput* output = parsed_document->add_parser_outputs();
-    parser->Parse(doc.url(), *xpath_wrapper, output);
-    // If the ParserOutput is empty, remove it.
-    if (output->relations_size() == 0) {
-      parsed_document->mutable_parser_outputs()->RemoveLast();
+  // Reuse the previous output of parsers that haven't changed.
+  vector<bool> reuse(relevant_parsers.size(), false);
+  int num_reused = 0;
+  if (previous != NULL) {
+    for (int i = 0; i < relevant_parsers.size(); ++i) {
+      ParserFingerprintMap::const_iterator it =
+          previous_fingerprints->find(relevant_parsers[i]->ParserName());
+      reuse[i] = it != previous_fingerprints->end() &&
+                 it->second == relevant_parsers[i]->Fingerprint();
+      if (reuse[i]) ++num_reused;
+    }
+    if (stats != NULL) stats->set_num_reused_parsers(num_reused);
+  }
+  const bool all_reused = !relevant_parsers.empty() &&
+                          num_reused == relevant_parsers.size();
+
+  if (!relevant_parsers.empty() &&
+      RunParsers(doc, relevant_parsers, reuse, previous, body, start_nanos,
+                 sink, stats)) {
+    VLOG(1) << "Output truncated: " << doc.url();
+    sink->SetTruncated();
+    if (stats != NULL) stats->set_truncated(true);
+    if (record_metrics) GetMasterMetrics().docs_truncated->Increment();
+  }
+  sink->EndDocument();
+
+  if (stats != NULL || record_metrics) {
+    const int64 nanos = MonotonicNanos() - start_nanos;
+    if (stats != NULL) stats->set_total_nanos(nanos);
+    if (record_metrics) {
+      const MasterMetrics& metrics = GetMasterMetrics();
+      if (relevant_parsers.empty()) {
+        metrics.docs_skipped->Increment();
+      } else if (all_reused) {
+        metrics.docs_reused->Increment();
+      } else {
+        metrics.docs_parsed->Increment();
+        metrics.parse_latency_nanos->Add(nanos);
+        metrics.doc_bytes->Add(doc.content().size());
+      }
     }
-    output->set_parser_name(parser->ParserName());
   }
 }
 
+bool XpafParserMaster::RunParsers(const Document& doc,
+                                  const vector<const XpafParser*>& parsers,
+                                  const vector<bool>& reuse,
+                                  const ParsedDocument* previous,
+                                  const StringPiece* body,
+                                  int64 start_nanos,
+                                  RelationSink* sink,
+                                  ParseStats* stats) const {
+  const ParseOptions& opt = parse_options_;
+  scoped_ptr<XPathWrapper> xpath_wrapper;
+  if (find(reuse.begin(), reuse.end(), false) != reuse.end()) {
+    if (opt.max_document_bytes > 0 &&
+        doc.content().size() > opt.max_document_bytes) {
+      VLOG(1) << "Document has " << doc.content().size() << " bytes: "
+              << doc.url();
+      return true;
+    }
+
+    xpath_wrapper.reset(body != NULL ?
+        XPathWrapper::NewXPathWrapperFromBody(
+            doc.url(), *body, doc.content_type(), stats) :
+        XPathWrapper::NewXPathWrapper(
+            doc.url(), doc.content(), doc.content_type(), stats));
+    if (opt.max_dom_nodes > 0 &&
+        xpath_wrapper->HasMoreNodesThan(opt.max_dom_nodes)) {
+      VLOG(1) << "DOM has more than " << opt.max_dom_nodes << " nodes: "
+              << doc.url();
+      return true;
+    }
+    xpath_wrapper->SetBudget(
+        opt.time_budget_nanos > 0 ? start_nanos + opt.time_budget_nanos : 0,
+        opt.max_xpath_ops);
+  }
+  scoped_ptr<PreviousOutputReplayer> replayer(
+      previous != NULL ? new PreviousOutputReplayer(*previous) : NULL);
+
+  OutputLimitingSink limiting_sink(sink, opt.max_relations,
+                                   opt.max_output_bytes, xpath_wrapper.get());
+  RelationSink* parser_sink =
+      opt.max_relations > 0 || opt.max_output_bytes > 0 ? &limiting_sink : sink;
+
+  for (int i = 0; i < parsers.size(); ++i) {
+    if (reuse[i]) {
+      replayer->Replay(parsers[i]->ParserName(), parser_sink);
+      continue;
+    }
+    // Skips remaining parsers that have to run.
+    if (xpath_wrapper->BudgetExhausted()) continue;
+    ParserStats* parser_stats =
+        stats != NULL ? stats->add_parser_stats() : NULL;
+    parsers[i]->Parse(doc.url(), *xpath_wrapper, parser_sink, parser_stats);
+    if (parser_stats != NULL) {
+      stats->set_output_bytes(stats->output_bytes() +
+                              parser_stats->output_bytes());
+    }
+  }
+  return (xpath_wrapper != NULL && xpath_wrapper->truncated()) ||
+         limiting_sink.full();
+}
+
 void XpafParserMaster::ParserNames(vector<string>* names) const {
   names->clear();
   names->reserve(parser_map_.size());
@@ -104,4 +600,52 @@ void XpafParserMaster::ParserNames(vector<string>* names) const {
   }
 }
 
+void XpafParserMaster::Compile(CompiledXpafParserDefs* compiled_defs) const {
+  vector<string> names;
+  ParserNames(&names);
+  sort(names.begin(), names.end());
+  compiled_defs->Clear();
+  for (int i = 0; i < names.size(); ++i) {
+    const XpafParser* parser = parser_map_.find(names[i])->second.get();
+    parser->Compile(compiled_defs->add_parser_defs());
+  }
+}
+
+XpafParserMaster* XpafParserMaster::CopyWithAddedParser(
+    const XpafParserDef& parser_def,
+    const ParseOptions& parse_options) const {
+  CHECK(parser_map_.find(parser_def.parser_name()) == parser_map_.end())
+      << "Duplicate parser name " << parser_def.parser_name();
+  XpafParser* parser = new XpafParser();
+  parser->Init(parser_def, parse_options);
+  XpafParserMaster* master = new XpafParserMaster(this);
+  master->AddParser(parser);
+  master->ComputeFingerprint();
+  return master;
+}
+
+XpafParserMaster* XpafParserMaster::CopyWithReplacedParser(
+    const XpafParserDef& parser_def,
+    const ParseOptions& parse_options) const {
+  XpafParser* parser = new XpafParser();
+  parser->Init(parser_def, parse_options);
+  XpafParserMaster* master = new XpafParserMaster(this);
+  ParserMap::iterator it = master->parser_map_.find(parser->ParserName());
+  CHECK(it != master->parser_map_.end())
+      << "No parser named " << parser->ParserName();
+  it->second.reset(parser);
+  master->ComputeFingerprint();
+  return master;
+}
+
+XpafParserMaster* XpafParserMaster::CopyWithRemovedParser(
+    const string& parser_name) const {
+  CHECK_GT(parser_map_.size(), 1) << "Can't remove our only parser";
+  XpafParserMaster* master = new XpafParserMaster(this);
+  CHECK_EQ(master->parser_map_.erase(parser_name), 1)
+      << "No parser named " << parser_name;
+  master->ComputeFingerprint();
+  return master;
+}
+
 }  // namespace xpaf
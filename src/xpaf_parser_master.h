@@ -15,44 +15,211 @@
 #ifndef XPAF_XPAF_PARSER_MASTER_H_
 #define XPAF_XPAF_PARSER_MASTER_H_
 
+#include <map>
 #include <string>
 #include <vector>
 
+#include "base/integral_types.h"
 #include "base/macros.h"
 #include "base/stl_decl.h"
+#include "xpaf_parser.h"  // for ParseOptions
 
 namespace xpaf {
 
+class CompiledXpafParserDefs;
 class Document;
-class ParseOptions;
+class ParseStats;
 class ParsedDocument;
+class RelationFingerprints;
+class RelationSink;
 class StringPiece;
-class XpafParser;
+class XpafParserDef;
 class XpafParserDefs;
 
+// Maps parser name to XpafParser::Fingerprint(). See
+// XpafParserMaster::ReparseDocument().
+typedef map<string, uint64> ParserFingerprintMap;
+
 class XpafParserMaster {
  public:
   // Constructs an XpafParser for each XpafParserDef in 'parser_defs', passing
-  // 'parse_options' to XpafParser::Init().
+  // 'parse_options' to XpafParser::Init(). Uses parse_options.num_init_threads
+  // threads to initialize parsers.
   XpafParserMaster(const XpafParserDefs& parser_defs,
                    const ParseOptions& parse_options);
 
+  // Constructs an XpafParser for each CompiledXpafParserDef in
+  // 'compiled_defs' via XpafParser::InitFromCompiled(), which is much faster
+  // than Init(). Takes the contents of 'compiled_defs', leaving it empty. See
+  // parser_snapshot.h.
+  XpafParserMaster(CompiledXpafParserDefs* compiled_defs,
+                   const ParseOptions& parse_options);
+
   ~XpafParserMaster();
 
   // Returns true if any XpafParser::ShouldParse() returns true.
   bool ShouldParse(const StringPiece& url) const;
 
-  // Parses 'doc' using all of our parsers, populating 'parsed_document'.
+  // Parses 'doc' using all of our parsers, replacing the contents of
+  // 'parsed_document'. Relevant parsers run in decreasing
+  // XpafParserDef.priority order; parsers with equal priority run in
+  // unspecified order.
   void ParseDocument(const Document& doc,
                      ParsedDocument* parsed_document) const;
 
+  // Parses 'doc' using all of our parsers, streaming relations to 'sink'. See
+  // RelationSink for the sequence of calls made.
+  void ParseDocument(const Document& doc, RelationSink* sink) const;
+
+  // Like the ParseDocument() methods above, but if 'stats' is non-NULL, also
+  // replaces its contents with statistics about this call. See
+  // parse_stats.proto. With 'stats' NULL, no timing is done.
+  void ParseDocument(const Document& doc,
+                     ParsedDocument* parsed_document,
+                     ParseStats* stats) const;
+  void ParseDocument(const Document& doc,
+                     RelationSink* sink,
+                     ParseStats* stats) const;
+
+  // Returns a fingerprint of our parser set: the XpafParser::Fingerprint() of
+  // each parser, plus the per-document settings that affect ParseDocument()
+  // output. Masters with equal fingerprints produce the same output for a
+  // document, except where a time budget runs out.
+  uint64 Fingerprint() const;
+
+  // Returns the key under which ParseDocument() stores its output for 'doc' in
+  // ParseOptions.result_cache. Hashes the document's url, content type and
+  // HTTP body, so documents that differ only in their headers share a key.
+  uint64 ResultCacheKey(const Document& doc) const;
+
+  // Replaces the contents of 'fingerprints' with the fingerprint of each of our
+  // parsers. Store these with the ParsedDocuments we produce to allow
+  // reprocessing them with ReparseDocument() once the parsers change.
+  void ParserFingerprints(ParserFingerprintMap* fingerprints) const;
+
+  // Returns true if ReparseDocument() would need to run any parser on a
+  // document with the given url, i.e. if any of our parsers that should parse
+  // it is missing from 'previous_fingerprints' or has a different fingerprint
+  // there. If this returns false, ReparseDocument() doesn't read the document's
+  // content, so callers can skip loading it.
+  bool ShouldReparse(const StringPiece& url,
+                     const ParserFingerprintMap& previous_fingerprints) const;
+
+  // Like ParseDocument(), but reuses parts of 'previous', the output for the
+  // same document of a master whose parsers had 'previous_fingerprints'. Only
+  // parsers that are new or changed since then are run; the output of every
+  // other relevant parser is copied from 'previous', and output of parsers we
+  // no longer have or that no longer match the url is dropped. No DOM is built
+  // if no parser needs to run. The result matches what ParseDocument() would
+  // produce, provided 'previous' was produced with the same output_errors
+  // setting; interned and non-interned inputs are both accepted. If 'previous'
+  // is truncated, the document is parsed from scratch. 'stats' may be NULL.
+  // ParseOptions.result_cache is not used.
+  void ReparseDocument(const Document& doc,
+                       const ParsedDocument& previous,
+                       const ParserFingerprintMap& previous_fingerprints,
+                       ParsedDocument* parsed_document,
+                       ParseStats* stats) const;
+  void ReparseDocument(const Document& doc,
+                       const ParsedDocument& previous,
+                       const ParserFingerprintMap& previous_fingerprints,
+                       RelationSink* sink,
+                       ParseStats* stats) const;
+
+  // Like ParseDocument(), but populates 'delta' with only the changes since
+  // 'previous', the relations output for the same document by an earlier parse
+  // (see ComputeRelationFingerprints() in delta_sink.h). Each parser with
+  // changes gets a ParserOutput listing its added relations and the
+  // fingerprints of its removed ones; delta.delta is set. If parsing is
+  // truncated, no relations are reported as removed. 'stats' may be NULL.
+  void ParseDocumentDelta(const Document& doc,
+                          const RelationFingerprints& previous,
+                          ParsedDocument* delta,
+                          ParseStats* stats) const;
+
+  // Like ParseDocumentDelta() above, with the fingerprints of the relations in
+  // 'previous', which may have interned strings.
+  void ParseDocumentDelta(const Document& doc,
+                          const ParsedDocument& previous,
+                          ParsedDocument* delta,
+                          ParseStats* stats) const;
+
   // Populates 'names' with all of our parser names.
   void ParserNames(vector<string>* names) const;
 
+  // Replaces the contents of 'compiled_defs' with the processed definitions of
+  // all of our parsers, sorted by parser name.
+  void Compile(CompiledXpafParserDefs* compiled_defs) const;
+
+  // The following methods return a new master that differs from this one by a
+  // single parser. Parsers are immutable once initialized, so all other parsers
+  // are shared between the two masters rather than rebuilt, and either master
+  // may be deleted first. The new master uses this master's per-document
+  // settings (intern_strings, record_metrics, and the limits); 'parse_options'
+  // only applies to the new parser. Caller takes ownership of the returned
+  // master.
+
+  // Returns a copy of this master with a new parser for 'parser_def', which
+  // must not have the same name as any of our parsers.
+  XpafParserMaster* CopyWithAddedParser(
+      const XpafParserDef& parser_def,
+      const ParseOptions& parse_options) const;
+
+  // Returns a copy of this master in which our parser with the same name as
+  // 'parser_def' is replaced by a new parser for 'parser_def'.
+  XpafParserMaster* CopyWithReplacedParser(
+      const XpafParserDef& parser_def,
+      const ParseOptions& parse_options) const;
+
+  // Returns a copy of this master without the parser named 'parser_name'. We
+  // must have such a parser, and it must not be our only parser.
+  XpafParserMaster* CopyWithRemovedParser(const string& parser_name) const;
+
  private:
-  typedef unordered_map<string, const XpafParser*> ParserMap;
+  typedef unordered_map<string, shared_ptr<const XpafParser> > ParserMap;
+
+  // Used by the Copy*() methods. Constructs a master with the same settings as
+  // 'source' that shares all of its parsers. Leaves fingerprint_ unset.
+  explicit XpafParserMaster(const XpafParserMaster* source);
+
+  // Constructor helper. Takes ownership of 'parser'.
+  void AddParser(const XpafParser* parser);
+
+  // Sets fingerprint_. Called by each constructor and Copy*() method once
+  // parser_map_ is final.
+  void ComputeFingerprint();
+
+  // Like ResultCacheKey() above, with 'body' the HTTP body of 'doc'.
+  uint64 ResultCacheKey(const Document& doc, const StringPiece& body) const;
+
+  // Implements ParseDocument() and, if 'previous' is non-NULL,
+  // ReparseDocument(). If 'body' is non-NULL, it must be the HTTP body of
+  // 'doc', which then needn't be found again.
+  void ParseDocumentInternal(const Document& doc,
+                             const ParsedDocument* previous,
+                             const ParserFingerprintMap* previous_fingerprints,
+                             const StringPiece* body,
+                             RelationSink* sink,
+                             ParseStats* stats) const;
+
+  // Parses 'doc' with 'parsers', which must be non-empty, as described for
+  // ParseDocument(). For each i with reuse[i] true, copies the output of
+  // parsers[i] from 'previous' rather than running it; the DOM is only built
+  // if some parser has to run. Returns true if the output is truncated.
+  bool RunParsers(const Document& doc,
+                  const vector<const XpafParser*>& parsers,
+                  const vector<bool>& reuse,
+                  const ParsedDocument* previous,
+                  const StringPiece* body,
+                  int64 start_nanos,
+                  RelationSink* sink,
+                  ParseStats* stats) const;
 
+  // We use the per-document settings here (intern_strings, record_metrics, and
+  // the limits); the rest only matter to our parsers.
+  const ParseOptions parse_options_;
   ParserMap parser_map_;
+  uint64 fingerprint_;
 
   DISALLOW_COPY_AND_ASSIGN(XpafParserMaster);
 };
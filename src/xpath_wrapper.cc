@@ -19,19 +19,25 @@
 #include <libxml/HTMLparser.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlversion.h>
 #include <libxml/xpath.h>
 
 #include "base/logging.h"
 #include "base/stl_decl.h"
 #include "base/stringpiece.h"
+#include "base/timer.h"
 #include "base/webutil.h"
 #include "document.h"
+#include "parse_stats.pb.h"
 
 namespace xpaf {
 
 XPathWrapper::XPathWrapper(xmlDocPtr doc)
     : doc_(doc),
-      context_(xmlXPathNewContext(doc)) {
+      context_(xmlXPathNewContext(doc)),
+      deadline_nanos_(0),
+      budget_exhausted_(false),
+      results_truncated_(false) {
 }
 
 XPathWrapper::~XPathWrapper() {
@@ -47,32 +53,110 @@ xmlXPathObjectPtr XPathWrapper::EvalExpressionOrDie(const string& expr) const {
   return xpath_obj;
 }
 
+void XPathWrapper::SetBudget(int64 deadline_nanos, int64 max_xpath_ops) {
+  deadline_nanos_ = deadline_nanos;
+#if LIBXML_VERSION >= 20911
+  context_->opLimit = max_xpath_ops > 0 ? max_xpath_ops : 0;
+  context_->opCount = 0;
+#endif
+}
+
+bool XPathWrapper::BudgetExhausted() const {
+  if (!budget_exhausted_ && deadline_nanos_ != 0 &&
+      MonotonicNanos() >= deadline_nanos_) {
+    budget_exhausted_ = true;
+  }
+  return budget_exhausted_;
+}
+
+bool XPathWrapper::HasMoreNodesThan(int64 max_nodes) const {
+  if (doc_ == NULL) return false;
+  // Iterative pre-order traversal, so that deep documents can't overflow the
+  // stack.
+  int64 num_nodes = 0;
+  xmlNodePtr node = doc_->children;
+  while (node != NULL) {
+    if (++num_nodes > max_nodes) return true;
+    if (node->type != XML_ENTITY_REF_NODE && node->children != NULL) {
+      node = node->children;
+      continue;
+    }
+    while (node != NULL && node->next == NULL) {
+      node = node->parent;
+      if (node == reinterpret_cast<xmlNodePtr>(doc_)) node = NULL;
+    }
+    if (node != NULL) node = node->next;
+  }
+  return false;
+}
+
+xmlXPathObjectPtr XPathWrapper::EvalExpression(const string& expr) const {
+  if (BudgetExhausted()) return NULL;
+  VLOG(1) << "Evaluating expression: " << expr;
+  xmlXPathObjectPtr xpath_obj =
+      xmlXPathEvalExpression(BAD_CAST expr.c_str(), context_);
+  if (xpath_obj != NULL) return xpath_obj;
+#if LIBXML_VERSION >= 20911
+  // libxml2 pins opCount to opLimit when the limit is exceeded.
+  if (context_->opLimit != 0 && context_->opCount >= context_->opLimit) {
+    VLOG(1) << "XPath op limit exceeded: " << expr;
+    budget_exhausted_ = true;
+    return NULL;
+  }
+#endif
+  LOG(FATAL) << "Invalid expression: " << expr;
+  return NULL;
+}
+
 /* static */
 XPathWrapper* XPathWrapper::NewXPathWrapper(const StringPiece& url,
                                             const StringPiece& content,
                                             ContentType content_type) {
-  const char* content_data = content.data();
-  const char* body = HTTPUtils::SkipHttpHeaders(content_data, content.size());
-  uint32 body_size = content.size();
-  if (body == NULL) {
-    body = content_data;
-  } else {
-    body_size -= (body - content_data);
+  return NewXPathWrapper(url, content, content_type, NULL);
+}
+
+/* static */
+XPathWrapper* XPathWrapper::NewXPathWrapper(const StringPiece& url,
+                                            const StringPiece& content,
+                                            ContentType content_type,
+                                            ParseStats* stats) {
+  if (content_type != CONTENT_TYPE_HTML && content_type != CONTENT_TYPE_XML) {
+    return NULL;
+  }
+
+  const int64 start_nanos = stats != NULL ? MonotonicNanos() : 0;
+  const StringPiece body = HTTPUtils::HttpBody(content);
+  if (stats != NULL) {
+    stats->set_skip_http_headers_nanos(MonotonicNanos() - start_nanos);
+  }
+  return NewXPathWrapperFromBody(url, body, content_type, stats);
+}
+
+/* static */
+XPathWrapper* XPathWrapper::NewXPathWrapperFromBody(const StringPiece& url,
+                                                    const StringPiece& body,
+                                                    ContentType content_type,
+                                                    ParseStats* stats) {
+  if (content_type != CONTENT_TYPE_HTML && content_type != CONTENT_TYPE_XML) {
+    return NULL;
   }
 
+  const int64 start_nanos = stats != NULL ? MonotonicNanos() : 0;
+  xmlDocPtr doc_ptr;
   if (content_type == CONTENT_TYPE_HTML) {
-    htmlDocPtr doc_ptr = htmlReadMemory(
-        body, body_size, url.data(), NULL /* encoding */,
+    doc_ptr = htmlReadMemory(
+        body.data(), body.size(), url.data(), NULL /* encoding */,
         HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
-    return new XPathWrapper(doc_ptr);
-  } else if (content_type == CONTENT_TYPE_XML) {
-    xmlDocPtr doc_ptr = xmlReadMemory(
-        body, body_size, url.data(), NULL /* encoding */,
-        XML_PARSE_NONET);
-    return new XPathWrapper(doc_ptr);
   } else {
-    return NULL;
+    doc_ptr = xmlReadMemory(
+        body.data(), body.size(), url.data(), NULL /* encoding */,
+        XML_PARSE_NONET);
+  }
+  XPathWrapper* wrapper = new XPathWrapper(doc_ptr);
+  if (stats != NULL) {
+    stats->set_dom_build_nanos(MonotonicNanos() - start_nanos);
   }
+  return wrapper;
 }
 
 }  // namespace xpaf
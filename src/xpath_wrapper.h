@@ -21,6 +21,7 @@
 #include <libxml/tree.h>   // for xmlDocPtr
 #include <libxml/xpath.h>  // for xmlXPathContextPtr
 
+#include "base/integral_types.h"
 #include "base/macros.h"
 #include "base/stl_decl.h"
 #include "document.h"  // for ContentType
@@ -29,6 +30,8 @@ class StringPiece;
 
 namespace xpaf {
 
+class ParseStats;
+
 class XPathWrapper {
  public:
   // Takes ownership of 'doc'.
@@ -38,16 +41,74 @@ class XPathWrapper {
 
   xmlXPathObjectPtr EvalExpressionOrDie(const string& expr) const;
 
+  // Limits the work done by subsequent EvalExpression() calls.
+  // 'deadline_nanos' is a MonotonicNanos() value, and 'max_xpath_ops' bounds
+  // the total number of XPath operations across all evaluations (requires
+  // libxml2 2.9.11 or later; ignored otherwise). Zero means no limit.
+  void SetBudget(int64 deadline_nanos, int64 max_xpath_ops);
+
+  // Returns true once the deadline has passed or the op limit has been hit.
+  bool BudgetExhausted() const;
+
+  // Returns true if an earlier BudgetExhausted() or EvalExpression() call found
+  // the budget exhausted, i.e. if the caller has had to skip some work.
+  bool budget_exhausted() const { return budget_exhausted_; }
+
+  // Marks the budget exhausted, so that parsing stops at the next check. Used
+  // when a per-document output limit is reached.
+  void ExhaustBudget() const { budget_exhausted_ = true; }
+
+  // Records that some query results were dropped because of
+  // ParseOptions.max_results_per_query. Unlike ExhaustBudget(), doesn't stop
+  // parsing.
+  void SetResultsTruncated() const { results_truncated_ = true; }
+
+  // Returns true if output for this document is incomplete, either because
+  // the budget ran out or because query results were dropped.
+  bool truncated() const { return budget_exhausted_ || results_truncated_; }
+
+  // Returns true if the DOM has more than 'max_nodes' nodes, not counting
+  // attributes. Stops counting once 'max_nodes' is exceeded.
+  bool HasMoreNodesThan(int64 max_nodes) const;
+
+  // Like EvalExpressionOrDie(), but returns NULL without evaluating 'expr' if
+  // the budget is exhausted, and returns NULL if evaluation is cut short by
+  // the op limit.
+  xmlXPathObjectPtr EvalExpression(const string& expr) const;
+
   // Constructs an XPathWrapper for the given document. Ignores HTTP headers.
   // Returns NULL if 'content_type' is neither HTML nor XML.
   static XPathWrapper* NewXPathWrapper(const StringPiece& url,
                                        const StringPiece& content,
                                        ContentType content_type);
 
+  // Like NewXPathWrapper() above, but if 'stats' is non-NULL, also records the
+  // time spent skipping HTTP headers and building the DOM.
+  static XPathWrapper* NewXPathWrapper(const StringPiece& url,
+                                       const StringPiece& content,
+                                       ContentType content_type,
+                                       ParseStats* stats);
+
+  // Like NewXPathWrapper() above, but 'body' must already have its HTTP headers
+  // removed, e.g. by HTTPUtils::HttpBody(). If 'stats' is non-NULL, records the
+  // time spent building the DOM.
+  static XPathWrapper* NewXPathWrapperFromBody(const StringPiece& url,
+                                               const StringPiece& body,
+                                               ContentType content_type,
+                                               ParseStats* stats);
+
  private:
   xmlDocPtr doc_;
   xmlXPathContextPtr context_;
 
+  // Zero if there's no deadline.
+  int64 deadline_nanos_;
+  // Per-document parse state. Mutable so that parsers, which take a const
+  // XPathWrapper&, can record when they run out of budget or drop results.
+  // Once set, never cleared.
+  mutable bool budget_exhausted_;
+  mutable bool results_truncated_;
+
   DISALLOW_COPY_AND_ASSIGN(XPathWrapper);
 };
 